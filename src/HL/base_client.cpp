@@ -22,21 +22,51 @@
 
 using namespace HL;
 
+namespace
+{
+	BaseClient* ConsoleClient = nullptr; // owner of global console commands and cvars
+	int NoConsoleScopes = 0;
+}
+
+BaseClient::NoConsoleScope::NoConsoleScope()
+{
+	NoConsoleScopes += 1;
+}
+
+BaseClient::NoConsoleScope::~NoConsoleScope()
+{
+	NoConsoleScopes -= 1;
+}
+
 BaseClient::BaseClient(bool hltv) : Networking(),
 	mHLTV(hltv)
 {
-	CONSOLE->registerCVar("dlogs", { "bool" }, CVAR_GETTER_BOOL(mDlogs), CVAR_SETTER_BOOL(mDlogs));
-	CONSOLE->registerCVar("dlogs_events", { "bool" }, CVAR_GETTER_BOOL(mDlogsEvents), CVAR_SETTER_BOOL(mDlogsEvents));
-	CONSOLE->registerCVar("dlogs_gmsg", { "bool" }, CVAR_GETTER_BOOL(mDlogsGmsg), CVAR_SETTER_BOOL(mDlogsGmsg));
-	CONSOLE->registerCVar("dlogs_temp_ents", { "bool" }, CVAR_GETTER_BOOL(mDlogsTempEnts), CVAR_SETTER_BOOL(mDlogsTempEnts));
-	CONSOLE->registerCVar("cl_timeout", { "seconds" }, CVAR_GETTER_FLOAT(mTimeout), CVAR_SETTER_FLOAT(mTimeout));
-
-	CONSOLE->registerCommand("connect", "connect to the server", { "address" }, CMD_METHOD(onConnect));
-	CONSOLE->registerCommand("disconnect", "disconnect from server", CMD_METHOD(onDisconnect));
-	CONSOLE->registerCommand("retry", "connect to the last server", CMD_METHOD(onRetry));
-	CONSOLE->registerCommand("cmd", "send command to server", CMD_METHOD(onCmd));
-	CONSOLE->registerCommand("fullserverinfo", "receiving from server", { "text" }, CMD_METHOD(onFullServerInfo));
-	CONSOLE->registerCommand("reconnect", CMD_METHOD(onReconnect));
+	if (ConsoleClient == nullptr && NoConsoleScopes == 0)
+		ConsoleClient = this;
+
+	addCVar("dlogs", "", { "bool" }, CVAR_GETTER_BOOL(mDlogs), CVAR_SETTER_BOOL(mDlogs));
+	addCVar("dlogs_events", "", { "bool" }, CVAR_GETTER_BOOL(mDlogsEvents), CVAR_SETTER_BOOL(mDlogsEvents));
+	addCVar("dlogs_gmsg", "", { "bool" }, CVAR_GETTER_BOOL(mDlogsGmsg), CVAR_SETTER_BOOL(mDlogsGmsg));
+	addCVar("dlogs_temp_ents", "", { "bool" }, CVAR_GETTER_BOOL(mDlogsTempEnts), CVAR_SETTER_BOOL(mDlogsTempEnts));
+	addCVar("cl_timeout", "", { "seconds" }, CVAR_GETTER_FLOAT(mTimeout), CVAR_SETTER_FLOAT(mTimeout));
+	addCVar("cl_cmdrate", "usercmds per second", { "int" }, CVAR_GETTER_INT(mCmdRate),
+		CVAR_SETTER(mCmdRate = std::clamp(CON_ARG_INT(0), 10, 1000)));
+	addCVar("cl_dlwindow", "resources requested at once", { "int" }, CVAR_GETTER_INT(mDownloads.getWindow()),
+		CVAR_SETTER(mDownloads.setWindow(std::clamp(CON_ARG_INT(0), 1, 64))));
+	addCVar("cl_cmdbackup", "previous usercmds resent in every move", { "int" }, CVAR_GETTER_INT(mCmdBackup),
+		CVAR_SETTER(mCmdBackup = std::clamp(CON_ARG_INT(0), 0, MaxBackupCommands)));
+
+	addCommand("connect", "connect to the server", { "address" }, CMD_METHOD(onConnect));
+	addCommand("disconnect", "disconnect from server", {}, CMD_METHOD(onDisconnect));
+	addCommand("retry", "connect to the last server", {}, CMD_METHOD(onRetry));
+	addCommand("cmd", "send command to server", {}, CMD_METHOD(onCmd));
+	addCommand("fullserverinfo", "receiving from server", { "text" }, CMD_METHOD(onFullServerInfo));
+	addCommand("reconnect", "", {}, CMD_METHOD(onReconnect));
+	addCommand("netstats", "print channel metrics", { "json" }, CMD_METHOD(onNetStats));
+	addCommand("downloads", "print resource downloads progress", {}, CMD_METHOD(onDownloads));
+	addCommand("svcstats", "print count, size and decode time of server messages", { "reset" }, CMD_METHOD(onSvcStats));
+
+	registerMessageHandlers();
 
 	/*
 
@@ -70,7 +100,7 @@ BaseClient::BaseClient(bool hltv) : Networking(),
 
 	addUserInfo("rate", "Client Rate",
 		CVAR_GETTER(mUserInfoRate),
-		CVAR_SETTER(mUserInfoRate = CON_ARG(0)));
+		CVAR_SETTER(mUserInfoRate = CON_ARG(0); applyRate()));
 
 	addUserInfo("topcolor", "Client Top Color",
 		CVAR_GETTER(mUserInfoTopColor),
@@ -90,9 +120,87 @@ BaseClient::BaseClient(bool hltv) : Networking(),
 }
 BaseClient::~BaseClient()
 {
+	// global commands stay registered, but do nothing without owner
+
+	if (ConsoleClient == this)
+		ConsoleClient = nullptr;
 }
 
 void BaseClient::onFrame()
+{
+	if (mExternalFrames)
+		return;
+
+	update();
+}
+
+void BaseClient::frame()
+{
+	receivePackets();
+	update();
+
+	if (mChannel.has_value())
+		mChannel->frame();
+
+	flushPackets();
+}
+
+void BaseClient::setExternalFrames(bool value)
+{
+	mExternalFrames = value;
+	setSocketExternalFrames(value);
+
+	if (mChannel.has_value())
+		mChannel->setExternalFrames(value);
+}
+
+void BaseClient::executeStuffedCommands()
+{
+	auto cmds = std::move(mStuffedCommands);
+	mStuffedCommands.clear();
+
+	for (const auto& cmd : cmds)
+		CONSOLE->execute(cmd);
+}
+
+void BaseClient::execute(const std::string& cmd)
+{
+	auto args = Console::System::MakeTokensFromString(cmd);
+
+	if (args.empty())
+		return;
+
+	auto name = args[0];
+	std::transform(name.begin(), name.end(), name.begin(), tolower);
+
+	if (executeLocal(name, { args.begin() + 1, args.end() }))
+		return;
+
+	CONSOLE->execute(cmd);
+}
+
+bool BaseClient::executeLocal(const std::string& name, const std::vector<std::string>& args)
+{
+	if (auto it = mConsoleCommands.find(name); it != mConsoleCommands.end())
+	{
+		it->second(args);
+		return true;
+	}
+
+	if (auto it = mConsoleCVars.find(name); it != mConsoleCVars.end())
+	{
+		// bare name only prints value in console, nothing to do for client
+
+		if (!args.empty())
+			it->second.setter(args);
+
+		return true;
+	}
+
+	return false;
+}
+
+void BaseClient::update()
 {
 	if (mState == State::Challenging)
 	{
@@ -116,8 +224,59 @@ void BaseClient::onFrame()
 		if (now - prev_time >= Clock::FromSeconds(mTimeout))
 		{
 			disconnect("timed out");
+			return;
 		}
 	}
+
+	// channel sends only keepalives while we have nothing to say,
+	// so ask for a packet whenever a new usercmd should go out
+
+	bool moving = (mResourcesVerified || mResourcesVerifying) && !mHLTV;
+
+	if (mChannel.has_value() && moving)
+		think();
+
+	if (mChannel.has_value() && (mNewCommands > 0 || mResourcesVerifying))
+		mChannel->requestTransmit();
+}
+
+void BaseClient::think()
+{
+	auto now = Clock::Now();
+
+	if (now - mCommandTime < Clock::FromSeconds(1.0f / static_cast<float>(mCmdRate)))
+		return;
+
+	auto msec = std::clamp<int64_t>(static_cast<int64_t>(Clock::ToMilliseconds(now - mCommandTime)), 1, 255);
+
+	mCommandTime = now;
+
+	if (mCommands.size() == MaxCommands)
+		mCommands.pop_front();
+
+	auto& cmd = mCommands.push_back();
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.msec = static_cast<uint8_t>(msec);
+
+	if (mThinkCallback && mSignonNum == 2)
+		mThinkCallback(cmd);
+
+	mNewCommands = std::min(mNewCommands + 1, mCommands.size());
+}
+
+void BaseClient::applyRate()
+{
+	if (!mChannel.has_value())
+		return;
+
+	try
+	{
+		mChannel->setRate(std::stoi(mUserInfoRate));
+	}
+	catch (const std::exception& e)
+	{
+		Utils::Log("bad rate \"{}\": {}", mUserInfoRate, e.what());
+	}
 }
 
 #pragma region read
@@ -221,14 +380,22 @@ void BaseClient::readConnectionlessAccepted(Network::Packet& packet)
 	if (mServerAdr != packet.adr)
 		return;
 
-	mChannel.emplace(getSocket(),
-		[&](auto& msg) { readRegularMessages(msg); },
-		[&](auto& msg) { writeRegularMessages(msg); },
-		[&](auto name, auto& msg) { receiveFile(name, msg); });
+	{
+		// channel registers in frame system
+		std::lock_guard lock(Utils::GetGlobalMutex());
+
+		mChannel.emplace([&](auto& packet) { sendPacket(packet); },
+			[&](auto& msg) { readRegularMessages(msg); },
+			[&](auto& msg) { writeRegularMessages(msg); },
+			[&](auto name, auto& msg) { receiveFile(name, msg); });
+	}
 
 	mChannel->setAddress(mServerAdr.value());
+	mChannel->setExternalFrames(mExternalFrames);
+
+	applyRate();
 
-	sky::Log("connection accepted");
+	Utils::Log("connection accepted");
 
 	mState = State::Connected;
 
@@ -241,268 +408,152 @@ void BaseClient::readConnectionlessReject(Network::Packet& packet)
 	disconnect(fmt::format("connection rejected ({})", reason));
 }
 
+void BaseClient::registerMessageHandlers()
+{
+	using Message = Protocol::Server::Message;
+
+	setMessageHandler(Message::Bad, [this](auto&) { disconnect("svc_bad"); });
+	setMessageHandler(Message::Nop, [](auto&) { });
+	setMessageHandler(Message::Choke, [](auto&) { });
+	setMessageHandler(Message::Disconnect, [this](auto& msg) { readRegularDisconnect(msg); });
+	setMessageHandler(Message::Event, [this](auto& msg) { readRegularEvent(msg); });
+	setMessageHandler(Message::Version, [this](auto& msg) { readRegularVersion(msg); });
+	setMessageHandler(Message::SetView, [this](auto& msg) { readRegularSetView(msg); });
+	setMessageHandler(Message::Sound, [this](auto& msg) { readRegularSound(msg); });
+	setMessageHandler(Message::Time, [this](auto& msg) { readRegularTime(msg); });
+	setMessageHandler(Message::Print, [this](auto& msg) { readRegularPrint(msg); });
+	setMessageHandler(Message::StuffText, [this](auto& msg) { readRegularStuffText(msg); });
+	setMessageHandler(Message::SetAngle, [this](auto& msg) { readRegularAngle(msg); });
+	setMessageHandler(Message::ServerInfo, [this](auto& msg) { readRegularServerInfo(msg); });
+	setMessageHandler(Message::LightStyle, [this](auto& msg) { readRegularLightStyle(msg); });
+	setMessageHandler(Message::UpdateUserinfo, [this](auto& msg) { readRegularUserInfo(msg); });
+	setMessageHandler(Message::DeltaDescription, [this](auto& msg) { readRegularDeltaDescription(msg); });
+	setMessageHandler(Message::ClientData, [this](auto& msg) { readRegularClientData(msg); });
+	setMessageHandler(Message::Pings, [this](auto& msg) { readRegularPings(msg); });
+	setMessageHandler(Message::EventReliable, [this](auto& msg) { readRegularEventReliable(msg); });
+	setMessageHandler(Message::SpawnBaseline, [this](auto& msg) { readRegularSpawnBaseline(msg); });
+	setMessageHandler(Message::TempEntity, [this](auto& msg) { readRegularTempEntity(msg); });
+	setMessageHandler(Message::SignonNum, [this](auto& msg) { readRegularSignonNum(msg); });
+	setMessageHandler(Message::SpawnStaticSound, [this](auto& msg) { readRegularStaticSound(msg); });
+	setMessageHandler(Message::CDTrack, [this](auto& msg) { readRegularCDTrack(msg); });
+	setMessageHandler(Message::WeaponAnim, [this](auto& msg) { readRegularWeaponAnim(msg); });
+	setMessageHandler(Message::DecalName, [this](auto& msg) { readRegularDecalName(msg); });
+	setMessageHandler(Message::RoomType, [this](auto& msg) { readRegularRoomType(msg); });
+	setMessageHandler(Message::NewUserMsg, [this](auto& msg) { readRegularUserMsg(msg); });
+	setMessageHandler(Message::PacketEntities, [this](auto& msg) { readRegularPacketEntities(msg, false); });
+	setMessageHandler(Message::DeltaPacketEntities, [this](auto& msg) { readRegularPacketEntities(msg, true); });
+	setMessageHandler(Message::ResourceList, [this](auto& msg) { readRegularResourceList(msg); });
+	setMessageHandler(Message::NewMoveVars, [this](auto& msg) { readRegularMoveVars(msg); });
+	setMessageHandler(Message::ResourceRequest, [this](auto& msg) { readRegularResourceRequest(msg); });
+	setMessageHandler(Message::Customization, [this](auto& msg) { readRegularCustomization(msg); });
+	setMessageHandler(Message::FileTxferFailed, [this](auto& msg) { readFileTxferFailed(msg); });
+	setMessageHandler(Message::HLTV, [this](auto& msg) { readRegularHLTV(msg); });
+	setMessageHandler(Message::Director, [this](auto& msg) { readRegularDirector(msg); });
+	setMessageHandler(Message::VoiceInit, [this](auto& msg) { readRegularVoiceInit(msg); });
+	setMessageHandler(Message::SendExtraInfo, [this](auto& msg) { readRegularSendExtraInfo(msg); });
+	setMessageHandler(Message::ResourceLocation, [this](auto& msg) { readRegularResourceLocation(msg); });
+	setMessageHandler(Message::SendCVarValue, [this](auto& msg) { readRegularCVarValue(msg); });
+	setMessageHandler(Message::SendCVarValue2, [this](auto& msg) { readRegularCVarValue2(msg); });
+}
+
+void BaseClient::setMessageHandler(Protocol::Server::Message svc, MessageHandler handler)
+{
+	mMessageHandlers.at(static_cast<size_t>(svc)) = std::move(handler);
+}
+
 void BaseClient::readRegularMessages(sky::BitBuffer& msg)
 {
-	std::list<Protocol::Server::Message> history;
+	// last messages of packet for error log, without allocations
+
+	std::array<uint8_t, MessageHistorySize> history;
+	size_t history_count = 0;
 
 	while (msg.hasRemaining())
 	{
 		auto index = msg.read<uint8_t>();
 
-		if (index > 64)
+		history[history_count++ % MessageHistorySize] = index;
+
+		auto start_position = msg.getPosition();
+		auto start_time = Clock::Now();
+
+		if (index >= MaxServerMessages)
 		{
 			readRegularGameMessage(msg, index);
-			continue;
 		}
-		auto svc = static_cast<Protocol::Server::Message>(index);
-
-		history.push_back(svc);
-
-		switch (svc)
+		else if (mMessageHandlers[index])
 		{
-		case Protocol::Server::Message::Bad:
-			disconnect("svc_bad");
-			return;
+			mMessageHandlers[index](msg);
+		}
+		else
+		{
+			// TODO: should disconnect
 
-		case Protocol::Server::Message::Nop:
-			break;
+			std::string history_str;
 
-		case Protocol::Server::Message::Disconnect:
-			readRegularDisconnect(msg);
-			return;
+			for (size_t i = history_count > MessageHistorySize ? history_count - MessageHistorySize : 0; i < history_count; i++)
+			{
+				auto id = history[i % MessageHistorySize];
+				auto name = id < MaxServerMessages ? magic_enum::enum_name(static_cast<Protocol::Server::Message>(id)) : "";
 
-		case Protocol::Server::Message::Event:
-			readRegularEvent(msg);
-			break;
-
-		case Protocol::Server::Message::Version:
-			readRegularVersion(msg);
-			break;
-
-		case Protocol::Server::Message::SetView:
-			readRegularSetView(msg);
-			break;
-
-		case Protocol::Server::Message::Sound:
-			readRegularSound(msg);
-			break;
-
-		case Protocol::Server::Message::Time:
-			readRegularTime(msg);
-			break;
-
-		case Protocol::Server::Message::Print:
-			readRegularPrint(msg);
-			break;
-
-		case Protocol::Server::Message::StuffText:
-			readRegularStuffText(msg);
-			break;
-
-		case Protocol::Server::Message::SetAngle:
-			readRegularAngle(msg);
-			break;
-
-		case Protocol::Server::Message::ServerInfo:
-			readRegularServerInfo(msg);
-			break;
-
-		case Protocol::Server::Message::LightStyle:
-			readRegularLightStyle(msg);
-			break;
-
-		case Protocol::Server::Message::UpdateUserinfo:
-			readRegularUserInfo(msg);
-			break;
-
-		case Protocol::Server::Message::DeltaDescription:
-			readRegularDeltaDescription(msg);
-			break;
-
-		case Protocol::Server::Message::ClientData:
-			readRegularClientData(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::StopSound:
-		*/
-
-		case Protocol::Server::Message::Pings:
-			readRegularPings(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::Particle:
-		case Protocol::Server::Message::Damage:
-		case Protocol::Server::Message::SpawnStatic:
-		*/
-
-		case Protocol::Server::Message::EventReliable:
-			readRegularEventReliable(msg);
-			break;
-
-		case Protocol::Server::Message::SpawnBaseline:
-			readRegularSpawnBaseline(msg);
-			break;
-
-		case Protocol::Server::Message::TempEntity:
-			readRegularTempEntity(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::SetPause:
-		*/
-
-		case Protocol::Server::Message::SignonNum:
-			readRegularSignonNum(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::CenterPrint:
-		case Protocol::Server::Message::KilledMonster:
-		case Protocol::Server::Message::FoundSecret:
-		*/
-
-		case Protocol::Server::Message::SpawnStaticSound:
-			readRegularStaticSound(msg);
-			break;
-		/*
-		case Protocol::Server::Message::Intermission:
-		case Protocol::Server::Message::Finale:
-		*/
-
-		case Protocol::Server::Message::CDTrack:
-			readRegularCDTrack(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::Restore:
-		case Protocol::Server::Message::CutScene:
-		*/
-
-		case Protocol::Server::Message::WeaponAnim:
-			readRegularWeaponAnim(msg);
-			break;
-
-		case Protocol::Server::Message::DecalName:
-			readRegularDecalName(msg);
-			break;
-
-		case Protocol::Server::Message::RoomType:
-			readRegularRoomType(msg);
-			break;
-
-		/*case Protocol::Server::Message::AddAngle:
-		*/
-
-		case Protocol::Server::Message::NewUserMsg:
-			readRegularUserMsg(msg);
-			break;
-
-		case Protocol::Server::Message::PacketEntities:
-			readRegularPacketEntities(msg, false);
-			break;
-
-		case Protocol::Server::Message::DeltaPacketEntities:
-			readRegularPacketEntities(msg, true);
-			break;
-
-		case Protocol::Server::Message::Choke:
-			break;
-
-		case Protocol::Server::Message::ResourceList:
-			readRegularResourceList(msg);
-			break;
-
-		case Protocol::Server::Message::NewMoveVars:
-			readRegularMoveVars(msg);
-			break;
-
-		case Protocol::Server::Message::ResourceRequest:
-			readRegularResourceRequest(msg);
-			break;
-
-		case Protocol::Server::Message::Customization:
-			readRegularCustomization(msg);
-			break;
-			/*
-		case Protocol::Server::Message::CrosshairAngle:
-		case Protocol::Server::Message::SoundFade:		*/
-
-		case Protocol::Server::Message::FileTxferFailed: 
-			readFileTxferFailed(msg);
-			break;
-
-		case Protocol::Server::Message::HLTV:
-			readRegularHLTV(msg);
-			break;
-
-		case Protocol::Server::Message::Director:
-			readRegularDirector(msg);
-			break;
-
-		case Protocol::Server::Message::VoiceInit:
-			readRegularVoiceInit(msg);
-			break;
-
-		/*
-		case Protocol::Server::Message::VoiceData:
-		*/
-
-		case Protocol::Server::Message::SendExtraInfo:
-			readRegularSendExtraInfo(msg);
-			break;
-		/*
-		case Protocol::Server::Message::TimeScale:
-		*/
-
-		case Protocol::Server::Message::ResourceLocation:
-			readRegularResourceLocation(msg);
-			break;
-
-		case Protocol::Server::Message::SendCVarValue:
-			readRegularCVarValue(msg);
-			break;
-
-		case Protocol::Server::Message::SendCVarValue2:
-			readRegularCVarValue2(msg);
-			break;
-
-		default:
-			// TODO: should disconnect 
+				if (!history_str.empty())
+					history_str += ", ";
 
-			auto history_str = std::accumulate(history.begin(), history.end(), std::string(magic_enum::enum_name(*history.begin())),
-				[](auto a, auto b) { return a + ", " + std::string(magic_enum::enum_name(b)); });
+				history_str += name.empty() ? std::to_string(id) : std::string(name);
+			}
 
-			sky::Log(Console::Color::Red, "unknown svc: {}, history: {}", index, history_str);
+			Utils::Log(Console::Color::Red, "unknown svc: {}, history: {}", index, history_str);
 			return;
 		}
+
+		// handler may disconnect, message buffer is gone then
+
+		if (mState == State::Disconnected)
+			return;
+
+		auto& stats = mMessageStats[index];
+		stats.count += 1;
+		stats.bytes += msg.getPosition() - start_position + 1;
+		stats.time += Clock::Now() - start_time;
 	}
 }
 
 void BaseClient::readRegularGameMessage(sky::BitBuffer& msg, uint8_t index)
 {
-	assert(mGameMessages.count(index) != 0);
+	const auto& gmsg = mGameMessages[index];
+
+	assert(gmsg.has_value());
 
-	if (mGameMessages.count(index) == 0)
+	if (!gmsg.has_value())
 		return;
 
-	const auto& gmsg = mGameMessages.at(index);
-	auto size = gmsg.size;
+	auto size = gmsg->size;
 
 	if (size == 255)
 		size = msg.read<uint8_t>();
 
-	sky::BitBuffer buf;
-	buf.setSize(size);
-	msg.read(buf.getMemory(), size);
-
 	if (mDlogsGmsg)
-		Utils::dlog("{}", gmsg.name);
+		Utils::dlog("{}", gmsg->name);
+
+	// callback reads right from packet memory
+
+	if (auto callback = mGameMessageCallbacks[index]; callback != nullptr)
+	{
+		BitReader bits(msg.getPositionMemory(), std::min<size_t>(size, msg.getRemaining()));
+		(*callback)(bits);
+	}
+
+	msg.seek(size);
+}
 
-	if (mGameMod)
+void BaseClient::bindGameMessages()
+{
+	for (size_t i = 0; i < mGameMessages.size(); i++)
 	{
-		mGameMod->readMessage(gmsg.name, buf);
+		if (mGameMod && mGameMessages[i].has_value())
+			mGameMessageCallbacks[i] = mGameMod->findReadCallback(mGameMessages[i]->name);
+		else
+			mGameMessageCallbacks[i] = nullptr;
 	}
 }
 
@@ -510,10 +561,35 @@ void BaseClient::receiveFile(std::string_view fileName, sky::BitBuffer& msg)
 {
 	auto game_dir = mServerInfo.value().game_dir;
     Platform::Asset::Write(game_dir + "/" + std::string(fileName), msg.getMemory(), msg.getSize(), HL_ASSET_STORAGE);
-	mDownloadQueue.remove_if([fileName](auto a) { return a == fileName; });
 
-	sky::Log("received: \"" + std::string(fileName) + "\", size: " +
-		Common::Helpers::BytesToNiceString(msg.getSize()) /*+ ", Left: " + std::to_string(mDownloadQueue.size())*/);
+	auto requested = mDownloads.onReceived(std::string(fileName), msg.getSize());
+
+	if (auto resource = mResources.find(fileName); resource != nullptr && mConfirmationRequired &&
+		(resource->flags & Protocol::RES_CHECKFILE) && !(resource->flags & Protocol::RES_RESERVED))
+	{
+		mHashCache->prefetch(game_dir + "/" + std::string(fileName));
+	}
+
+	Utils::Log("received: \"" + std::string(fileName) + "\", size: " +
+		Common::Helpers::BytesToNiceString(msg.getSize()));
+
+	if (requested)
+		requestDownloads();
+}
+
+void BaseClient::requestDownloads()
+{
+	auto names = mDownloads.takeRequests();
+
+	if (names.empty())
+		return;
+
+	for (const auto& name : names)
+		sendCommand("dlfile " + name);
+
+	// one fragmented buffer for whole batch, commands are too small for bzip2 to help
+
+	mChannel->fragmentateReliableBuffer(512, false);
 }
 
 void BaseClient::readRegularDisconnect(sky::BitBuffer& msg)
@@ -524,7 +600,9 @@ void BaseClient::readRegularDisconnect(sky::BitBuffer& msg)
 
 void BaseClient::readRegularEvent(sky::BitBuffer& msg)
 {
-	auto count = msg.readBits(5);
+	BitReader bits(msg);
+
+	auto count = bits.readBits(5);
 
 	for (uint32_t i = 0; i < count; i++)
 	{
@@ -533,18 +611,18 @@ void BaseClient::readRegularEvent(sky::BitBuffer& msg)
 		evt.packet_index = -1;
 		evt.entity_index = -1;
 
-		evt.index = msg.readBits(10);
+		evt.index = bits.readBits(10);
 
-		if (msg.readBit()) 
+		if (bits.readBit()) 
 		{
-			evt.packet_index = msg.readBits(11);
+			evt.packet_index = bits.readBits(11);
 
-			if (msg.readBit())
-				mDelta.readEvent(msg, evt.args);
+			if (bits.readBit())
+				mDelta.readEvent(bits, evt.args);
 		}
 
-		if (msg.readBit())
-			evt.fire_time = static_cast<float>(msg.readBits(16));
+		if (bits.readBit())
+			evt.fire_time = static_cast<float>(bits.readBits(16));
 
 		if (mDlogsEvents)
 		{
@@ -559,7 +637,7 @@ void BaseClient::readRegularEvent(sky::BitBuffer& msg)
 			mEventCallback(evt);
 	}
 
-	msg.alignByteBoundary();
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 }
 
 void BaseClient::readRegularVersion(sky::BitBuffer& msg)
@@ -574,34 +652,36 @@ void BaseClient::readRegularSetView(sky::BitBuffer& msg)
 
 void BaseClient::readRegularSound(sky::BitBuffer& msg)
 {
+	BitReader bits(msg);
+
 	Protocol::Sound sound;
 
 	sound.volume = Protocol::VOL_NORM;
 	sound.attenuation = Protocol::ATTN_NORM;
 	sound.pitch = Protocol::PITCH_NORM;
 
-	sound.flags = msg.readBits(9);
+	sound.flags = bits.readBits(9);
 
 	if (sound.flags & Protocol::SND_VOLUME) 
-		sound.volume = msg.readBits(8);
+		sound.volume = bits.readBits(8);
 
 	if (sound.flags & Protocol::SND_ATTN)
-			sound.attenuation = static_cast<float>(msg.readBits(8)); // TODO: confirm static cast
+			sound.attenuation = static_cast<float>(bits.readBits(8)); // TODO: confirm static cast
 
-	sound.channel = msg.readBits(3); // if chan = 6 then static sound ? (from ida)
-	sound.entity = msg.readBits(11);
+	sound.channel = bits.readBits(3); // if chan = 6 then static sound ? (from ida)
+	sound.entity = bits.readBits(11);
 
 	if (sound.flags & Protocol::SND_LONG_INDEX)
-		sound.index = msg.readBits(16);
+		sound.index = bits.readBits(16);
 	else
-		sound.index = msg.readBits(8);
+		sound.index = bits.readBits(8);
 
-	sky::bitbuffer_helpers::ReadBitVec3(msg, sound.origin);
+	bits.readBitVec3(sound.origin);
 
 	if (sound.flags & Protocol::SND_PITCH)
-		sound.pitch = msg.readBits(8);
+		sound.pitch = bits.readBits(8);
 
-	msg.alignByteBoundary();
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 
 	// onSound(sound); // TODO: event
 }
@@ -614,7 +694,7 @@ void BaseClient::readRegularTime(sky::BitBuffer& msg)
 void BaseClient::readRegularPrint(sky::BitBuffer& msg)
 {
 	auto text = sky::bitbuffer_helpers::ReadString(msg);
-	sky::Log(text);
+	Utils::Log(text);
 }
 
 void BaseClient::readRegularStuffText(sky::BitBuffer& msg)
@@ -636,11 +716,22 @@ void BaseClient::readRegularStuffText(sky::BitBuffer& msg)
 		if (name.empty())
 			continue;
 
+		// own commands and cvars first, e.g. reconnect on changelevel, rate, name
+
+		if (executeLocal(name, { args.begin() + 1, args.end() }))
+			continue;
+
+		std::unique_lock lock(Utils::GetGlobalMutex());
+
 		bool shouldFeedback = CONSOLE->getCommands().count(name) == 0 && 
 			CONSOLE->getAliases().count(name) == 0 && CONSOLE->getCVars().count(name) == 0;
 
+		lock.unlock();
+
 		if (shouldFeedback)
 			sendCommand(cmd);
+		else if (mExternalFrames)
+			mStuffedCommands.push_back(cmd); // commands can touch other clients
 		else
 			CONSOLE->execute(cmd);
 	}
@@ -707,10 +798,12 @@ void BaseClient::readRegularUserInfo(sky::BitBuffer& msg)
 
 void BaseClient::readRegularDeltaDescription(sky::BitBuffer& msg)
 {
-	auto name = sky::bitbuffer_helpers::ReadString(msg);
-	auto fieldsCount = msg.readBits(16);
-	mDelta.add(msg, name, fieldsCount);
-	msg.alignByteBoundary();
+	BitReader bits(msg);
+
+	auto name = bits.readString();
+	auto fieldsCount = bits.readBits(16);
+	mDelta.add(bits, name, fieldsCount);
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 }
 
 void BaseClient::readRegularClientData(sky::BitBuffer& msg)
@@ -718,22 +811,28 @@ void BaseClient::readRegularClientData(sky::BitBuffer& msg)
 	if (mHLTV)
 		return;
 
-	if (msg.readBit())
-		msg.read<uint8_t>(); // delta sequence
+	BitReader bits(msg);
 
-	mDelta.readClientData(msg, mClientData);
+	if (bits.readBit())
+		bits.read<uint8_t>(); // delta sequence
 
-	while (msg.readBit())
+	auto sequence = mChannel->getIncomingSequence();
+
+	mDelta.readClientData(bits, mClientData);
+	mClientData.changed_tick = sequence;
+
+	while (bits.readBit())
 	{
-		auto index = msg.readBits(6); // 5 bits if protocol < 47
+		auto index = bits.readBits(6); // 5 bits if protocol < 47
 
 		if (index + 1 > m_WeaponData.size())
 			m_WeaponData.resize(index + 1);
 
-		mDelta.readWeaponData(msg, m_WeaponData[index]);
+		mDelta.readWeaponData(bits, m_WeaponData[index]);
+		m_WeaponData[index].changed_tick = sequence;
 	}
 
-	msg.alignByteBoundary();
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 }
 
 void BaseClient::readRegularPings(sky::BitBuffer& msg)
@@ -749,19 +848,21 @@ void BaseClient::readRegularPings(sky::BitBuffer& msg)
 
 void BaseClient::readRegularEventReliable(sky::BitBuffer& msg)
 {
+	BitReader bits(msg);
+
 	Protocol::Event evt;
 
 	evt.packet_index = -1;
 	evt.entity_index = -1;
 
-	evt.index = msg.readBits(10);
+	evt.index = bits.readBits(10);
 
-	mDelta.readEvent(msg, evt.args);
+	mDelta.readEvent(bits, evt.args);
 
-	if (msg.readBit())
-		evt.fire_time = static_cast<float>(msg.readBits(16)); // TODO: confirm static cast
+	if (bits.readBit())
+		evt.fire_time = static_cast<float>(bits.readBits(16)); // TODO: confirm static cast
 
-	msg.alignByteBoundary();
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 
 	if (mDlogsEvents)
 	{
@@ -775,33 +876,40 @@ void BaseClient::readRegularEventReliable(sky::BitBuffer& msg)
 
 void BaseClient::readRegularSpawnBaseline(sky::BitBuffer& msg)
 {
-	while (msg.read<uint16_t>() != 0xFFFF)
-	{
-		msg.seek(-2);
+	BitReader bits(msg);
 
-		auto index = msg.readBits(11);
-		auto& entity = mBaselines[index];
+	while (bits.peekBits(16) != 0xFFFF)
+	{
+		auto index = bits.readBits(11);
+		auto& entity = mBaselines.insert(index);
 
-		if (msg.readBits(2) & (int)Protocol::EntityType::Beam)
-			mDelta.readEntityCustom(msg, entity);
+		if (bits.readBits(2) & (int)Protocol::EntityType::Beam)
+			mDelta.readEntityCustom(bits, entity);
 		else if (isPlayerIndex(index))
-			mDelta.readEntityPlayer(msg, entity);
+			mDelta.readEntityPlayer(bits, entity);
 		else
-			mDelta.readEntityNormal(msg, entity);
+			mDelta.readEntityNormal(bits, entity);
 	}
 
-	for (uint32_t i = 0; i < msg.readBits(6); i++)
-		mDelta.readEntityNormal(msg, mExtraBaselines[i]);
+	bits.readBits(16); // 0xFFFF
 
-	msg.alignByteBoundary();
+	for (uint32_t i = 0; i < bits.readBits(6); i++)
+		mDelta.readEntityNormal(bits, mExtraBaselines.insert(i));
+
+	msg.seek(static_cast<int>(bits.getBytesRead()));
 
 	if (mBaselines.size() > 0)
-		sky::Log("{} baseline entities received", mBaselines.size());
+		Utils::Log("{} baseline entities received", mBaselines.size());
 
 	if (mExtraBaselines.size() > 0)
-		sky::Log("{} extra baseline entities received", mExtraBaselines.size());
+		Utils::Log("{} extra baseline entities received", mExtraBaselines.size());
+
+	// frames made before baselines are not valid anymore
 
-	mDeltaEntities = mBaselines;
+	mEntities.deactivate();
+	mEntityFrames.clear();
+	mLiveFrame = {};
+	mDeltaSequenceValid = false;
 }
 
 void BaseClient::readRegularTempEntity(sky::BitBuffer& msg)
@@ -973,26 +1081,30 @@ void BaseClient::readRegularDecalName(sky::BitBuffer& msg)
 	auto index = msg.read<uint8_t>();
 	auto name = sky::bitbuffer_helpers::ReadString(msg);
 
-	sky::Log(Console::Color::Red, "DecalIndex: " + std::to_string(index) + ", DecalName: " + name);
+	Utils::Log(Console::Color::Red, "DecalIndex: " + std::to_string(index) + ", DecalName: " + name);
 }
 
 void BaseClient::readRegularRoomType(sky::BitBuffer& msg)
 {
 	auto room = msg.read<int16_t>();
 
-	sky::Log(Console::Color::Red, "RoomType: " + std::to_string(room));
+	Utils::Log(Console::Color::Red, "RoomType: " + std::to_string(room));
 }
 
 void BaseClient::readRegularUserMsg(sky::BitBuffer& msg)
 {
 	auto index = msg.read<uint8_t>();
 
-	mGameMessages[index].size = msg.read<uint8_t>();
+	Protocol::GameMessage gmsg;
+	gmsg.size = msg.read<uint8_t>();
 
 	char name[16];
 	msg.read(&name, 16);
 
-	mGameMessages[index].name = name;
+	gmsg.name = std::string(name, strnlen(name, sizeof(name)));
+
+	mGameMessages[index] = std::move(gmsg);
+	mGameMessageCallbacks[index] = mGameMod ? mGameMod->findReadCallback(mGameMessages[index]->name) : nullptr;
 }
 
 void BaseClient::readRegularPacketEntities(sky::BitBuffer& msg, bool delta)
@@ -1002,120 +1114,217 @@ void BaseClient::readRegularPacketEntities(sky::BitBuffer& msg, bool delta)
 		signon(2);
 	}
 
-	auto readDeltaEntity = [this, &msg](int index, Protocol::Entity& entity, bool custom) {
+	BitReader bits(msg);
+
+	auto readDeltaEntity = [this, &bits](int index, Protocol::Entity& entity, bool custom) {
 		if (custom)
-			mDelta.readEntityCustom(msg, entity);
+			mDelta.readEntityCustom(bits, entity);
 		else if (isPlayerIndex(index))
-			mDelta.readEntityPlayer(msg, entity);
+			mDelta.readEntityPlayer(bits, entity);
 		else
-			mDelta.readEntityNormal(msg, entity);
+			mDelta.readEntityNormal(bits, entity);
 	};
 
-	auto readEntityIndex = [&msg](uint32_t& index) {
-		if (msg.readBit())
-			index = msg.readBits(11);
+	auto readEntityIndex = [&bits](uint32_t& index) {
+		if (bits.readBit())
+			index = bits.readBits(11);
 		else
-			index += msg.readBits(6);
+			index += bits.readBits(6);
+	};
+
+	auto baseline = [this](uint32_t index) {
+		return mBaselines.contains(index) ? mBaselines.at(index) : Protocol::Entity{};
 	};
 
-	auto count = msg.read<uint16_t>();
+	auto count = bits.read<uint16_t>();
+	auto sequence = mChannel->getIncomingSequence();
+
+	// find frame this delta is made from before new frame takes its slot
+
+	const EntityFrames::Frame* base = nullptr;
+
+	if (delta)
+	{
+		auto delta_sequence = bits.read<uint8_t>();
+
+		base = mEntityFrames.find(delta_sequence);
+
+		if (base != nullptr && (base->sequence & EntityFrames::UpdateMask) == (sequence & EntityFrames::UpdateMask))
+			base = nullptr;
+
+		if (base == nullptr)
+			Utils::Log(Console::Color::Red, "delta from unknown frame {}, waiting for full update", delta_sequence);
+	}
+
+	auto& frame = mEntityFrames.create(sequence);
+	auto& entities = frame.entities;
 
 	uint32_t index = 0;
 
 	if (delta)
 	{
-		auto mask = msg.read<uint8_t>();
+		// entities which are not mentioned stay the same as in base frame
 
-		mDeltaSequence = mChannel->getIncomingSequence() & 0xFF; // TODO: only in delta ?
+		size_t b = 0;
 
-		while (msg.read<uint16_t>() != 0)
-		{
-			msg.seek(-2);
+		auto copyBaseUntil = [&](uint32_t until) {
+			while (base != nullptr && b < base->entities.size() && (uint32_t)base->entities[b].first < until)
+				entities.push_back(base->entities[b++]);
+		};
 
-			bool remove = msg.readBit();
+		while (bits.peekBits(16) != 0)
+		{
+			bool remove = bits.readBit();
 
 			readEntityIndex(index);
+			copyBaseUntil(index);
+
+			EntityFrames::EntityPtr prev = nullptr;
+
+			if (base != nullptr && b < base->entities.size() && (uint32_t)base->entities[b].first == index)
+				prev = base->entities[b++].second;
 
 			if (remove)
 			{
-				if (mEntities.count(index) == 0)
-				{
-					sky::Log(Console::Color::Red, "trying to delete non existing entity " + std::to_string(index));
-				}
-				mEntities.erase(index);
+				if (base != nullptr && prev == nullptr)
+					Utils::Log(Console::Color::Red, "trying to delete non existing entity " + std::to_string(index));
+
 				continue;
 			}
 
-			auto& entity = mDeltaEntities[index];
-			mEntities[index] = &entity;
+			auto entity = std::make_shared<Protocol::Entity>(prev != nullptr ? *prev : baseline(index));
 
-			bool custom = msg.readBit();
+			bool custom = bits.readBit();
 
-			if (!mExtraBaselines.empty() && msg.readBit()) // TODO: confirm in tfc (does it has in delta packet)
+			if (!mExtraBaselines.empty() && bits.readBit()) // TODO: confirm in tfc (does it has in delta packet)
 			{
-				auto extra_index = msg.readBits(6);
-				assert(mExtraBaselines.count(extra_index) > 0);
-				sky::Log("using extra baseline {} for entity {}", extra_index, index);
-				entity = mExtraBaselines[extra_index];
+				auto extra_index = bits.readBits(6);
+				assert(mExtraBaselines.contains(extra_index));
+				Utils::Log("using extra baseline {} for entity {}", extra_index, index);
+				*entity = mExtraBaselines.at(extra_index);
 			}
 
-			readDeltaEntity(index, entity, custom);
+			readDeltaEntity(index, *entity, custom);
+			entity->changed_tick = sequence;
+			entities.push_back({ index, entity });
 		}
 
-		if (mEntities.size() != count)
-			sky::Log(Console::Color::Red, "entities size mismatch: have {}, must be {}", mEntities.size(), count);
+		bits.readBits(16); // 0
+
+		copyBaseUntil(Protocol::MAX_EDICTS);
+
+		if (base != nullptr && entities.size() != count)
+			Utils::Log(Console::Color::Red, "entities size mismatch: have {}, must be {}", entities.size(), count);
 	}
 	else
 	{
-		mEntities.clear();
-
 		for (int i = 0; i < count; i++)
 		{
-			if (msg.readBit())
+			if (bits.readBit())
 				index += 1;
 			else
 				readEntityIndex(index);
 
-			auto& entity = mDeltaEntities[index];
-			mEntities[index] = &entity;
+			auto entity = std::make_shared<Protocol::Entity>(baseline(index));
 
-			bool custom = msg.readBit();
+			bool custom = bits.readBit();
 
-			if (!mExtraBaselines.empty() && msg.readBit()) // TODO: confirm in tfc
+			if (!mExtraBaselines.empty() && bits.readBit()) // TODO: confirm in tfc
 			{
-				auto extra_index = msg.readBits(6);
-				assert(mExtraBaselines.count(extra_index) > 0);
-				sky::Log("using extra baseline {} for entity {}", extra_index, index);
-				entity = mExtraBaselines[extra_index];
+				auto extra_index = bits.readBits(6);
+				assert(mExtraBaselines.contains(extra_index));
+				Utils::Log("using extra baseline {} for entity {}", extra_index, index);
+				*entity = mExtraBaselines.at(extra_index);
 			}
-			else if (msg.readBit())
+			else if (bits.readBit())
 			{
-				auto base_index = msg.readBits(6);
-				if (mBaselines.count(base_index) > 0)
+				auto base_index = bits.readBits(6);
+				if (mBaselines.contains(base_index))
 				{
-					sky::Log("using baseline {} for entity {}", base_index, index);
-					entity = mBaselines[base_index];
+					Utils::Log("using baseline {} for entity {}", base_index, index);
+					*entity = mBaselines.at(base_index);
 				}
 				else
 				{
-					sky::Log(Console::Color::Red, "want use baseline {} for entity {}, but baseline not found", base_index, index);
+					Utils::Log(Console::Color::Red, "want use baseline {} for entity {}, but baseline not found", base_index, index);
 				}
 			}
 
-			readDeltaEntity(index, entity, custom);
+			readDeltaEntity(index, *entity, custom);
+			entity->changed_tick = sequence;
+			entities.push_back({ index, entity });
 		}
 
-		msg.read<uint16_t>();
+		bits.read<uint16_t>();
 	}
 
-	msg.alignByteBoundary();
+	msg.seek(static_cast<int>(bits.getBytesRead()));
+
+	// delta from lost frame is parsed only to skip it, server will send
+	// full update since we stop acknowledging frames
+
+	if (delta && base == nullptr)
+	{
+		mDeltaSequenceValid = false;
+		return;
+	}
+
+	frame.valid = true;
+	mDeltaSequence = sequence & 0xFF;
+	mDeltaSequenceValid = true;
+
+	// live entities, only entities that differ from previous frame are copied,
+	// changes are published as diff stream, changed fields are known only
+	// when new frame is made from the live one
+
+	bool incremental = base != nullptr && mLiveFrame.valid && base->sequence == mLiveFrame.sequence;
+
+	size_t l = 0;
+	const auto& live = mLiveFrame.entities;
+
+	mEntityChanges.clear();
+
+	auto remove = [&] {
+		auto index = live[l++].first;
+		mEntities.erase(index);
+		mEntityChanges.push_back({ EntityChange::Type::Removed, index, 0 });
+	};
+
+	for (const auto& [entity_index, entity] : entities)
+	{
+		while (l < live.size() && live[l].first < entity_index)
+			remove();
+
+		if (l < live.size() && live[l].first == entity_index)
+		{
+			if (live[l++].second == entity)
+				continue;
+
+			auto changed = incremental ? entity->changed_fields : Protocol::ENTITY_FIELD_ALL;
+			mEntityChanges.push_back({ EntityChange::Type::Updated, entity_index, changed });
+		}
+		else
+		{
+			mEntityChanges.push_back({ EntityChange::Type::Spawned, entity_index, Protocol::ENTITY_FIELD_ALL });
+		}
+
+		mEntities.insert(entity_index) = *entity;
+	}
+
+	while (l < live.size())
+		remove();
+
+	mLiveFrame = frame;
+
+	if (mEntitiesChangedCallback && !mEntityChanges.empty())
+		mEntitiesChangedCallback(mEntityChanges);
 }
 
 void BaseClient::readRegularResourceList(sky::BitBuffer& msg)
 {
-	mResources.resize(msg.readBits(12));
+	std::vector<Protocol::Resource> resources(msg.readBits(12));
 
-	for (auto& resource : mResources)
+	for (auto& resource : resources)
 	{
 		resource.type = static_cast<Protocol::Resource::Type>(msg.readBits(4));
 		resource.name = sky::bitbuffer_helpers::ReadString(msg);
@@ -1147,17 +1356,17 @@ void BaseClient::readRegularResourceList(sky::BitBuffer& msg)
 			else
 				index = msg.readBits(10);
 
-			mResources[index].flags |= Protocol::RES_CHECKFILE;
+			resources[index].flags |= Protocol::RES_CHECKFILE;
 		}
 	}
 
 	msg.alignByteBoundary();
 
-	sky::Log("{} resources received", mResources.size());
+	Utils::Log("{} resources received", resources.size());
 
 	// fix sound directory
 
-	for (auto& resource : mResources)
+	for (auto& resource : resources)
 	{
 		if (resource.type != Protocol::Resource::Type::Sound)
 			continue;
@@ -1165,6 +1374,24 @@ void BaseClient::readRegularResourceList(sky::BitBuffer& msg)
 		resource.name = "sound/" + resource.name;
 	}
 
+	mResources.assign(std::move(resources));
+
+	// local files that server will ask about are hashed while we are downloading
+
+	if (mConfirmationRequired)
+	{
+		for (const auto& resource : mResources)
+		{
+			if (!(resource.flags & Protocol::RES_CHECKFILE) || (resource.flags & Protocol::RES_RESERVED))
+				continue;
+
+			auto path = mServerInfo.value().game_dir + '/' + resource.name;
+
+			if (Platform::Asset::Exists(path, HL_ASSET_STORAGE))
+				mHashCache->prefetch(path);
+		}
+	}
+
 	mResourcesVerifying = true;
 	mResourcesVerified = false;
 
@@ -1216,7 +1443,7 @@ void BaseClient::readRegularResourceRequest(sky::BitBuffer& msg)
 	bf.write<uint8_t>((uint8_t)Protocol::Client::Message::ResourceList);
 	bf.write<int16_t>(count);
 
-	sky::Log("{} resources sent", count);
+	Utils::Log("{} resources sent", count);
 
 	mChannel->addReliableMessage(bf);
 	mChannel->fragmentateReliableBuffer(512, false);
@@ -1265,12 +1492,15 @@ void BaseClient::readRegularCustomization(sky::BitBuffer& msg)
 void BaseClient::readFileTxferFailed(sky::BitBuffer& msg)
 {
 	auto name = sky::bitbuffer_helpers::ReadString(msg);
-	sky::Log(Console::Color::Red, "failed to download file: " + name);
+	Utils::Log(Console::Color::Red, "failed to download file: " + name);
+
+	mDownloads.onFailed(name);
+	requestDownloads();
 }
 
 void BaseClient::readRegularHLTV(sky::BitBuffer& msg)
 {
-	sky::Log(Console::Color::Red, "SVC_HLTV was received");
+	Utils::Log(Console::Color::Red, "SVC_HLTV was received");
 }
 
 void BaseClient::readRegularDirector(sky::BitBuffer& msg)
@@ -1302,14 +1532,14 @@ void BaseClient::readRegularResourceLocation(sky::BitBuffer& msg)
 void BaseClient::readRegularCVarValue(sky::BitBuffer& msg)
 {
 	auto name = sky::bitbuffer_helpers::ReadString(msg);
-	sky::Log(Console::Color::Red, "SVC_SENDCVARVALUE: " + name);
+	Utils::Log(Console::Color::Red, "SVC_SENDCVARVALUE: " + name);
 }
 
 void BaseClient::readRegularCVarValue2(sky::BitBuffer& msg)
 {
 	auto id = msg.read<uint32_t>();
 	auto name = sky::bitbuffer_helpers::ReadString(msg);
-	sky::Log(Console::Color::Red, "SVC_SENDCVARVALUE2: " + std::to_string(id) + ", " + name);
+	Utils::Log(Console::Color::Red, "SVC_SENDCVARVALUE2: " + std::to_string(id) + ", " + name);
 }
 
 void BaseClient::readTempEntityBeamPoints(sky::BitBuffer& msg)
@@ -1441,7 +1671,7 @@ void BaseClient::readTempEntityBloodSprite(sky::BitBuffer& msg)
 #pragma region write
 void BaseClient::writeRegularMessages(sky::BitBuffer& msg)
 {
-	if (mResourcesVerifying && mDownloadQueue.size() == 0)
+	if (mResourcesVerifying && !mDownloads.isBusy())
 	{
 		mResourcesVerified = true;
 		mResourcesVerifying = false;
@@ -1449,7 +1679,7 @@ void BaseClient::writeRegularMessages(sky::BitBuffer& msg)
 		if (mConfirmationRequired)
 			writeRegularFileConsistency(msg);
 		else
-			sky::Log("confirmation of resources isn't required");
+			Utils::Log("confirmation of resources isn't required");
 
 		auto crc = mServerInfo.value().map_crc;
 		auto spawn_count = mServerInfo.value().spawn_count;
@@ -1472,32 +1702,46 @@ void BaseClient::writeRegularMessages(sky::BitBuffer& msg)
 
 void BaseClient::writeRegularMove(sky::BitBuffer& msg)
 {
+	if (mNewCommands == 0)
+		return;
+
+	// newest commands go as new, ones before them as backup for lost packets,
+	// server expects them from oldest to newest, each one delta from previous
+
+	auto count = std::min<size_t>(mNewCommands, MaxTotalCommands);
+	auto backup = std::min<size_t>({ static_cast<size_t>(mCmdBackup), mCommands.size() - count,
+		static_cast<size_t>(MaxTotalCommands) - count });
+	auto total = count + backup;
+
+	mNewCommands = 0;
+
 	size_t o = msg.getSize();
 
 	msg.write<uint8_t>((uint8_t)Protocol::Client::Message::Move);
 	msg.write<uint8_t>(0); // size
 	msg.write<uint8_t>(0); // checksum
 	msg.write<uint8_t>(0); // flags; send net_drops or bad clc_delta count ? 8th bit is voiceloopback flag, munge starts from here
-	msg.write<uint8_t>(0); // backup count
-	msg.write<uint8_t>(1); // cmd count
+	msg.write<uint8_t>(static_cast<uint8_t>(backup));
+	msg.write<uint8_t>(static_cast<uint8_t>(count));
 
-	Protocol::UserCmd old;
-	memset(&old, 0, sizeof(old));
+	Protocol::UserCmd null_cmd;
+	memset(&null_cmd, 0, sizeof(null_cmd));
 
-	HL::Protocol::UserCmd userCmd;
-	memset(&userCmd, 0, sizeof(userCmd));
-
-	if (mThinkCallback && mSignonNum == 2)
-		mThinkCallback(userCmd);
+	const Protocol::UserCmd* prev = &null_cmd;
 
-	mDelta.writeUserCmd(msg, userCmd, old);
+	for (size_t i = mCommands.size() - total; i < mCommands.size(); i++)
+	{
+		const auto& cmd = mCommands[i];
+		mDelta.writeUserCmd(msg, cmd, *prev);
+		prev = &cmd;
+	}
 
 	msg.alignByteBoundary();
 
 	*(uint8_t*)((size_t)msg.getMemory() + o + 1) = (uint8_t)(msg.getSize() - o - 3);
 
-	*(uint8_t*)((size_t)msg.getMemory() + o + 2) = (uint8_t)Encoder::BlockSequenceCRCByte(
-		(void*)((size_t)msg.getMemory() + o + 3), msg.getSize() - o - 3, mChannel->getOutgoingSequence());
+	*(uint8_t*)((size_t)msg.getMemory() + o + 2) = Encoder::BlockSequenceCRCByte(msg, o + 3,
+		msg.getSize() - o - 3, mChannel->getOutgoingSequence());
 
 	Encoder::Munge((void*)((size_t)msg.getMemory() + o + 3), msg.getSize() - o - 3,
 		mChannel->getOutgoingSequence());
@@ -1505,6 +1749,9 @@ void BaseClient::writeRegularMove(sky::BitBuffer& msg)
 
 void BaseClient::writeRegularDelta(sky::BitBuffer& msg)
 {
+	if (!mDeltaSequenceValid)
+		return; // server sends full update then
+
 	msg.write<uint8_t>((uint8_t)Protocol::Client::Message::Delta);
 	msg.write<uint8_t>(mDeltaSequence);
 }
@@ -1520,7 +1767,7 @@ void BaseClient::writeRegularFileConsistency(sky::BitBuffer& msg)
 
 	for (int i = 0; i < mResources.size(); i++)
 	{
-		auto resource = mResources[i];
+		const auto& resource = mResources[i];
 
 		if (!(resource.flags & Protocol::RES_CHECKFILE))
 			continue;
@@ -1543,7 +1790,9 @@ void BaseClient::writeRegularFileConsistency(sky::BitBuffer& msg)
 	msg.writeBit(false);
 	msg.alignByteBoundary();
 
-	sky::Log("{} resources confirmed", c);
+	mHashCache->save();
+
+	Utils::Log("{} resources confirmed", c);
 }
 #pragma endregion
 
@@ -1557,7 +1806,7 @@ void BaseClient::onConnect(CON_ARGS)
 	}
 	catch (const std::exception& e)
 	{
-		sky::Log(e.what());
+		Utils::Log(e.what());
 		return;
 	}
 
@@ -1571,7 +1820,7 @@ void BaseClient::onDisconnect(CON_ARGS)
 {
 	if (mState <= State::Disconnected)
 	{
-		sky::Log("cannot disconnect, not connected");
+		Utils::Log("cannot disconnect, not connected");
 		return;
 	}
 	if (mChannel)
@@ -1586,7 +1835,7 @@ void BaseClient::onRetry(CON_ARGS)
 {
 	if (!mServerAdr.has_value())
 	{
-		sky::Log("cannot retry, no connection was made");
+		Utils::Log("cannot retry, no connection was made");
 		return;
 	}
 	connect(mServerAdr.value());
@@ -1600,6 +1849,69 @@ void BaseClient::onCmd(CON_ARGS)
 	sendCommand(CON_ARG(0));
 }
 
+void BaseClient::onNetStats(CON_ARGS)
+{
+	if (!mChannel.has_value())
+	{
+		Utils::Log("not connected");
+		return;
+	}
+
+	auto snapshot = mChannel->getMetrics().snapshot();
+
+	if (CON_ARGS_COUNT > 0 && CON_ARG(0) == "json")
+		Utils::Log(snapshot.toJson());
+	else
+		Utils::Log(snapshot.toText());
+}
+
+void BaseClient::onDownloads(CON_ARGS)
+{
+	Utils::Log(mDownloads.toText());
+
+	if (!mChannel.has_value())
+		return;
+
+	for (const auto& file : mChannel->getIncomingFiles())
+	{
+		Utils::Log("receiving {}: {}/{} fragments", file.name.empty() ? "?" : file.name, file.received, file.total);
+	}
+}
+
+void BaseClient::onSvcStats(CON_ARGS)
+{
+	if (CON_ARGS_COUNT > 0 && CON_ARG(0) == "reset")
+	{
+		mMessageStats = {};
+		return;
+	}
+
+	std::vector<size_t> indices;
+
+	for (size_t i = 0; i < mMessageStats.size(); i++)
+	{
+		if (mMessageStats[i].count > 0)
+			indices.push_back(i);
+	}
+
+	std::sort(indices.begin(), indices.end(), [this](auto a, auto b) {
+		return mMessageStats[a].time > mMessageStats[b].time;
+	});
+
+	for (auto i : indices)
+	{
+		const auto& stats = mMessageStats[i];
+
+		auto name = i < MaxServerMessages ? std::string(magic_enum::enum_name(static_cast<Protocol::Server::Message>(i))) :
+			mGameMessages[i].has_value() ? mGameMessages[i]->name : "gmsg " + std::to_string(i);
+
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(stats.time).count();
+
+		Utils::Log("{}: {} messages, {} bytes, {} us ({:.2f} us per message)", name, stats.count, stats.bytes, us,
+			static_cast<double>(us) / static_cast<double>(stats.count));
+	}
+}
+
 void BaseClient::onFullServerInfo(CON_ARGS)
 {
 	if (CON_ARGS_COUNT < 1)
@@ -1612,7 +1924,7 @@ void BaseClient::onReconnect(CON_ARGS)
 {
 	if (mState < State::Connected)
 	{
-		sky::Log("cannot reconnect, not connected");
+		Utils::Log("cannot reconnect, not connected");
 		return;
 	}
 	resetGameResources();
@@ -1649,23 +1961,26 @@ void BaseClient::onReconnect(CON_ARGS)
 
 void BaseClient::verifyResources()
 {
-	for (auto& resource : mResources)
+	std::vector<std::pair<std::string, size_t>> required;
+
+	for (const auto& resource : mResources)
 	{
 		if (resource.type != Protocol::Resource::Type::Model && 
 			resource.type != Protocol::Resource::Type::Sound &&
 			resource.type != Protocol::Resource::Type::Generic)
 			continue;
 
-		if (resource.type == Protocol::Resource::Type::Model && resource.name[0] == '*')
+		if (resource.brush)
 			continue;
 
 		if (!isResourceRequired(resource))
 			continue;
 
-		mDownloadQueue.push_back(resource.name);
-		sendCommand("dlfile " + resource.name);
-		mChannel->fragmentateReliableBuffer();
+		required.push_back({ resource.name, static_cast<size_t>(resource.size) });
 	}
+
+	mDownloads.enqueue(required);
+	requestDownloads();
 }
 
 bool BaseClient::isResourceRequired(const Protocol::Resource& resource)
@@ -1697,14 +2012,17 @@ bool BaseClient::isResourceRequired(const Protocol::Resource& resource)
 int BaseClient::getResourceHash(const Protocol::Resource& resource)
 {
 	auto game_dir = mServerInfo.value().game_dir;
-	auto asset = Platform::Asset(game_dir + '/' + resource.name);
-
-	MD5 md5;
+	auto digest = mHashCache->get(game_dir + '/' + resource.name);
 
-	md5.update((unsigned char*)asset.getMemory(), asset.getSize());
-	md5.finalize();
+	if (!digest.has_value())
+	{
+		Utils::Log(Console::Color::Red, "cannot hash resource \"{}\"", resource.name);
+		return 0;
+	}
 
-	return *(int*)md5.getdigest();
+	int result;
+	memcpy(&result, digest.value().data(), sizeof(result));
+	return result;
 }
 
 void BaseClient::signon(uint8_t num)
@@ -1725,7 +2043,7 @@ void BaseClient::sendCommand(const std::string& command)
 {
 	if (mState < State::Connected)
 	{
-		sky::Log("cannot forward \"" + command + "\", not connected");
+		Utils::Log("cannot forward \"" + command + "\", not connected");
 		return;
 	}
 
@@ -1735,18 +2053,19 @@ void BaseClient::sendCommand(const std::string& command)
 
 	mChannel->addReliableMessage(buf);
 
-	sky::Log("forward \"" + command + "\"");
+	Utils::Log("forward \"" + command + "\"");
 }
 
 void BaseClient::connect(const Network::Address& address)
 {
 	if (mState != State::Disconnected)
 	{
-		sky::Log("cannot connect, already connected");
+		Utils::Log("cannot connect, already connected");
 		return;
 	}
 
 	mServerAdr = address;
+	mDownloads.setServer(address.toString());
 	mState = State::Challenging;
 	initializeConnection();
 	mInitializeConnectionTime = Clock::Now();
@@ -1755,26 +2074,35 @@ void BaseClient::connect(const Network::Address& address)
 void BaseClient::disconnect(const std::string& reason)
 {
 	mState = State::Disconnected;
-	mChannel.reset();
+
+	{
+		std::lock_guard lock(Utils::GetGlobalMutex());
+		mChannel.reset();
+	}
+
+	mCommands.clear();
+	mNewCommands = 0;
 
 	mResourcesVerifying = false;
 	mResourcesVerified = false;
 	mConfirmationRequired = false;
-	mDownloadQueue.clear();
+	mDownloads.suspend();
 	mDelta.clear();
-	mGameMessages.clear();
+	mGameMessages = {};
+	mGameMessageCallbacks = {};
 	mTime = 0.0f;
 	m_LightStyles.clear();
 	m_WeaponData.clear();
 	mSignonNum = 0;
 	mDeltaSequence = 0;
+	mDeltaSequenceValid = false;
 	mMoveVars.reset();
 	mGameMod.reset();
 	mInitializeConnectionTime.reset();
 
 	resetGameResources();
 
-	sky::Log("disconnected, reason: \"" + reason + "\"");
+	Utils::Log("disconnected, reason: \"" + reason + "\"");
 
 	if (mDisconnectCallback)
 		mDisconnectCallback(reason);
@@ -1787,7 +2115,7 @@ void BaseClient::initializeConnection()
 	packet.adr = mServerAdr.value();
 	sky::bitbuffer_helpers::WriteString(packet.buf, "getchallenge steam");
 	sendConnectionlessPacket(packet);
-	sky::Log("initializing connection to " + mServerAdr.value().toString());
+	Utils::Log("initializing connection to " + mServerAdr.value().toString());
 }
 
 bool BaseClient::isPlayerIndex(int value) const
@@ -1796,23 +2124,56 @@ bool BaseClient::isPlayerIndex(int value) const
 	return value >= 1 && value <= max_players;
 }
 
-std::optional<HL::Protocol::Resource> BaseClient::findModel(int model_index) const
+const HL::Protocol::Resource* BaseClient::findModel(int model_index) const
+{
+	return mResources.findModel(model_index);
+}
+
+void BaseClient::addCommand(const std::string& name, const std::string& description,
+	const std::vector<std::string>& args, CommandCallback callback)
 {
-	auto result = std::find_if(mResources.cbegin(), mResources.cend(), [model_index](const auto& res) {
-		return res.index == model_index && res.type == HL::Protocol::Resource::Type::Model;
+	mConsoleCommands.insert_or_assign(name, callback);
+
+	if (ConsoleClient != this)
+		return;
+
+	// bound by name, so owner can be destroyed safely
+
+	CONSOLE->registerCommand(name, description, args, [name](CON_ARGS) {
+		if (ConsoleClient == nullptr)
+			return;
+
+		ConsoleClient->executeLocal(name, _args);
 	});
+}
 
-	if (result == mResources.cend())
-		return std::nullopt;
-	else
-		return *result;
+void BaseClient::addCVar(const std::string& name, const std::string& description,
+	const std::vector<std::string>& args, Console::CVar::Getter getter, Console::CVar::Setter setter)
+{
+	mConsoleCVars.insert_or_assign(name, CVar{ getter, setter });
+
+	if (ConsoleClient != this)
+		return;
+
+	CONSOLE->registerCVar(name, description, args, [name]() {
+		using Result = std::invoke_result_t<Console::CVar::Getter>;
+
+		if (ConsoleClient == nullptr || !ConsoleClient->mConsoleCVars.contains(name))
+			return Result{ "" };
+
+		return ConsoleClient->mConsoleCVars.at(name).getter();
+	}, [name](CON_ARGS) {
+		if (ConsoleClient == nullptr)
+			return;
+
+		ConsoleClient->executeLocal(name, _args);
+	});
 }
 
 void BaseClient::addUserInfo(const std::string& name, const std::string& description,
 	Console::CVar::Getter getter, Console::CVar::Setter setter)
 {
-	CONSOLE->registerCVar(name, description, { "str" },
-		getter, setter);
+	addCVar(name, description, { "str" }, getter, setter);
 
 	mUserInfos.insert({ name, getter });
 }
@@ -1840,6 +2201,8 @@ void BaseClient::initializeGameEngine()
 	mGameMod->setSendCommandCallback([this](const auto& cmd) {
 		sendCommand(cmd);
 	});
+
+	bindGameMessages();
 }
 
 void BaseClient::initializeGame()
@@ -1866,9 +2229,11 @@ void BaseClient::initializeGame()
 void BaseClient::resetGameResources()
 {
 	mEntities.clear();
+	mEntityFrames.clear();
+	mLiveFrame = {};
+	mEntityChanges.clear();
 	mServerInfo.reset();
 	mResources.clear();
-	mDeltaEntities.clear();
 	mBaselines.clear();
 	mExtraBaselines.clear();
 }
\ No newline at end of file
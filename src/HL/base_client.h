@@ -11,6 +11,12 @@
 #include "encoder.h"
 #include <cstdint>
 #include "gamemod.h"
+#include "ring_buffer.h"
+#include "entity_store.h"
+#include "entity_frames.h"
+#include "resource_registry.h"
+#include "download_manager.h"
+#include "resource_hash_cache.h"
 
 namespace HL
 {
@@ -34,6 +40,30 @@ namespace HL
 	public:
 		void onFrame() override;
 
+		// runs client on caller's thread instead of frame system: receives, thinks,
+		// transmits and sends. console commands from server wait for
+		// executeStuffedCommands() on frame thread. see ClientSwarm
+
+		void frame();
+		void setExternalFrames(bool value);
+		void executeStuffedCommands();
+
+		// runs command or sets cvar of this client, others go to console
+		void execute(const std::string& cmd);
+
+		// global console commands and cvars are bound to one client, the first
+		// constructed outside of this scope. others, e.g. clients of swarm, get
+		// commands only from server (stufftext) and execute()
+
+		struct NoConsoleScope
+		{
+			NoConsoleScope();
+			~NoConsoleScope();
+		};
+
+	private:
+		void update();
+
 	protected:
 		void readConnectionlessPacket(Network::Packet& packet) override;
 		void readRegularPacket(Network::Packet& packet) override;
@@ -43,9 +73,28 @@ namespace HL
 		void readConnectionlessAccepted(Network::Packet& packet);
 		void readConnectionlessReject(Network::Packet& packet);
 
+	public:
+		using MessageHandler = std::function<void(sky::BitBuffer& msg)>;
+
+		struct MessageStats
+		{
+			uint64_t count = 0;
+			uint64_t bytes = 0; // with id byte
+			Clock::Duration time = Clock::Duration::zero();
+		};
+
+		static constexpr size_t MaxServerMessages = 65; // ids above are game messages
+
+	protected:
+		// subclasses can replace handler of svc or handle one that we skip
+
+		void setMessageHandler(Protocol::Server::Message svc, MessageHandler handler);
+
 	private:
+		void registerMessageHandlers();
 		void readRegularMessages(sky::BitBuffer& msg);
 		void readRegularGameMessage(sky::BitBuffer& msg, uint8_t index);
+		void bindGameMessages();
 		void receiveFile(std::string_view fileName, sky::BitBuffer& msg);
 
 		void readRegularDisconnect(sky::BitBuffer& msg);
@@ -107,20 +156,44 @@ namespace HL
 		void onDisconnect(CON_ARGS);
 		void onRetry(CON_ARGS);
 		void onCmd(CON_ARGS);
+		void onNetStats(CON_ARGS);
+		void onSvcStats(CON_ARGS);
+		void onDownloads(CON_ARGS);
 		void onFullServerInfo(CON_ARGS);
 		void onReconnect(CON_ARGS);
 
+	public:
+		// what happened to live entity in last packet entities, changed_fields is
+		// ENTITY_FIELD_ALL for spawned ones and when frame was not made from previous one
+
+		struct EntityChange
+		{
+			enum class Type
+			{
+				Spawned,
+				Updated,
+				Removed
+			};
+
+			Type type;
+			int index;
+			uint32_t changed_fields;
+		};
+
 	public:
 		auto getState() const { return mState; }
 		const auto& getEntities() const { return mEntities; }
 		const auto& getBaselines() const { return mBaselines; }
 		const auto& getClientData() const { return mClientData; }
+		const auto& getWeaponData() const { return m_WeaponData; }
+		const auto& getEntityChanges() const { return mEntityChanges; }
 		const auto& getPlayerUserInfos() const { return mPlayerUserInfos; }
 		const auto& getChannel() const { return mChannel; }
 		const auto& getResources() const { return mResources; }
 		const auto& getGameMod() const { return mGameMod; }
 		const auto& getServerInfo() const { return mServerInfo; }
 		const auto& getMoveVars() const { return mMoveVars; }
+		const auto& getMessageStats() const { return mMessageStats; } // by message id, svc and game ones
 
 		const auto& getProtInfo() const { return mProtInfo; }
 		void setProtInfo(const std::map<std::string, std::string>& value) { mProtInfo = value; }
@@ -134,28 +207,39 @@ namespace HL
 		std::map<std::string, std::string> mProtInfo;
 		std::vector<uint8_t> mCertificate = { };
 		std::optional<Channel> mChannel;
-		std::list<std::string> mDownloadQueue;
+		bool mExternalFrames = false;
+		std::vector<std::string> mStuffedCommands;
+		DownloadManager mDownloads;
+		std::shared_ptr<ResourceHashCache> mHashCache = ResourceHashCache::GetShared();
 		bool mResourcesVerifying = false;
 		bool mResourcesVerified = false;
 		bool mConfirmationRequired = false;
+		static constexpr size_t MessageHistorySize = 16;
+
+		std::array<MessageHandler, MaxServerMessages> mMessageHandlers;
+		std::array<MessageStats, 256> mMessageStats;
 		Delta mDelta;
-		std::map<uint8_t, Protocol::GameMessage> mGameMessages;
+		std::array<std::optional<Protocol::GameMessage>, 256> mGameMessages; // svc_newusermsg
+		std::array<const GameMod::ReadMessageCallback*, 256> mGameMessageCallbacks = {}; // bound on registration
 		std::shared_ptr<GameMod> mGameMod;
 		float mTime = 0.0f; // svc_time
 		Protocol::ClientData mClientData = {}; // svc_clientdata
 		std::vector<std::string> m_LightStyles; // svc_lightstyles
 		std::vector<Protocol::WeaponData> m_WeaponData; // svc_clientdata
-		std::vector<Protocol::Resource> mResources;
-		std::map<int, Protocol::Entity*> mEntities; // TODO: shared ptr
-		std::map<int, Protocol::Entity> mDeltaEntities;
-		std::map<int, Protocol::Entity> mBaselines;
-		std::map<int, Protocol::Entity> mExtraBaselines;
+		ResourceRegistry mResources;
+		EntityStore<Protocol::MAX_EDICTS> mEntities; // active ones and last states of removed ones
+		EntityStore<Protocol::MAX_EDICTS> mBaselines;
+		EntityStore<Protocol::MAX_EXTRA_BASELINES> mExtraBaselines;
+		EntityFrames mEntityFrames;
+		EntityFrames::Frame mLiveFrame; // frame mEntities is made of
+		std::vector<EntityChange> mEntityChanges; // of last packet entities
 		std::map<int, std::string> mPlayerUserInfos;
 		bool mHLTV = false;
 		std::optional<Protocol::ServerInfo> mServerInfo;
 		std::optional<Protocol::MoveVars> mMoveVars;
 		uint8_t mSignonNum = 0;
-		uint8_t mDeltaSequence;
+		uint8_t mDeltaSequence = 0;
+		bool mDeltaSequenceValid = false;
 		std::optional<Clock::TimePoint> mInitializeConnectionTime;
 		float mTimeout = 30.0f;
 
@@ -165,6 +249,7 @@ namespace HL
 		using IsResourceRequiredCallback = std::function<bool(const Protocol::Resource& resource)>;
 		using GameEngineInitializedCallback = std::function<void()>;
 		using GameInitializedCallback = std::function<void()>;
+		using EntitiesChangedCallback = std::function<void(const std::vector<EntityChange>& changes)>;
 
 	public:
 		void setThinkCallback(ThinkCallback value) { mThinkCallback = value; }
@@ -172,6 +257,7 @@ namespace HL
 		void setResourceRequiredCallback(IsResourceRequiredCallback callback) { mIsResourceRequiredCallback = callback; }
 		void setGameEngineInitializedCallback(GameEngineInitializedCallback value) { mGameEngineInitializedCallback = value; }
 		void setGameInitializedCallback(GameInitializedCallback value) { mGameInitializedCallback = value; }
+		void setEntitiesChangedCallback(EntitiesChangedCallback value) { mEntitiesChangedCallback = value; }
 
 	private:
 		ThinkCallback mThinkCallback = nullptr;
@@ -179,9 +265,11 @@ namespace HL
 		IsResourceRequiredCallback mIsResourceRequiredCallback = nullptr;
 		GameEngineInitializedCallback mGameEngineInitializedCallback = nullptr;
 		GameInitializedCallback mGameInitializedCallback = nullptr;
+		EntitiesChangedCallback mEntitiesChangedCallback = nullptr;
 
 	private:
 		void verifyResources();
+		void requestDownloads();
 
 		virtual bool isResourceRequired(const Protocol::Resource& resource);
 		virtual int getResourceHash(const Protocol::Resource& resource);
@@ -199,7 +287,7 @@ namespace HL
 		void connect(const Network::Address& address);
 		void disconnect(const std::string& reason);
 		bool isPlayerIndex(int value) const;
-		std::optional<HL::Protocol::Resource> findModel(int model_index) const;
+		const HL::Protocol::Resource* findModel(int model_index) const; // nullptr when not found
 
 	private: // userinfos
 		std::string mUserInfoDLMax = "512";
@@ -213,10 +301,45 @@ namespace HL
 		std::string mUserInfoName = "Player";
 		std::string mUserInfoPassword = "";
 
+	private:
+		void applyRate();
+
+	private: // usercmds are made with own rate and packed into clc_move as they were not sent yet
+		static constexpr size_t MaxCommands = 64; // history
+		static constexpr int MaxBackupCommands = 8;
+		static constexpr int MaxTotalCommands = 16; // per clc_move
+
+		void think();
+
+		RingBuffer<Protocol::UserCmd> mCommands = RingBuffer<Protocol::UserCmd>(MaxCommands);
+		size_t mNewCommands = 0; // at the end of mCommands
+		Clock::TimePoint mCommandTime = Clock::Now();
+		int mCmdRate = 60;
+		int mCmdBackup = 2;
+
 	protected:
+		using CommandCallback = std::function<void(CON_ARGS)>;
+
+		void addCommand(const std::string& name, const std::string& description,
+			const std::vector<std::string>& args, CommandCallback callback);
+		void addCVar(const std::string& name, const std::string& description,
+			const std::vector<std::string>& args, Console::CVar::Getter getter, Console::CVar::Setter setter);
 		void addUserInfo(const std::string& name, const std::string& description, 
 			Console::CVar::Getter getter, Console::CVar::Setter setter);
 
+	private:
+		bool executeLocal(const std::string& name, const std::vector<std::string>& args); // false if not ours
+
+	private:
+		struct CVar
+		{
+			Console::CVar::Getter getter;
+			Console::CVar::Setter setter;
+		};
+
+		std::map<std::string, CommandCallback> mConsoleCommands;
+		std::map<std::string, CVar> mConsoleCVars;
+
 	private:
 		std::map<std::string, Console::CVar::Getter> mUserInfos;
 
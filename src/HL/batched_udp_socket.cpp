@@ -0,0 +1,257 @@
+#include "batched_udp_socket.h"
+
+#if defined(__linux__)
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "utils.h"
+
+using namespace HL;
+
+namespace
+{
+	void InitRing(auto& ring, size_t size, size_t slot_size)
+	{
+		ring.memory.resize(size * slot_size);
+		ring.iovecs.resize(size);
+		ring.addresses.resize(size);
+		ring.headers.resize(size);
+
+		for (size_t i = 0; i < size; i++)
+		{
+			ring.iovecs[i].iov_base = ring.memory.data() + i * slot_size;
+			ring.iovecs[i].iov_len = slot_size;
+
+			auto& hdr = ring.headers[i].msg_hdr;
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.msg_name = &ring.addresses[i];
+			hdr.msg_namelen = sizeof(sockaddr_in);
+			hdr.msg_iov = &ring.iovecs[i];
+			hdr.msg_iovlen = 1;
+		}
+	}
+}
+
+BatchedUdpSocket::BatchedUdpSocket(uint16_t port, size_t batch_size) :
+	mBatchSize(batch_size)
+{
+	mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (mSocket < 0)
+		throw std::runtime_error(std::string("socket: ") + strerror(errno));
+
+	fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL, 0) | O_NONBLOCK);
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(mSocket, (sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		auto error = std::string("bind: ") + strerror(errno);
+		close(mSocket);
+		throw std::runtime_error(error);
+	}
+
+	InitRing(mRecvRing, mBatchSize, SlotSize);
+	InitRing(mSendRing, mBatchSize, SlotSize);
+}
+
+BatchedUdpSocket::~BatchedUdpSocket()
+{
+	flush();
+	close(mSocket);
+}
+
+void BatchedUdpSocket::onFrame()
+{
+	if (mExternalFrames)
+		return;
+
+	receive();
+	flush();
+}
+
+void BatchedUdpSocket::receive()
+{
+	while (true)
+	{
+		for (size_t i = 0; i < mBatchSize; i++)
+		{
+			mRecvRing.iovecs[i].iov_len = SlotSize;
+			mRecvRing.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			mRecvRing.headers[i].msg_hdr.msg_flags = 0;
+		}
+
+		auto count = recvmmsg(mSocket, mRecvRing.headers.data(), (unsigned int)mBatchSize, MSG_DONTWAIT, nullptr);
+
+		mStats.recv_calls += 1;
+
+		if (count <= 0)
+			return;
+
+		for (int i = 0; i < count; i++)
+		{
+			const auto& hdr = mRecvRing.headers[i];
+
+			if (hdr.msg_hdr.msg_flags & MSG_TRUNC)
+			{
+				mStats.dropped_packets += 1;
+				continue;
+			}
+
+			mStats.received_packets += 1;
+
+			if (!mReadCallback)
+				continue;
+
+			mPacket.adr = toAddress(mRecvRing.addresses[i]);
+			mPacket.buf.clear();
+			mPacket.buf.write(mRecvRing.iovecs[i].iov_base, hdr.msg_len);
+			mPacket.buf.toStart();
+
+			mReadCallback(mPacket);
+		}
+
+		// socket is drained when batch was not filled
+
+		if ((size_t)count < mBatchSize)
+			return;
+	}
+}
+
+void BatchedUdpSocket::sendPacket(const Network::Packet& packet)
+{
+	auto size = packet.buf.getSize();
+
+	if (size > SlotSize)
+	{
+		mStats.dropped_packets += 1;
+		return;
+	}
+
+	auto addr = toSockAddr(packet.adr);
+
+	if (addr == nullptr)
+	{
+		mStats.dropped_packets += 1;
+		return;
+	}
+
+	if (mSendCount == mBatchSize)
+		flush();
+
+	// kernel buffer is still full and ring has no room left
+
+	if (mSendCount == mBatchSize)
+	{
+		mStats.dropped_packets += 1;
+		return;
+	}
+
+	auto i = mSendCount++;
+
+	memcpy(mSendRing.iovecs[i].iov_base, packet.buf.getMemory(), size);
+	mSendRing.iovecs[i].iov_len = size;
+	mSendRing.addresses[i] = *addr;
+}
+
+void BatchedUdpSocket::flush()
+{
+	size_t sent = 0;
+
+	while (sent < mSendCount)
+	{
+		auto count = sendmmsg(mSocket, mSendRing.headers.data() + sent, (unsigned int)(mSendCount - sent), 0);
+
+		mStats.send_calls += 1;
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			// socket buffer is full, the rest stays in ring until next flush
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+			{
+				mStats.blocked_flushes += 1;
+				break;
+			}
+
+			// skip datagram that cannot be sent to its address, e.g. unreachable one
+
+			mStats.dropped_packets += 1;
+			sent += 1;
+			continue;
+		}
+
+		mStats.sent_packets += count;
+		sent += count;
+	}
+
+	if (sent == 0)
+		return;
+
+	// move unsent datagrams to the front of ring
+
+	for (size_t i = sent; i < mSendCount; i++)
+	{
+		auto j = i - sent;
+		memcpy(mSendRing.iovecs[j].iov_base, mSendRing.iovecs[i].iov_base, mSendRing.iovecs[i].iov_len);
+		mSendRing.iovecs[j].iov_len = mSendRing.iovecs[i].iov_len;
+		mSendRing.addresses[j] = mSendRing.addresses[i];
+	}
+
+	mSendCount -= sent;
+}
+
+const Network::Address& BatchedUdpSocket::toAddress(const sockaddr_in& addr)
+{
+	if (mLastRecvValid && mLastRecvSockAddr.sin_addr.s_addr == addr.sin_addr.s_addr &&
+		mLastRecvSockAddr.sin_port == addr.sin_port)
+		return mLastRecvAddress;
+
+	char ip[INET_ADDRSTRLEN] = { 0 };
+	inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+
+	mLastRecvAddress = Network::Address(std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port)));
+	mLastRecvSockAddr = addr;
+	mLastRecvValid = true;
+
+	return mLastRecvAddress;
+}
+
+const sockaddr_in* BatchedUdpSocket::toSockAddr(const Network::Address& address)
+{
+	if (mLastSendValid && mLastSendAddress == address)
+		return mLastSendResolved ? &mLastSendSockAddr : nullptr;
+
+	auto str = address.toString();
+	auto host = str.substr(0, str.find(':'));
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(address.port);
+
+	mLastSendAddress = address;
+	mLastSendValid = true;
+	mLastSendResolved = inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1;
+
+	if (!mLastSendResolved)
+	{
+		Utils::Log(Console::Color::Red, "socket: cannot send to \"{}\", not an ipv4 address", str);
+		return nullptr;
+	}
+
+	mLastSendSockAddr = addr;
+
+	return &mLastSendSockAddr;
+}
+
+#endif
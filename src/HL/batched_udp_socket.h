@@ -0,0 +1,93 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <core/engine.h>
+#include <network/system.h>
+#include <common/frame_system.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+namespace HL
+{
+	// udp socket that drains incoming datagrams with recvmmsg into a buffer ring
+	// and sends everything queued during frame with one sendmmsg.
+	// used by Networking only when built with HL_BATCHED_UDP_SOCKET
+
+	class BatchedUdpSocket : public Common::FrameSystem::Frameable
+	{
+	public:
+		using ReadCallback = std::function<void(Network::Packet& packet)>;
+
+		static const size_t SlotSize = 4096; // larger than any goldsrc datagram
+
+		struct Stats
+		{
+			uint64_t recv_calls = 0;
+			uint64_t send_calls = 0;
+			uint64_t received_packets = 0;
+			uint64_t sent_packets = 0;
+			uint64_t dropped_packets = 0; // too large, bad address or failed to send
+			uint64_t blocked_flushes = 0; // kernel buffer was full, rest was kept for next flush
+		};
+
+	public:
+		BatchedUdpSocket(uint16_t port = 0, size_t batch_size = 64);
+		~BatchedUdpSocket();
+
+	private:
+		void onFrame() override;
+
+	public:
+		void receive(); // drains socket now, also called every frame
+		void sendPacket(const Network::Packet& packet);
+		void flush();
+
+		// owner calls receive() and flush() itself, e.g. from another thread
+		void setExternalFrames(bool value) { mExternalFrames = value; }
+
+	private:
+		const Network::Address& toAddress(const sockaddr_in& addr);
+		const sockaddr_in* toSockAddr(const Network::Address& address); // nullptr if not ipv4
+
+	public:
+		void setReadCallback(ReadCallback value) { mReadCallback = value; }
+		const auto& getStats() const { return mStats; }
+
+	private:
+		int mSocket = -1;
+		size_t mBatchSize;
+		ReadCallback mReadCallback = nullptr;
+		Stats mStats;
+		bool mExternalFrames = false;
+
+		struct Ring
+		{
+			std::vector<uint8_t> memory;
+			std::vector<iovec> iovecs;
+			std::vector<sockaddr_in> addresses;
+			std::vector<mmsghdr> headers;
+		};
+
+		Ring mRecvRing;
+		Ring mSendRing;
+		size_t mSendCount = 0;
+
+		Network::Packet mPacket; // reused for every received datagram
+
+		// most datagrams come from and go to the same server,
+		// so remember last conversion in each direction
+
+		sockaddr_in mLastRecvSockAddr = {};
+		Network::Address mLastRecvAddress;
+		bool mLastRecvValid = false;
+
+		Network::Address mLastSendAddress;
+		sockaddr_in mLastSendSockAddr = {};
+		bool mLastSendValid = false;
+		bool mLastSendResolved = false;
+	};
+}
+
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <common/bitbuffer.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace HL
+{
+	// reads lsb-first bit stream through a 64 bit cache, made for delta and other
+	// bit packed messages, works right over memory of the message without copying
+
+	class BitReader
+	{
+		static_assert(std::endian::native == std::endian::little);
+
+	public:
+		BitReader(const void* data, size_t size) :
+			mData(static_cast<const uint8_t*>(data)),
+			mSize(size)
+		{
+		}
+
+		// starts at current position of buffer, which must be on byte boundary
+		// (beginning of svc), use getBytesRead() to seek buffer after reading
+
+		explicit BitReader(const sky::BitBuffer& buf) : BitReader(buf.getPositionMemory(), buf.getRemaining())
+		{
+		}
+
+	public:
+		uint32_t peekBits(int count)
+		{
+			if (mCacheBits < count)
+				refill(count);
+
+			return static_cast<uint32_t>(mCache & ((1ULL << count) - 1));
+		}
+
+		uint32_t readBits(int count)
+		{
+			auto result = peekBits(count);
+			mCache >>= count;
+			mCacheBits -= count;
+			mPosition += count;
+			return result;
+		}
+
+		bool readBit()
+		{
+			return readBits(1) != 0;
+		}
+
+		// sign bit goes first, then magnitude
+
+		int32_t readSBits(int count)
+		{
+			auto value = readBits(count);
+			auto sign = static_cast<int32_t>(value & 1);
+			auto magnitude = static_cast<int32_t>(value >> 1);
+			return (magnitude ^ -sign) + sign;
+		}
+
+		float readBitAngle(int count)
+		{
+			return static_cast<float>(readBits(count) * (360.0 / (1 << count)));
+		}
+
+		// byte aligned coord, 1/8 of unit
+
+		float readCoord()
+		{
+			return static_cast<float>(read<int16_t>()) * (1.0f / 8.0f);
+		}
+
+		float readBitCoord()
+		{
+			bool has_int = readBit();
+			bool has_fract = readBit();
+
+			if (!has_int && !has_fract)
+				return 0.0f;
+
+			bool sign = readBit();
+			auto value = has_int ? static_cast<float>(readBits(12)) : 0.0f;
+
+			if (has_fract)
+				value += static_cast<float>(readBits(3)) * (1.0f / 8.0f);
+
+			return sign ? -value : value;
+		}
+
+		void readBitVec3(float* value)
+		{
+			auto flags = readBits(3);
+
+			for (int i = 0; i < 3; i++)
+			{
+				if (flags & (1 << i))
+					value[i] = readBitCoord();
+			}
+		}
+
+		std::string readString()
+		{
+			std::string result;
+
+			while (true)
+			{
+				auto c = static_cast<char>(readBits(8));
+
+				if (c == 0)
+					break;
+
+				result.push_back(c);
+			}
+
+			return result;
+		}
+
+		void read(void* data, size_t size)
+		{
+			auto dst = static_cast<uint8_t*>(data);
+
+			for (size_t i = 0; i < size; i++)
+			{
+				dst[i] = static_cast<uint8_t>(readBits(8));
+			}
+		}
+
+		template <typename T> T read()
+		{
+			T result;
+			read(&result, sizeof(T));
+			return result;
+		}
+
+		void alignByteBoundary()
+		{
+			auto skip = static_cast<int>((8 - (mPosition & 7)) & 7);
+
+			if (skip > 0)
+				readBits(skip);
+		}
+
+	public:
+		auto getPosition() const { return mPosition; } // bits
+		auto getBytesRead() const { return (mPosition + 7) / 8; }
+		auto getSize() const { return mSize; }
+		bool hasRemaining() const { return mPosition < mSize * 8; }
+
+	private:
+		void refill(int count)
+		{
+			if (mPosition + count > mSize * 8)
+				throw std::out_of_range("bit reader: read past the end of message");
+
+			auto byte = mPosition >> 3;
+			auto shift = static_cast<int>(mPosition & 7);
+
+			uint64_t word = 0;
+
+			if (byte + 8 <= mSize)
+				memcpy(&word, mData + byte, 8);
+			else
+				memcpy(&word, mData + byte, mSize - byte);
+
+			mCache = word >> shift;
+			mCacheBits = static_cast<int>(std::min<size_t>(64 - shift, mSize * 8 - mPosition));
+		}
+
+	private:
+		const uint8_t* mData = nullptr;
+		size_t mSize = 0; // bytes
+		size_t mPosition = 0; // bits
+		uint64_t mCache = 0;
+		int mCacheBits = 0;
+	};
+}
@@ -0,0 +1,68 @@
+#include "bz2_decompressor.h"
+#include <bzlib.h>
+
+using namespace HL;
+
+BZ2Decompressor::BZ2Decompressor()
+{
+	auto stream = new bz_stream();
+
+	if (BZ2_bzDecompressInit(stream, 0, 1) != BZ_OK)
+	{
+		delete stream;
+		return;
+	}
+
+	mStream = std::shared_ptr<void>(stream, [](void* ptr) {
+		auto stream = static_cast<bz_stream*>(ptr);
+		BZ2_bzDecompressEnd(stream);
+		delete stream;
+	});
+}
+
+bool BZ2Decompressor::decompress(const void* src, size_t size, sky::BitBuffer& dst, size_t max_size)
+{
+	if (mStream == nullptr || mFinished || mOverflowed)
+		return false;
+
+	auto stream = static_cast<bz_stream*>(mStream.get());
+
+	stream->next_in = (char*)src;
+	stream->avail_in = (unsigned int)size;
+
+	// one byte more than allowed, so the stream that ends right at max_size
+	// can be told from the one that goes on
+
+	auto capacity = max_size + 1;
+
+	while (true)
+	{
+		if (mTotalOut == dst.getSize())
+			dst.setSize(std::min(std::max<size_t>(dst.getSize() * 2, 4096), capacity));
+
+		stream->next_out = (char*)((size_t)dst.getMemory() + mTotalOut);
+		stream->avail_out = (unsigned int)(dst.getSize() - mTotalOut);
+
+		auto result = BZ2_bzDecompress(stream);
+
+		mTotalOut = dst.getSize() - stream->avail_out;
+
+		if (mTotalOut > max_size)
+		{
+			mOverflowed = true;
+			return false;
+		}
+
+		if (result == BZ_STREAM_END)
+		{
+			mFinished = true;
+			return true;
+		}
+
+		if (result != BZ_OK)
+			return false;
+
+		if (stream->avail_in == 0 && stream->avail_out > 0)
+			return true;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <shared/all.h>
+
+namespace HL
+{
+	class BZ2Decompressor
+	{
+	public:
+		BZ2Decompressor();
+
+	public:
+		// decompresses next chunk of the stream, output is written to dst right after
+		// previous output, dst grows when needed, but whole output of the stream
+		// cannot be larger than max_size
+		bool decompress(const void* src, size_t size, sky::BitBuffer& dst, size_t max_size);
+
+	public:
+		auto getTotalOut() const { return mTotalOut; }
+		auto isFinished() const { return mFinished; }
+		auto isOverflowed() const { return mOverflowed; }
+
+	private:
+		std::shared_ptr<void> mStream;
+		size_t mTotalOut = 0;
+		bool mFinished = false;
+		bool mOverflowed = false;
+	};
+}
@@ -3,26 +3,116 @@
 #include "protocol.h"
 #include "utils.h"
 #include <bzlib.h>
+#include <numeric>
 
 using namespace HL;
 
-Channel::Channel(std::shared_ptr<Network::UdpSocket> socket, MessagesHandler readHandler, MessagesHandler writeHandler, FileHandler fileHandler) :
-	mSocket(socket),
+Channel::Channel(SendHandler sendHandler, MessagesHandler readHandler, MessagesHandler writeHandler, FileHandler fileHandler) :
+	mSendHandler(sendHandler),
 	mReadHandler(readHandler),
 	mWriteHandler(writeHandler),
 	mFileHandler(fileHandler)
 {
-	mTimer.setInterval(Clock::FromMilliseconds(10));
-	mTimer.setCallback(std::bind(&Channel::transmit, this));
 }
 
 void Channel::onFrame()
 {
-	STATS_INDICATE_GROUP("netchan_seq", "in seq", getIncomingSequence());
-	STATS_INDICATE_GROUP("netchan_seq", "out seq", getOutgoingSequence());
-	STATS_INDICATE_GROUP("netchan_rel", "in rel", getIncomingReliable());
-	STATS_INDICATE_GROUP("netchan_rel", "out rel", getOutgoingReliable());
-	STATS_INDICATE_GROUP("netchan", "latency", Clock::ToMilliseconds(getLatency()));
+	if (mExternalFrames)
+		return;
+
+	frame();
+}
+
+void Channel::frame()
+{
+	mNormalFragBuffers.expire();
+	mFileFragBuffers.expire();
+
+	schedule();
+	updateMetrics();
+}
+
+void Channel::schedule()
+{
+	auto now = Clock::Now();
+
+	// token bucket, refilled with negotiated rate, holds at most 1/10 of a second of data
+
+	auto elapsed = Clock::ToSeconds(now - mTokensTime);
+	auto max_tokens = static_cast<float>(mRate) / 10.0f;
+
+	mTokens = std::min(mTokens + elapsed * static_cast<float>(mRate), max_tokens);
+	mTokensTime = now;
+
+	auto since_transmit = now - mTransmitTime;
+
+	bool keepalive = since_transmit >= mKeepaliveInterval;
+
+	// lost reliable packet is found only when peer acknowledges a later one,
+	// so do not leave it waiting for keepalive when we have nothing else to send
+
+	bool in_flight = mIncomingAcknowledgement < mReliableSequence;
+	bool probe = in_flight && !keepalive && since_transmit >= getRetransmitTimeout();
+
+	if (!mTransmitRequested && !hasReliableData() && !keepalive && !probe)
+		return;
+
+	if (since_transmit < Clock::FromSeconds(1.0f / static_cast<float>(mMaxPacketRate)))
+		return;
+
+	if (mTokens < 0.0f)
+	{
+		if (!mChoked)
+			mMetrics.choked.fetch_add(1, std::memory_order_relaxed);
+
+		mChoked = true;
+		return;
+	}
+
+	if (probe && !mTransmitRequested)
+	{
+		mMetrics.reliable_probes.fetch_add(1, std::memory_order_relaxed);
+		mReliableProbes += 1;
+	}
+	else if (!mTransmitRequested && !hasReliableData())
+	{
+		mMetrics.keepalives.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	transmit();
+}
+
+bool Channel::hasReliableData() const
+{
+	if (mIncomingAcknowledgement < mReliableSequence)
+		return false; // previous reliable packet is still in flight
+
+	return !mReliableMessages.empty() || !mOutgoingFragBuffers.empty() || !mOutgoingFileFragBuffers.empty();
+}
+
+Clock::Duration Channel::getRetransmitTimeout() const
+{
+	// rfc 6298: smoothed rtt plus four variations, doubled for every probe
+	// that got no answer, never later than keepalive
+
+	if (mSmoothedLatency == Clock::Duration::zero())
+		return mKeepaliveInterval;
+
+	auto timeout = std::max(mSmoothedLatency + 4 * mLatencyVariation, Clock::FromSeconds(0.05f));
+	timeout *= 1 << std::min(mReliableProbes, 4);
+
+	return std::min(timeout, mKeepaliveInterval);
+}
+
+void Channel::updateMetrics()
+{
+	auto now = Clock::Now();
+
+	if (now - mMetricsTime < Clock::FromSeconds(1.0f))
+		return;
+
+	mMetrics.updateRates(Clock::ToSeconds(now - mMetricsTime));
+	mMetricsTime = now;
 }
 
 void Channel::transmit()
@@ -34,7 +124,7 @@ void Channel::transmit()
 
 	if (mIncomingAcknowledgement >= mReliableSequence)
 	{
-		has_fragments = !mOutgoingFragBuffers.empty();
+		has_fragments = !mOutgoingFragBuffers.empty() || !mOutgoingFileFragBuffers.empty();
 		has_reliable_messages = !mReliableMessages.empty();
 	}
 
@@ -46,7 +136,10 @@ void Channel::transmit()
 	int seq = (int)mOutgoingSequence | (has_fragments << 30) | (rel << 31);
 	int ack = (int)mIncomingSequence | (mOutgoingReliable << 31);
 
-	sky::BitBuffer msg;
+	// serialize right into the packet we send, its storage is reused between transmits
+
+	auto& msg = mPacket.buf;
+	msg.clear();
 	msg.write(seq);
 	msg.write(ack);
 
@@ -63,62 +156,89 @@ void Channel::transmit()
 
 	Encoder::Munge2((void*)((size_t)msg.getMemory() + 8), msg.getSize() - 8, seq & 0xFF);
 
-	Network::Packet pack;
-	pack.adr = mAddress;
-	sky::bitbuffer_helpers::WriteToBuffer(msg, pack.buf);
-	mSocket->sendPacket(pack);
+	// one rtt sample in flight at a time, taken when the peer acknowledges this sequence
+
+	if (mLatencyReady)
+	{
+		mLatencySequence = mOutgoingSequence;
+		mLatencyTime = Clock::Now();
+		mLatencyReady = false;
+	}
+
+	mPacket.adr = mAddress;
+	mSendHandler(mPacket);
+
+	mTransmitRequested = false;
+	mChoked = false;
+	mTransmitTime = Clock::Now();
+	mTokens -= static_cast<float>(msg.getSize());
+
+	mMetrics.addOutgoing(msg.getSize());
 }
 
 void Channel::writeFragments(sky::BitBuffer& msg)
 {
-	auto has_frag_buf = !mOutgoingFragBuffers.empty();
+	// protocol allows one normal and one file fragment per datagram,
+	// so we always send both streams at once when both have data
 
-	msg.write<uint8_t>(has_frag_buf ? 1 : 0);
+	const OutgoingFragBuffer* normal = nullptr;
+	const OutgoingFragBuffer* file = nullptr;
 
-	if (has_frag_buf)
-	{
-		const auto& frag_buf = *mOutgoingFragBuffers.begin();
+	if (!mOutgoingFragBuffers.empty())
+		normal = &mOutgoingFragBuffers.front();
 
-		uint16_t total = frag_buf.total;
-		uint16_t cur = total - frag_buf.buffers.size() + 1;
-		uint16_t offset = 0; // will be non zero in filefrag
-		uint16_t size = frag_buf.buffers.begin()->getSize();
+	if (!mOutgoingFileFragBuffers.empty())
+		file = &mOutgoingFileFragBuffers.front();
 
-		msg.write<uint16_t>(total);
-		msg.write<uint16_t>(cur);
-		msg.write<uint16_t>(offset);
-		msg.write<uint16_t>(size);
+	msg.write<uint8_t>(normal != nullptr ? 1 : 0);
 
-		Utils::dlog("{}/{}, size: {}", cur, total, size);
-	}
+	if (normal != nullptr)
+		writeFragmentHeader(msg, *normal, 0);
 
-	auto has_file_frag_buf = false;
+	msg.write<uint8_t>(file != nullptr ? 1 : 0);
 
-	msg.write<uint8_t>(has_file_frag_buf ? 1 : 0); // no file fragments
+	if (file != nullptr)
+		writeFragmentHeader(msg, *file, normal != nullptr ? (uint16_t)normal->buffers.front().getSize() : 0);
 
-	if (has_file_frag_buf)
+	if (normal != nullptr)
 	{
-		// file frag headers here
+		const auto& buf = normal->buffers.front();
+		msg.write(buf.getMemory(), buf.getSize());
 	}
 
-	const auto& buf = *mOutgoingFragBuffers.begin()->buffers.begin();
+	if (file != nullptr)
+	{
+		const auto& buf = file->buffers.front();
+		msg.write(buf.getMemory(), buf.getSize());
+	}
 
-	msg.write(buf.getMemory(), buf.getSize());
-	// write file frag buf here
+	mNormalFragmentSent = normal != nullptr;
+	mFileFragmentSent = file != nullptr;
 }
 
-void Channel::writeReliableMessages(sky::BitBuffer& msg)
+void Channel::writeFragmentHeader(sky::BitBuffer& msg, const OutgoingFragBuffer& frag_buf, uint16_t offset)
 {
-	bool first = true;
+	uint16_t total = frag_buf.total;
+	uint16_t cur = total - frag_buf.buffers.size() + 1;
+	uint16_t size = frag_buf.buffers.front().getSize();
+
+	msg.write<uint16_t>(total);
+	msg.write<uint16_t>(cur);
+	msg.write<uint16_t>(offset);
+	msg.write<uint16_t>(size);
 
-	for (auto& message : mReliableMessages)
+	Utils::dlog("{}/{}, offset: {}, size: {}", cur, total, offset, size);
+}
+
+void Channel::writeReliableMessages(sky::BitBuffer& msg)
+{
+	for (size_t i = 0; i < mReliableMessages.size(); i++)
 	{
-		if (msg.getSize() > 1024 && !first)
+		if (msg.getSize() > 1024 && i > 0)
 			break;
 
-		first = false;
-
-		sky::bitbuffer_helpers::WriteToBuffer(message, msg);
+		const auto& message = mReliableMessages[i];
+		msg.write(message.getMemory(), message.getSize());
 
 		mReliableSent++;
 	}
@@ -148,48 +268,70 @@ void Channel::process(sky::BitBuffer& msg)
 	ack &= ~(1 << 31);
 	ack &= ~(1 << 30);
 
+	mMetrics.addIncoming(msg.getSize());
+
 	if (seq < mIncomingSequence)
-		return; // out of order packet
+	{
+		mMetrics.out_of_order_packets.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
 
 	if (seq == mIncomingSequence)
-		return; // duplicate packet
+	{
+		mMetrics.duplicate_packets.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
 
 	if (seq > mIncomingSequence + 1)
-		sky::Log(Console::Color::Red, "channel: dropped {} packet(s)", seq - mIncomingSequence);
+	{
+		mMetrics.dropped_packets.fetch_add(seq - mIncomingSequence - 1, std::memory_order_relaxed);
+		Utils::Log(Console::Color::Red, "channel: dropped {} packet(s)", seq - mIncomingSequence - 1);
+	}
 
 	mIncomingSequence = seq;
 	mIncomingAcknowledgement = ack;
 
+	if (!mLatencyReady && mIncomingAcknowledgement >= mLatencySequence)
+	{
+		mLatency = Clock::Now() - mLatencyTime;
+		mLatencyReady = true;
+		mMetrics.addRtt(static_cast<uint32_t>(Clock::ToMilliseconds(mLatency)));
+
+		if (mSmoothedLatency == Clock::Duration::zero())
+		{
+			mSmoothedLatency = mLatency;
+			mLatencyVariation = mLatency / 2;
+		}
+		else
+		{
+			auto diff = mSmoothedLatency > mLatency ? mSmoothedLatency - mLatency : mLatency - mSmoothedLatency;
+			mLatencyVariation = (mLatencyVariation * 3 + diff) / 4;
+			mSmoothedLatency = (mSmoothedLatency * 7 + mLatency) / 8;
+		}
+	}
+
 	if (rel)
+	{
 		mOutgoingReliable = !mOutgoingReliable;
+		mTransmitRequested = true; // acknowledge it as soon as possible
+	}
 
 	if (mIncomingAcknowledgement >= mReliableSequence)
 	{
+		mReliableProbes = 0;
+
 		if (relAck != mIncomingReliable)
 		{
 			mIncomingReliable = relAck;
 
-			if (!mOutgoingFragBuffers.empty())
-			{
-				auto& frags_buffer = *mOutgoingFragBuffers.begin();
-				if (!frags_buffer.buffers.empty())
-				{
-					frags_buffer.buffers.pop_front();
-				}
-
-				int total = frags_buffer.total;
-				int count = total - frags_buffer.buffers.size();
-				int index = total << 16;
-				int percent = static_cast<int>((static_cast<float>(count) / static_cast<float>(total)) * 100.0f);
-				STATS_INDICATE_GROUP("netchan_frag", fmt::format("out frag {}", index), fmt::format("{}/{} ({}%)", count, total, percent));
-
-				if (frags_buffer.buffers.empty())
-				{
-					mOutgoingFragBuffers.pop_front();
-				}
-			}
+			if (mNormalFragmentSent)
+				popOutgoingFragment(mOutgoingFragBuffers);
+
+			if (mFileFragmentSent)
+				popOutgoingFragment(mOutgoingFileFragBuffers);
 
-			// filefrag
+			mNormalFragmentSent = false;
+			mFileFragmentSent = false;
 
 			while (mReliableSent > 0)
 			{
@@ -199,7 +341,14 @@ void Channel::process(sky::BitBuffer& msg)
 		}
 		else
 		{
+			// not acknowledged, everything we sent will go again
+
+			if (mReliableSent > 0 || mNormalFragmentSent || mFileFragmentSent)
+				mMetrics.reliable_retransmits.fetch_add(1, std::memory_order_relaxed);
+
 			mReliableSent = 0;
+			mNormalFragmentSent = false;
+			mFileFragmentSent = false;
 		}
 	}
 
@@ -209,244 +358,484 @@ void Channel::process(sky::BitBuffer& msg)
 	mReadHandler(msg);
 }
 
+void Channel::popOutgoingFragment(std::list<OutgoingFragBuffer>& frag_buffers)
+{
+	if (frag_buffers.empty())
+		return;
+
+	auto& frags_buffer = frag_buffers.front();
+
+	if (!frags_buffer.buffers.empty())
+		frags_buffer.buffers.pop_front();
+
+	int total = frags_buffer.total;
+	int count = total - frags_buffer.buffers.size();
+
+	mMetrics.fragments_sent.fetch_add(1, std::memory_order_relaxed);
+	mMetrics.setOutgoingFragments(count, total);
+
+	if (frags_buffer.buffers.empty())
+		frag_buffers.pop_front();
+}
+
 void Channel::readFragments(sky::BitBuffer& msg)
 {
-	size_t size = msg.getSize();
+	std::optional<FragmentHeader> normal;
+	std::optional<FragmentHeader> file;
 
 	if (msg.read<uint8_t>())
-		readNormalFragments(msg);
+		normal = readFragmentHeader(msg);
 
 	if (msg.read<uint8_t>())
-		readFileFragments(msg, size - msg.getSize());
+		file = readFragmentHeader(msg);
+
+	// fragments data lies in front of regular messages, offsets are relative to this point
+
+	auto payload = (const uint8_t*)msg.getPositionMemory();
+	auto payload_size = msg.getRemaining();
+
+	auto isValid = [payload_size](const std::optional<FragmentHeader>& header) {
+		if (!header.has_value())
+			return true;
+
+		return header->count >= 1 && header->count <= header->total &&
+			(size_t)header->offset + header->size <= payload_size;
+	};
+
+	// writeFragments puts file data right after normal data, overlapping regions
+	// would make cutting them out below run past the end of message
+
+	bool overlapped = normal.has_value() && file.has_value() &&
+		(size_t)file->offset < (size_t)normal->offset + normal->size;
+
+	if (!isValid(normal) || !isValid(file) || overlapped)
+	{
+		Utils::Log(Console::Color::Red, "channel: bad fragment header");
+		msg.seek(static_cast<int>(msg.getRemaining()));
+		return;
+	}
+
+	std::shared_ptr<FragBuffer> normal_completed = nullptr;
+	std::shared_ptr<FileStream> file_completed = nullptr;
+
+	if (normal.has_value())
+		normal_completed = readFragment(mNormalFragBuffers, normal.value(), payload + normal->offset);
+
+	if (file.has_value())
+		file_completed = readFileFragment(file.value(), payload + file->offset);
+
+	skipFragmentsData(msg, normal, file);
+
+	if (normal_completed)
+	{
+		mNormalFragBuffers.complete(normal->getIndex());
+		readNormalFragments(normal_completed->buffer);
+	}
+
+	if (file_completed)
+	{
+		mFileFragBuffers.complete(file->getIndex());
+		Utils::dlog("file completed: \"{}\" (size: {})", file_completed->name, file_completed->output.getSize());
+		mFileHandler(file_completed->name, file_completed->output);
+	}
 }
 
-void Channel::readNormalFragments(sky::BitBuffer& msg)
+Channel::FragmentHeader Channel::readFragmentHeader(sky::BitBuffer& msg)
 {
 	auto sequence = msg.read<int32_t>();
-	auto offset = msg.read<int16_t>();
-	auto size = msg.read<int16_t>();
 
-	int index = sequence << 16;
-	int count = sequence >> 16;
-	int total = sequence & 0xFFFF;
+	FragmentHeader header;
+	header.count = sequence >> 16;
+	header.total = sequence & 0xFFFF;
+	header.offset = msg.read<uint16_t>();
+	header.size = msg.read<uint16_t>();
+
+	Utils::dlog("index: {} ({}/{}), offset: {}, size: {}", header.getIndex(), header.count, header.total, header.offset, header.size);
 
-	Utils::dlog("index: {} ({}/{}), offset: {}, size: {}", index, count, total, offset, size);
+	mMetrics.fragments_received.fetch_add(1, std::memory_order_relaxed);
+	mMetrics.setIncomingFragments(header.count, header.total);
 
-	int percent = static_cast<int>((static_cast<float>(count) / static_cast<float>(total)) * 100.0f);
-	STATS_INDICATE_GROUP("netchan_frag", fmt::format("in frag {}", index), fmt::format("{}/{} ({}%)", count, total, percent));
+	return header;
+}
+
+std::shared_ptr<Channel::FragBuffer> Channel::readFragment(FragBuffers& buffers, const FragmentHeader& header, const uint8_t* data)
+{
+	auto index = header.getIndex();
 
 	std::shared_ptr<FragBuffer> fb = nullptr;
 
 	// search frag buffer
 
-	if (mNormalFragBuffers.contains(index))
-	{
-		fb = mNormalFragBuffers.at(index);
-	}
+	fb = buffers.find(index);
 
 	// allocate new buffer if we cannot found one
 
-	if (fb == nullptr)
+	if (fb == nullptr || fb->received.size() != (size_t)header.total)
 	{
+		if ((size_t)header.total * header.size > buffers.getBudget())
+		{
+			Utils::Log(Console::Color::Red, "channel: fragments {} are too large ({}x{})", index, header.total, header.size);
+			return nullptr;
+		}
+
 		fb = std::make_shared<FragBuffer>();
-		fb->frags.resize(total);
-		mNormalFragBuffers.insert({ index, fb });
+		fb->received.resize(header.total);
+		buffers.insert(index, fb);
 	}
 
-	fb->time = Clock::Now();
+	auto slot = header.count - 1;
 
-	auto& frag = fb->frags[count - 1];
+	if (fb->received[slot])
+		return nullptr; // duplicate
 
-	// write fragment data to buffer
+	bool last = header.count == header.total;
 
-	size_t skip;
+	// all fragments except the last one have the same size, so the whole buffer 
+	// can be allocated as soon as we know this size
 
-	if (msg.read<uint8_t>())
-		skip = 9;
-	else
-		skip = 1;
+	if (fb->fragment_size == 0 && (!last || header.total == 1))
+	{
+		if ((size_t)header.total * header.size > buffers.getAvailable(index))
+		{
+			Utils::Log(Console::Color::Red, "channel: fragments {} dropped, out of memory budget", index);
+			buffers.remove(index);
+			return nullptr;
+		}
 
-	msg.seek(-1);
+		// last fragment that came first cannot be larger than others
 
-	frag.buffer.write((void*)((size_t)msg.getMemory() + msg.getPosition() + skip + offset), size);
-	frag.completed = true;
+		if (fb->last.size() > (size_t)header.size)
+		{
+			Utils::Log(Console::Color::Red, "channel: fragment {}/{} has unexpected size {}", header.total, header.total, fb->last.size());
+			buffers.remove(index);
+			return nullptr;
+		}
 
-	// remove frag data from msg
+		fb->fragment_size = header.size;
+		fb->buffer.setSize(header.total * fb->fragment_size);
 
-	size_t wpos = msg.getPosition() + skip + offset;
-	size_t rpos = wpos + size;
+		if (fb->received[header.total - 1])
+		{
+			auto dst = (uint8_t*)fb->buffer.getMemory() + (header.total - 1) * fb->fragment_size;
+			memcpy(dst, fb->last.data(), fb->last.size());
+			fb->last.clear();
+		}
+	}
 
-	memmove((void*)((size_t)msg.getMemory() + wpos), (void*)((size_t)msg.getMemory() + rpos), 
-		msg.getSize() - rpos);
+	if ((!last && (size_t)header.size != fb->fragment_size) || (fb->fragment_size != 0 && (size_t)header.size > fb->fragment_size))
+	{
+		Utils::Log(Console::Color::Red, "channel: fragment {}/{} has unexpected size {}", header.count, header.total, header.size);
+		return nullptr;
+	}
 
-	msg.setSize(msg.getSize() - size);
+	if (last)
+		fb->last_size = header.size;
 
-	// check for completion
+	if (fb->fragment_size == 0)
+	{
+		// last fragment came first, we will know its place only after any other fragment
+		fb->last.assign(data, data + header.size);
+	}
+	else
+	{
+		auto dst = (uint8_t*)fb->buffer.getMemory() + slot * fb->fragment_size;
+		memcpy(dst, data, header.size);
+	}
 
-	bool completed = std::all_of(fb->frags.begin(), fb->frags.end(), [](const auto& frag) {
-		return frag.completed;
-	});
+	fb->received[slot] = true;
+	fb->received_count += 1;
 
-	if (completed)
+	if (!buffers.touch(index, fb->buffer.getSize() + fb->last.size()))
 	{
-		sky::BitBuffer buf;
+		Utils::Log(Console::Color::Red, "channel: fragments {} dropped, out of memory budget", index);
+		return nullptr;
+	}
 
-		for (auto& f : fb->frags)
-		{
-			sky::bitbuffer_helpers::WriteToBuffer(f.buffer, buf);
-		}
+	if (fb->received_count < fb->received.size())
+		return nullptr;
 
-		buf.toStart();
+	fb->buffer.setSize((header.total - 1) * fb->fragment_size + fb->last_size);
+	fb->buffer.toStart();
 
-		Utils::dlog("fragments completed (size: {})", buf.getSize());
+	return fb;
+}
 
-		if (buf.getRemaining() >= 3 && sky::bitbuffer_helpers::ReadString(buf) == "BZ2")
-		{
-			uint32_t dst_len = 65536;
-			sky::BitBuffer dst_buf;
-			dst_buf.setSize(dst_len);
+void Channel::skipFragmentsData(sky::BitBuffer& msg, const std::optional<FragmentHeader>& normal,
+	const std::optional<FragmentHeader>& file)
+{
+	std::vector<std::pair<size_t, size_t>> regions; // offset, size
 
-			auto dst = (char*)dst_buf.getMemory();
-			auto src = (char*)((size_t)buf.getMemory() + buf.getPosition());
-			auto src_len = (unsigned int)(buf.getSize() - buf.getPosition());
+	if (normal.has_value())
+		regions.push_back({ normal->offset, normal->size });
 
-			BZ2_bzBuffToBuffDecompress(dst, &dst_len, src, src_len, 1, 0);
+	if (file.has_value())
+		regions.push_back({ file->offset, file->size });
 
-			buf.clear();
-			buf.write(dst_buf.getMemory(), dst_len);
+	std::sort(regions.begin(), regions.end());
 
-			Utils::dlog("decompress {} -> {}", src_len, dst_len);
-		}
+	// usually fragments data goes one by one right from the start,
+	// so regular messages can be read right after it without any moving
 
-		// read just completed fragbuf as normal messages
+	size_t skip = 0;
 
-		buf.toStart();
-		mReadHandler(buf);
+	for (const auto& [offset, size] : regions)
+	{
+		if (offset != skip)
+			break;
 
-		// remove completed fragbuf
+		skip += size;
+	}
 
-		mNormalFragBuffers.erase(index);
+	if (skip == std::accumulate(regions.begin(), regions.end(), (size_t)0, [](size_t a, const auto& b) { return a + b.second; }))
+	{
+		msg.seek(static_cast<int>(skip));
+		return;
+	}
+
+	// otherwise cut fragments data out, starting from the farthest one
+
+	auto payload = msg.getPosition();
+
+	for (auto it = regions.rbegin(); it != regions.rend(); ++it)
+	{
+		auto [offset, size] = *it;
+
+		size_t wpos = payload + offset;
+
+		if (wpos >= msg.getSize())
+			continue;
+
+		size = std::min(size, msg.getSize() - wpos);
+
+		size_t rpos = wpos + size;
+
+		memmove((void*)((size_t)msg.getMemory() + wpos), (void*)((size_t)msg.getMemory() + rpos),
+			msg.getSize() - rpos);
+
+		msg.setSize(msg.getSize() - size);
 	}
 }
 
-void Channel::readFileFragments(sky::BitBuffer& msg, size_t normalSize)
+void Channel::readNormalFragments(sky::BitBuffer& buf)
 {
-	auto sequence = msg.read<int32_t>();
-	auto offset = msg.read<int16_t>();
-	auto size = msg.read<int16_t>();
+	Utils::dlog("fragments completed (size: {})", buf.getSize());
 
-	int index = sequence << 16;
-	int count = sequence >> 16;
-	int total = sequence & 0xFFFF;
+	if (buf.getRemaining() >= 3 && sky::bitbuffer_helpers::ReadString(buf) == "BZ2")
+	{
+		sky::BitBuffer dst_buf;
+		BZ2Decompressor decompressor;
 
-	Utils::dlog("index: {} ({}/{}), offset: {}, size: {}", index, count, total, offset, size);
+		auto src_len = buf.getRemaining();
 
-	int percent = static_cast<int>((static_cast<float>(count) / static_cast<float>(total)) * 100.0f);
-	STATS_INDICATE_GROUP("netchan_frag", fmt::format("in frag {}", index), fmt::format("{}/{} ({}%)", count, total, percent));
+		// a few compressed fragments can expand into gigabytes, so output is
+		// limited by the same budget as incoming fragments
 
-	offset -= (int16_t)normalSize; // !!!
+		auto max_size = mNormalFragBuffers.getBudget();
 
-	std::shared_ptr<FragBuffer> fb = nullptr;
+		if (!decompressor.decompress(buf.getPositionMemory(), src_len, dst_buf, max_size) || !decompressor.isFinished())
+		{
+			if (decompressor.isOverflowed())
+				Utils::Log(Console::Color::Red, "channel: decompressed fragments are larger than {}", max_size);
+			else
+				Utils::Log(Console::Color::Red, "channel: cannot decompress fragments");
 
-	if (mFileFragBuffers.contains(index))
-	{
-		fb = mFileFragBuffers.at(index);
+			return;
+		}
+
+		dst_buf.setSize(decompressor.getTotalOut());
+
+		Utils::dlog("decompress {} -> {}", src_len, dst_buf.getSize());
+
+		dst_buf.toStart();
+		mReadHandler(dst_buf);
+		return;
 	}
 
-	// allocate new buffer if we cannot found one
+	// read just completed fragbuf as normal messages
+
+	buf.toStart();
+	mReadHandler(buf);
+}
+
+std::shared_ptr<Channel::FileStream> Channel::readFileFragment(const FragmentHeader& header, const uint8_t* data)
+{
+	auto index = header.getIndex();
+
+	std::shared_ptr<FileStream> stream = nullptr;
+
+	stream = mFileFragBuffers.find(index);
 
-	if (fb == nullptr)
+	if (stream == nullptr || stream->received.size() != (size_t)header.total)
 	{
-		fb = std::make_shared<FragBuffer>();
-		fb->frags.resize(total);
-		mFileFragBuffers.insert({ index, fb });
+		stream = std::make_shared<FileStream>();
+		stream->received.resize(header.total);
+		mFileFragBuffers.insert(index, stream);
 	}
 
-	fb->time = Clock::Now();
+	auto slot = (size_t)(header.count - 1);
+
+	if (stream->received[slot])
+		return nullptr; // duplicate
 
-	auto& frag = fb->frags[count - 1];
+	stream->received[slot] = true;
+	stream->received_count += 1;
 
-	// write fragment to buffer
+	if (slot != stream->next)
+	{
+		stream->pending[slot].assign(data, data + header.size);
+		stream->pending_bytes += header.size;
 
-	frag.buffer.write((void*)((size_t)msg.getMemory() + msg.getPosition() + offset), size);
-	frag.completed = true;
+		if (!mFileFragBuffers.touch(index, stream->getBytes()))
+			Utils::Log(Console::Color::Red, "channel: file fragments {} dropped, out of memory budget", index);
 
-	// remove frag data from msg
+		return nullptr;
+	}
 
-	size_t wpos = msg.getPosition() + offset;
-	size_t rpos = wpos + size;
+	bool ok = decodeFileFragment(*stream, data, header.size);
+	stream->next += 1;
 
-	memmove((void*)((size_t)msg.getMemory() + wpos), (void*)((size_t)msg.getMemory() + rpos),
-		msg.getSize() - rpos);
+	while (ok && stream->pending.contains(stream->next))
+	{
+		auto node = stream->pending.extract(stream->next);
+		stream->pending_bytes -= node.mapped().size();
+		ok = decodeFileFragment(*stream, node.mapped().data(), node.mapped().size());
+		stream->next += 1;
+	}
 
-	msg.setSize(msg.getSize() - size);
+	if (!ok)
+	{
+		Utils::Log(Console::Color::Red, "channel: cannot decode file \"{}\"", stream->name);
+		mFileFragBuffers.remove(index);
+		return nullptr;
+	}
 
-	// check for completion
+	if (!mFileFragBuffers.touch(index, stream->getBytes()))
+	{
+		Utils::Log(Console::Color::Red, "channel: file \"{}\" dropped, out of memory budget", stream->name);
+		return nullptr;
+	}
 
-	bool completed = std::all_of(fb->frags.begin(), fb->frags.end(), [](const auto& frag) {
-		return frag.completed;
-	});
+	if (stream->next < stream->received.size())
+		return nullptr;
 
-	if (completed)
+	if (!stream->header_parsed || (stream->compressed && !stream->decompressor.isFinished()))
 	{
-		//std::cout << total << " file fragments completed" << std::endl;
+		Utils::Log(Console::Color::Red, "channel: file \"{}\" is incomplete", stream->name);
+		mFileFragBuffers.remove(index);
+		return nullptr;
+	}
 
-		sky::BitBuffer buf;
+	if (stream->compressed)
+		stream->output.setSize(stream->decompressor.getTotalOut());
 
-		for (auto& f : fb->frags)
-		{
-			sky::bitbuffer_helpers::WriteToBuffer(f.buffer, buf);
-		}
+	stream->output.toStart();
 
-		buf.toStart();
+	return stream;
+}
 
-		Utils::dlog("fragments completed (size: {})", buf.getSize());
+bool Channel::decodeFileFragment(FileStream& stream, const uint8_t* data, size_t size)
+{
+	if (!stream.header_parsed)
+	{
+		// header: name, "bz2" or "uncompressed", uint32 size
 
-		auto fileName = sky::bitbuffer_helpers::ReadString(buf);
-		bool compressed = sky::bitbuffer_helpers::ReadString(buf) == "bz2";
-		uint32_t size = buf.read<uint32_t>();
+		stream.head.insert(stream.head.end(), data, data + size);
 
-		sky::BitBuffer filebuf;
+		auto& head = stream.head;
+		auto name_end = std::find(head.begin(), head.end(), 0);
 
-		filebuf.setSize(size);
+		if (name_end == head.end())
+			return true;
 
-		if (compressed)
-		{
-			auto dst = (char*)filebuf.getMemory();
-			auto src = (char*)((size_t)buf.getMemory() + buf.getPosition());
-			auto src_len = (unsigned int)(buf.getSize() - buf.getPosition());
+		auto method_end = std::find(name_end + 1, head.end(), 0);
 
-			BZ2_bzBuffToBuffDecompress(dst, &size, src, src_len, 1, 0);
+		if (method_end == head.end() || head.end() - method_end < 5)
+			return true;
 
-			Utils::dlog("decompress {} -> {}", src_len, size);
+		stream.name.assign(head.begin(), name_end);
+		stream.compressed = std::string(name_end + 1, method_end) == "bz2";
+		memcpy(&stream.size, &*(method_end + 1), sizeof(uint32_t));
+		stream.header_parsed = true;
+
+		if (stream.size > mFileFragBuffers.getBudget())
+		{
+			Utils::Log(Console::Color::Red, "channel: file \"{}\" is too large ({})", stream.name, stream.size);
+			return false;
 		}
-		else
+
+		if (stream.compressed)
+			stream.output.setSize(stream.size);
+
+		auto body = std::vector<uint8_t>(method_end + 5, head.end());
+		head.clear();
+		head.shrink_to_fit();
+
+		if (body.empty())
+			return true;
+
+		return decodeFileFragment(stream, body.data(), body.size());
+	}
+
+	// file cannot be larger than its header says
+
+	if (!stream.compressed)
+	{
+		if (stream.output.getSize() + size > stream.size)
 		{
-			for (int i = 0; i < static_cast<int>(size); i++)
-				filebuf.write<uint8_t>(buf.read<uint8_t>());
+			Utils::Log(Console::Color::Red, "channel: file \"{}\" is larger than {}", stream.name, stream.size);
+			return false;
 		}
 
-		mFileHandler(fileName, filebuf);
+		stream.output.write((void*)data, size);
+		return true;
+	}
+
+	if (!stream.decompressor.decompress(data, size, stream.output, stream.size))
+	{
+		if (stream.decompressor.isOverflowed())
+			Utils::Log(Console::Color::Red, "channel: file \"{}\" is larger than {}", stream.name, stream.size);
 
-		mFileFragBuffers.erase(index);
+		return false;
 	}
+
+	return true;
 }
 
 void Channel::addReliableMessage(sky::BitBuffer& msg)
 {
-	auto bf = sky::BitBuffer();
-	sky::bitbuffer_helpers::WriteToBuffer(msg, bf);
-	mReliableMessages.push_back(bf);
+	auto& bf = mReliableMessages.push_back();
+	bf.clear();
+	bf.write(msg.getMemory(), msg.getSize());
+}
+
+std::vector<Channel::IncomingFileProgress> Channel::getIncomingFiles() const
+{
+	std::vector<IncomingFileProgress> result;
+
+	for (const auto& [index, entry] : mFileFragBuffers)
+	{
+		const auto& stream = *entry.value;
+		result.push_back({ stream.name, stream.received_count, stream.received.size() });
+	}
+
+	return result;
 }
 
 void Channel::fragmentateReliableBuffer(int fragment_size, bool compress)
 {
-	assert(!mReliableMessages.empty());
+	// messages of reliable packet in flight stay in place, they are popped
+	// on its ack or sent again, only ones after them are folded
+
+	auto first = static_cast<size_t>(mReliableSent);
+
+	if (mReliableMessages.size() <= first)
+		return;
 
 	sky::BitBuffer msg;
 
-	for (const auto& reliable : mReliableMessages)
+	for (size_t i = first; i < mReliableMessages.size(); i++)
 	{
+		const auto& reliable = mReliableMessages[i];
 		msg.write(reliable.getMemory(), reliable.getSize());
 	}
 
@@ -469,29 +858,74 @@ void Channel::fragmentateReliableBuffer(int fragment_size, bool compress)
 		Utils::dlog("compress {} -> {}", src_len, dst_len);
 	}
 
-	mReliableMessages.clear();
+	while (mReliableMessages.size() > first)
+		mReliableMessages.pop_back();
 
-	OutgoingFragBuffer frag_buf;
+	auto frag_buf = createFragments(msg, fragment_size);
+	mOutgoingFragBuffers.push_back(frag_buf);
+
+	Utils::dlog("{} fragments created", frag_buf.total);
+}
+
+void Channel::addFile(const std::string& name, const void* data, size_t size, int fragment_size, bool compress)
+{
+	sky::BitBuffer msg;
 
-	msg.toStart();
+	sky::bitbuffer_helpers::WriteString(msg, name);
 
-	while (msg.hasRemaining())
+	if (compress)
 	{
+		// bzip2 output is never larger than input + 1% + 600 bytes
+
+		auto dst_len = (unsigned int)(size + size / 100 + 600);
+
 		sky::BitBuffer temp_buf;
+		temp_buf.setSize(dst_len);
+
+		auto dst = (char*)temp_buf.getMemory();
+		auto src = (char*)data;
+		auto res = BZ2_bzBuffToBuffCompress(dst, &dst_len, src, (unsigned int)size, 9, 0, 30);
+
+		compress = res == BZ_OK && dst_len < size;
 
-		for (int i = 0; i < fragment_size; i++)
+		if (compress)
 		{
-			if (!msg.hasRemaining())
-				break;
+			sky::bitbuffer_helpers::WriteString(msg, "bz2");
+			msg.write<uint32_t>(static_cast<uint32_t>(size));
+			msg.write(temp_buf.getMemory(), dst_len);
 
-			temp_buf.write<uint8_t>(msg.read<uint8_t>());
+			Utils::dlog("compress {} -> {}", size, dst_len);
 		}
+	}
+
+	if (!compress)
+	{
+		sky::bitbuffer_helpers::WriteString(msg, "uncompressed");
+		msg.write<uint32_t>(static_cast<uint32_t>(size));
+		msg.write((void*)data, size);
+	}
+
+	auto frag_buf = createFragments(msg, fragment_size);
+	mOutgoingFileFragBuffers.push_back(frag_buf);
+
+	Utils::dlog("file \"{}\": {} fragments created", name, frag_buf.total);
+}
+
+Channel::OutgoingFragBuffer Channel::createFragments(sky::BitBuffer& msg, int fragment_size)
+{
+	OutgoingFragBuffer frag_buf;
 
+	auto data = (const uint8_t*)msg.getMemory();
+	auto size = msg.getSize();
+
+	for (size_t pos = 0; pos < size; pos += fragment_size)
+	{
+		sky::BitBuffer temp_buf;
+		temp_buf.write((void*)(data + pos), std::min<size_t>(fragment_size, size - pos));
 		frag_buf.buffers.push_back(temp_buf);
 	}
 
 	frag_buf.total = frag_buf.buffers.size();
-	mOutgoingFragBuffers.push_back(frag_buf);
 
-	Utils::dlog("{} fragments created", frag_buf.total);
-}
\ No newline at end of file
+	return frag_buf;
+}
@@ -1,49 +1,62 @@
 #pragma once
 
-// TODO: add timeouts for frag buffers
-
 #include <shared/all.h>
+#include "bz2_decompressor.h"
+#include "channel_metrics.h"
+#include "reassembly_cache.h"
+#include "ring_buffer.h"
 
 namespace HL
 {
 	class Channel : public Common::FrameSystem::Frameable
 	{
 	public:
+		using SendHandler = std::function<void(Network::Packet& packet)>;
 		using MessagesHandler = std::function<void(sky::BitBuffer& msg)>;
 		using FileHandler = std::function<void(const std::string& name, sky::BitBuffer& buf)>;
 
 	public:
-		Channel(std::shared_ptr<Network::UdpSocket> socket, MessagesHandler readHandler, MessagesHandler writeHandler, FileHandler fileHandler);
+		Channel(SendHandler sendHandler, MessagesHandler readHandler, MessagesHandler writeHandler, FileHandler fileHandler);
 
 	private:
 		void onFrame() override;
 
+	public:
+		void frame(); // same as frame system does, when external frames are enabled
+		void setExternalFrames(bool value) { mExternalFrames = value; }
+
+	private:
+		void schedule();
+		bool hasReliableData() const;
+		Clock::Duration getRetransmitTimeout() const;
+		void updateMetrics();
+
 	public:
 		void transmit();
+		void requestTransmit() { mTransmitRequested = true; }
 		void process(sky::BitBuffer& msg);
 		void addReliableMessage(sky::BitBuffer& msg);
-		void fragmentateReliableBuffer(int fragment_size = 512, bool compress = true);
+		void fragmentateReliableBuffer(int fragment_size = 512, bool compress = true); // messages not sent yet
+		void addFile(const std::string& name, const void* data, size_t size, int fragment_size = 512, bool compress = true);
 
 	private:
 		void writeFragments(sky::BitBuffer& msg);
 		void writeReliableMessages(sky::BitBuffer& msg);
 		void readFragments(sky::BitBuffer& msg);
-		void readNormalFragments(sky::BitBuffer& msg);
-		void readFileFragments(sky::BitBuffer& msg, size_t normalSize);
+		void readNormalFragments(sky::BitBuffer& buf);
 
 	private:
+		SendHandler mSendHandler;
 		MessagesHandler mReadHandler;
 		MessagesHandler mWriteHandler;
 		FileHandler mFileHandler;
+		bool mExternalFrames = false;
 
 	public:
-		auto getSocket() { return mSocket; }
-
 		auto getAddress() const { return mAddress; }
 		void setAddress(Network::Address value) { mAddress = value; }
 
 	private:
-		std::shared_ptr<Network::UdpSocket> mSocket;
 		Network::Address mAddress;
 
 	public:
@@ -69,35 +82,108 @@ namespace HL
 		uint32_t mReliableSequence = 0;
 
 		Clock::Duration mLatency = Clock::Duration::zero();
+		Clock::Duration mSmoothedLatency = Clock::Duration::zero(); // zero until first sample
+		Clock::Duration mLatencyVariation = Clock::Duration::zero();
 		uint32_t mLatencySequence = 0;
 		Clock::TimePoint mLatencyTime = Clock::Now();
 		bool mLatencyReady = true;
 
 		int mReliableSent = 0;
 
-		Common::Timer mTimer;
-		std::list<sky::BitBuffer> mReliableMessages;
+		RingBuffer<sky::BitBuffer> mReliableMessages;
+		Network::Packet mPacket;
+
+	public:
+		const auto& getMetrics() const { return mMetrics; }
+
+		auto getRate() const { return mRate; }
+		void setRate(int value) { mRate = std::max(value, 1000); }
+
+		auto getMaxPacketRate() const { return mMaxPacketRate; }
+		void setMaxPacketRate(int value) { mMaxPacketRate = std::max(value, 1); }
+
+		auto getKeepaliveInterval() const { return mKeepaliveInterval; }
+		void setKeepaliveInterval(Clock::Duration value) { mKeepaliveInterval = value; }
+
+	private:
+		int mRate = 25000; // bytes per second
+		int mMaxPacketRate = 100;
+		Clock::Duration mKeepaliveInterval = Clock::FromSeconds(1.0f);
+		float mTokens = 0.0f;
+		Clock::TimePoint mTokensTime = Clock::Now();
+		Clock::TimePoint mTransmitTime = Clock::Now();
+		bool mTransmitRequested = false;
+		bool mChoked = false;
+		int mReliableProbes = 0; // sent since reliable packet went out, for backoff
+		ChannelMetrics mMetrics;
+		Clock::TimePoint mMetricsTime = Clock::Now();
 
 	public:
 		const auto& getNormalFragBuffers() const { return mNormalFragBuffers; }
 		const auto& getFileFragBuffers() const { return mFileFragBuffers; }
 
+		auto& getNormalFragBuffers() { return mNormalFragBuffers; }
+		auto& getFileFragBuffers() { return mFileFragBuffers; }
+
 	public:
-		struct Fragment
+		struct FragBuffer
 		{
-			sky::BitBuffer buffer;
-			bool completed = false;
+			Clock::TimePoint time;
+			sky::BitBuffer buffer; // total * fragment_size, filled in place by fragment index
+			std::vector<bool> received;
+			size_t received_count = 0;
+			size_t fragment_size = 0;
+			size_t last_size = 0;
+			std::vector<uint8_t> last; // last fragment, if it came before we know fragment_size
 		};
 
-		struct FragBuffer
+		using FragBuffers = ReassemblyCache</*index*/int32_t, FragBuffer>;
+
+		// file fragments are decoded as soon as they come in order, only fragments 
+		// that came ahead of the decoding position are kept
+
+		struct FileStream
 		{
 			Clock::TimePoint time;
-			std::vector<Fragment> frags;
+			std::vector<bool> received;
+			size_t received_count = 0;
+			size_t next = 0; // next fragment to decode
+			std::map<size_t, std::vector<uint8_t>> pending;
+			size_t pending_bytes = 0;
+			std::vector<uint8_t> head; // collected until file header is parsed
+			bool header_parsed = false;
+			std::string name;
+			bool compressed = false;
+			uint32_t size = 0;
+			BZ2Decompressor decompressor;
+			sky::BitBuffer output;
+
+			size_t getBytes() const { return pending_bytes + head.size() + output.getSize(); }
 		};
 
+		using FileStreams = ReassemblyCache</*index*/int32_t, FileStream>;
+
 	private:
-		std::map</*index*/int32_t, std::shared_ptr<FragBuffer>> mNormalFragBuffers;
-		std::map</*index*/int32_t, std::shared_ptr<FragBuffer>> mFileFragBuffers;
+		struct FragmentHeader
+		{
+			int count = 0;
+			int total = 0;
+			int offset = 0;
+			int size = 0;
+
+			int32_t getIndex() const { return total << 16; }
+		};
+
+		FragmentHeader readFragmentHeader(sky::BitBuffer& msg);
+		std::shared_ptr<FragBuffer> readFragment(FragBuffers& buffers, const FragmentHeader& header, const uint8_t* data);
+		std::shared_ptr<FileStream> readFileFragment(const FragmentHeader& header, const uint8_t* data);
+		bool decodeFileFragment(FileStream& stream, const uint8_t* data, size_t size);
+		void skipFragmentsData(sky::BitBuffer& msg, const std::optional<FragmentHeader>& normal,
+			const std::optional<FragmentHeader>& file);
+
+	private:
+		FragBuffers mNormalFragBuffers = FragBuffers(4 * 1024 * 1024, Clock::FromSeconds(10.0f));
+		FileStreams mFileFragBuffers = FileStreams(64 * 1024 * 1024, Clock::FromSeconds(10.0f));
 
 		struct OutgoingFragBuffer
 		{
@@ -106,5 +192,25 @@ namespace HL
 		};
 
 		std::list<OutgoingFragBuffer> mOutgoingFragBuffers;
+		std::list<OutgoingFragBuffer> mOutgoingFileFragBuffers;
+		bool mNormalFragmentSent = false;
+		bool mFileFragmentSent = false;
+
+		OutgoingFragBuffer createFragments(sky::BitBuffer& msg, int fragment_size);
+		void writeFragmentHeader(sky::BitBuffer& msg, const OutgoingFragBuffer& frag_buf, uint16_t offset);
+		void popOutgoingFragment(std::list<OutgoingFragBuffer>& frag_buffers);
+
+	public:
+		struct IncomingFileProgress
+		{
+			std::string name; // empty until file header is received
+			size_t received = 0; // fragments
+			size_t total = 0;
+		};
+
+		std::vector<IncomingFileProgress> getIncomingFiles() const;
+
+		auto getOutgoingFragmentsCount() const { return mOutgoingFragBuffers.size(); }
+		auto getOutgoingFileFragmentsCount() const { return mOutgoingFileFragBuffers.size(); }
 	};
 }
\ No newline at end of file
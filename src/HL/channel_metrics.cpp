@@ -0,0 +1,164 @@
+#include "channel_metrics.h"
+#include <cmath>
+#include <fmt/format.h>
+
+using namespace HL;
+
+void ChannelMetrics::addIncoming(size_t bytes)
+{
+	mIncomingPackets.fetch_add(1, std::memory_order_relaxed);
+	mIncomingBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ChannelMetrics::addOutgoing(size_t bytes)
+{
+	mOutgoingPackets.fetch_add(1, std::memory_order_relaxed);
+	mOutgoingBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ChannelMetrics::addRtt(uint32_t ms)
+{
+	// jitter is smoothed difference between consecutive rtt samples (rfc 3550)
+
+	if (mHasRtt)
+	{
+		auto diff = std::abs(static_cast<float>(ms) - static_cast<float>(mRtt.load(std::memory_order_relaxed)));
+		mSmoothJitter += (diff - mSmoothJitter) / 16.0f;
+
+		auto jitter = static_cast<uint32_t>(mSmoothJitter);
+		mJitter.store(jitter, std::memory_order_relaxed);
+		mJitterHistogram.add(jitter, JitterBounds);
+	}
+
+	mHasRtt = true;
+	mRtt.store(ms, std::memory_order_relaxed);
+	mRttHistogram.add(ms, RttBounds);
+}
+
+void ChannelMetrics::updateRates(float seconds)
+{
+	if (seconds <= 0.0f)
+		return;
+
+	auto rate = [seconds](const std::atomic<uint64_t>& value, uint64_t& prev, std::atomic<float>& result) {
+		auto current = value.load(std::memory_order_relaxed);
+		result.store(static_cast<float>(current - prev) / seconds, std::memory_order_relaxed);
+		prev = current;
+	};
+
+	rate(mIncomingPackets, mPrevIncomingPackets, mIncomingPacketsPerSecond);
+	rate(mIncomingBytes, mPrevIncomingBytes, mIncomingBytesPerSecond);
+	rate(mOutgoingPackets, mPrevOutgoingPackets, mOutgoingPacketsPerSecond);
+	rate(mOutgoingBytes, mPrevOutgoingBytes, mOutgoingBytesPerSecond);
+}
+
+void ChannelMetrics::setIncomingFragments(uint32_t count, uint32_t total)
+{
+	mIncomingFragmentsCount.store(count, std::memory_order_relaxed);
+	mIncomingFragmentsTotal.store(total, std::memory_order_relaxed);
+}
+
+void ChannelMetrics::setOutgoingFragments(uint32_t count, uint32_t total)
+{
+	mOutgoingFragmentsCount.store(count, std::memory_order_relaxed);
+	mOutgoingFragmentsTotal.store(total, std::memory_order_relaxed);
+}
+
+ChannelMetrics::Snapshot ChannelMetrics::snapshot() const
+{
+	auto load = [](const auto& value) { return value.load(std::memory_order_relaxed); };
+
+	Snapshot result;
+	result.incoming_packets = load(mIncomingPackets);
+	result.incoming_bytes = load(mIncomingBytes);
+	result.outgoing_packets = load(mOutgoingPackets);
+	result.outgoing_bytes = load(mOutgoingBytes);
+	result.incoming_packets_per_second = load(mIncomingPacketsPerSecond);
+	result.incoming_bytes_per_second = load(mIncomingBytesPerSecond);
+	result.outgoing_packets_per_second = load(mOutgoingPacketsPerSecond);
+	result.outgoing_bytes_per_second = load(mOutgoingBytesPerSecond);
+	result.dropped_packets = load(dropped_packets);
+	result.duplicate_packets = load(duplicate_packets);
+	result.out_of_order_packets = load(out_of_order_packets);
+	result.choked = load(choked);
+	result.keepalives = load(keepalives);
+	result.reliable_retransmits = load(reliable_retransmits);
+	result.reliable_probes = load(reliable_probes);
+	result.fragments_received = load(fragments_received);
+	result.fragments_sent = load(fragments_sent);
+	result.rtt = load(mRtt);
+	result.jitter = load(mJitter);
+	result.incoming_fragments_count = load(mIncomingFragmentsCount);
+	result.incoming_fragments_total = load(mIncomingFragmentsTotal);
+	result.outgoing_fragments_count = load(mOutgoingFragmentsCount);
+	result.outgoing_fragments_total = load(mOutgoingFragmentsTotal);
+	result.rtt_histogram = mRttHistogram.load();
+	result.jitter_histogram = mJitterHistogram.load();
+	return result;
+}
+
+namespace
+{
+	template <size_t N, size_t M>
+	std::string HistogramToString(const std::array<uint64_t, N>& values, const std::array<uint32_t, M>& bounds, bool json)
+	{
+		std::string result;
+
+		for (size_t i = 0; i < N; i++)
+		{
+			auto name = i < M ? fmt::format("<={}", bounds[i]) : fmt::format(">{}", bounds[M - 1]);
+
+			if (json)
+				result += fmt::format("{}\"{}\": {}", i > 0 ? ", " : "", name, values[i]);
+			else
+				result += fmt::format("{}{}: {}", i > 0 ? ", " : "", name, values[i]);
+		}
+
+		return result;
+	}
+}
+
+std::string ChannelMetrics::Snapshot::toText() const
+{
+	std::string result;
+
+	result += fmt::format("in: {} packets, {} bytes ({:.1f} p/s, {:.1f} b/s)\n", incoming_packets, incoming_bytes,
+		incoming_packets_per_second, incoming_bytes_per_second);
+	result += fmt::format("out: {} packets, {} bytes ({:.1f} p/s, {:.1f} b/s)\n", outgoing_packets, outgoing_bytes,
+		outgoing_packets_per_second, outgoing_bytes_per_second);
+	result += fmt::format("rtt: {} ms, jitter: {} ms\n", rtt, jitter);
+	result += fmt::format("dropped: {}, duplicates: {}, out of order: {}\n", dropped_packets, duplicate_packets, out_of_order_packets);
+	result += fmt::format("choked: {}, keepalives: {}, reliable retransmits: {}, reliable probes: {}\n", choked, keepalives,
+		reliable_retransmits, reliable_probes);
+	result += fmt::format("fragments: {} in ({}/{}), {} out ({}/{})\n", fragments_received, incoming_fragments_count,
+		incoming_fragments_total, fragments_sent, outgoing_fragments_count, outgoing_fragments_total);
+	result += fmt::format("rtt histogram: {}\n", HistogramToString(rtt_histogram, RttBounds, false));
+	result += fmt::format("jitter histogram: {}", HistogramToString(jitter_histogram, JitterBounds, false));
+
+	return result;
+}
+
+std::string ChannelMetrics::Snapshot::toJson() const
+{
+	std::string result = "{";
+
+	result += fmt::format("\"incoming_packets\": {}, \"incoming_bytes\": {}, ", incoming_packets, incoming_bytes);
+	result += fmt::format("\"outgoing_packets\": {}, \"outgoing_bytes\": {}, ", outgoing_packets, outgoing_bytes);
+	result += fmt::format("\"incoming_packets_per_second\": {:.2f}, \"incoming_bytes_per_second\": {:.2f}, ",
+		incoming_packets_per_second, incoming_bytes_per_second);
+	result += fmt::format("\"outgoing_packets_per_second\": {:.2f}, \"outgoing_bytes_per_second\": {:.2f}, ",
+		outgoing_packets_per_second, outgoing_bytes_per_second);
+	result += fmt::format("\"dropped_packets\": {}, \"duplicate_packets\": {}, \"out_of_order_packets\": {}, ",
+		dropped_packets, duplicate_packets, out_of_order_packets);
+	result += fmt::format("\"choked\": {}, \"keepalives\": {}, \"reliable_retransmits\": {}, \"reliable_probes\": {}, ", choked,
+		keepalives, reliable_retransmits, reliable_probes);
+	result += fmt::format("\"fragments_received\": {}, \"fragments_sent\": {}, ", fragments_received, fragments_sent);
+	result += fmt::format("\"incoming_fragments\": [{}, {}], \"outgoing_fragments\": [{}, {}], ", incoming_fragments_count,
+		incoming_fragments_total, outgoing_fragments_count, outgoing_fragments_total);
+	result += fmt::format("\"rtt\": {}, \"jitter\": {}, ", rtt, jitter);
+	result += fmt::format("\"rtt_histogram\": {{{}}}, ", HistogramToString(rtt_histogram, RttBounds, true));
+	result += fmt::format("\"jitter_histogram\": {{{}}}", HistogramToString(jitter_histogram, JitterBounds, true));
+	result += "}";
+
+	return result;
+}
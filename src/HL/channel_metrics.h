@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace HL
+{
+	// counters of one channel, written only by the channel, can be read
+	// from any thread with snapshot(), nothing is formatted until export
+
+	class ChannelMetrics
+	{
+	public:
+		static constexpr std::array<uint32_t, 12> RttBounds = { 5, 10, 20, 30, 50, 75, 100, 150, 200, 300, 500, 1000 }; // ms
+		static constexpr std::array<uint32_t, 8> JitterBounds = { 1, 2, 5, 10, 20, 50, 100, 200 }; // ms
+
+		template <size_t N>
+		class Histogram
+		{
+		public:
+			void add(uint32_t value, const std::array<uint32_t, N>& bounds)
+			{
+				size_t i = 0;
+
+				while (i < N && value > bounds[i])
+					i++;
+
+				mBuckets[i].fetch_add(1, std::memory_order_relaxed);
+			}
+
+			std::array<uint64_t, N + 1> load() const
+			{
+				std::array<uint64_t, N + 1> result;
+
+				for (size_t i = 0; i <= N; i++)
+				{
+					result[i] = mBuckets[i].load(std::memory_order_relaxed);
+				}
+
+				return result;
+			}
+
+		private:
+			std::array<std::atomic<uint64_t>, N + 1> mBuckets = {}; // last one is overflow
+		};
+
+		struct Snapshot
+		{
+			uint64_t incoming_packets = 0;
+			uint64_t incoming_bytes = 0;
+			uint64_t outgoing_packets = 0;
+			uint64_t outgoing_bytes = 0;
+			float incoming_packets_per_second = 0.0f;
+			float incoming_bytes_per_second = 0.0f;
+			float outgoing_packets_per_second = 0.0f;
+			float outgoing_bytes_per_second = 0.0f;
+			uint64_t dropped_packets = 0;
+			uint64_t duplicate_packets = 0;
+			uint64_t out_of_order_packets = 0;
+			uint64_t choked = 0;
+			uint64_t keepalives = 0;
+			uint64_t reliable_retransmits = 0;
+			uint64_t reliable_probes = 0;
+			uint64_t fragments_received = 0;
+			uint64_t fragments_sent = 0;
+			uint32_t rtt = 0; // ms
+			uint32_t jitter = 0; // ms
+			uint32_t incoming_fragments_count = 0; // of current stream
+			uint32_t incoming_fragments_total = 0;
+			uint32_t outgoing_fragments_count = 0;
+			uint32_t outgoing_fragments_total = 0;
+			std::array<uint64_t, RttBounds.size() + 1> rtt_histogram = {};
+			std::array<uint64_t, JitterBounds.size() + 1> jitter_histogram = {};
+
+			std::string toText() const;
+			std::string toJson() const;
+		};
+
+	public:
+		void addIncoming(size_t bytes);
+		void addOutgoing(size_t bytes);
+		void addRtt(uint32_t ms);
+		void updateRates(float seconds);
+
+		void setIncomingFragments(uint32_t count, uint32_t total);
+		void setOutgoingFragments(uint32_t count, uint32_t total);
+
+		Snapshot snapshot() const;
+
+	public:
+		std::atomic<uint64_t> dropped_packets = 0;
+		std::atomic<uint64_t> duplicate_packets = 0;
+		std::atomic<uint64_t> out_of_order_packets = 0;
+		std::atomic<uint64_t> choked = 0;
+		std::atomic<uint64_t> keepalives = 0;
+		std::atomic<uint64_t> reliable_retransmits = 0;
+		std::atomic<uint64_t> reliable_probes = 0; // packets sent early to learn the fate of a reliable one
+		std::atomic<uint64_t> fragments_received = 0;
+		std::atomic<uint64_t> fragments_sent = 0;
+
+	private:
+		std::atomic<uint64_t> mIncomingPackets = 0;
+		std::atomic<uint64_t> mIncomingBytes = 0;
+		std::atomic<uint64_t> mOutgoingPackets = 0;
+		std::atomic<uint64_t> mOutgoingBytes = 0;
+
+		std::atomic<float> mIncomingPacketsPerSecond = 0.0f;
+		std::atomic<float> mIncomingBytesPerSecond = 0.0f;
+		std::atomic<float> mOutgoingPacketsPerSecond = 0.0f;
+		std::atomic<float> mOutgoingBytesPerSecond = 0.0f;
+
+		// values at last rates update, touched only by the channel
+		uint64_t mPrevIncomingPackets = 0;
+		uint64_t mPrevIncomingBytes = 0;
+		uint64_t mPrevOutgoingPackets = 0;
+		uint64_t mPrevOutgoingBytes = 0;
+
+		std::atomic<uint32_t> mRtt = 0;
+		std::atomic<uint32_t> mJitter = 0;
+		float mSmoothJitter = 0.0f;
+		bool mHasRtt = false;
+
+		std::atomic<uint32_t> mIncomingFragmentsCount = 0;
+		std::atomic<uint32_t> mIncomingFragmentsTotal = 0;
+		std::atomic<uint32_t> mOutgoingFragmentsCount = 0;
+		std::atomic<uint32_t> mOutgoingFragmentsTotal = 0;
+
+		Histogram<RttBounds.size()> mRttHistogram;
+		Histogram<JitterBounds.size()> mJitterHistogram;
+	};
+}
@@ -0,0 +1,198 @@
+#include "client_swarm.h"
+
+using namespace HL;
+
+ClientSwarm::ClientSwarm(ClientFactory factory, size_t threads) :
+	mFactory(factory)
+{
+	if (threads > 0 && !Networking::ExternalFramesSupported)
+	{
+		sky::Log(Console::Color::Red, "swarm: threads need batched udp socket, clients run on frame thread");
+		threads = 0;
+	}
+
+	for (size_t i = 0; i < threads; i++)
+	{
+		mShards.push_back(std::make_unique<WorkerPool>(1));
+	}
+}
+
+void ClientSwarm::onFrame()
+{
+	releaseHandshakes();
+
+	if (!mShards.empty())
+		runShards();
+
+	auto now = Clock::Now();
+
+	if (now - mStatsTime < Clock::FromSeconds(1.0f))
+		return;
+
+	updateStats();
+
+	STATS_INDICATE_GROUP("swarm", "clients", mStats.clients);
+	STATS_INDICATE_GROUP("swarm", "in game", mStats.game_started);
+	STATS_INDICATE_GROUP("swarm_traffic", "in kb/s", static_cast<int>(mStats.incoming_bytes_per_second / 1024.0f));
+	STATS_INDICATE_GROUP("swarm_traffic", "out kb/s", static_cast<int>(mStats.outgoing_bytes_per_second / 1024.0f));
+}
+
+void ClientSwarm::spawn(size_t count)
+{
+	mClients.reserve(mClients.size() + count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		BaseClient::NoConsoleScope no_console;
+
+		auto client = mFactory();
+
+		if (!mShards.empty())
+			client->setExternalFrames(true);
+
+		mClients.push_back(client);
+	}
+
+	sky::Log("swarm: {} clients spawned, total {}", count, mClients.size());
+}
+
+void ClientSwarm::connect(const Network::Address& address)
+{
+	mAddress = address;
+	mNextHandshake = 0;
+	mHandshakeTime = Clock::Now() - mHandshakeInterval;
+}
+
+void ClientSwarm::disconnect(const std::string& reason)
+{
+	mAddress.reset();
+
+	for (auto& client : mClients)
+	{
+		if (client->getState() == BaseClient::State::Disconnected)
+			continue;
+
+		client->disconnect(reason);
+	}
+}
+
+void ClientSwarm::releaseHandshakes()
+{
+	// every client re-sends its challenge request every 2 seconds, so starting
+	// all of them in the same frame makes the whole swarm hit the server in bursts
+
+	if (!mAddress.has_value())
+		return;
+
+	if (mNextHandshake >= mClients.size())
+		return;
+
+	auto now = Clock::Now();
+
+	if (now - mHandshakeTime < mHandshakeInterval)
+		return;
+
+	mHandshakeTime = now;
+
+	for (size_t i = 0; i < mHandshakesPerInterval && mNextHandshake < mClients.size(); i++)
+	{
+		auto& client = mClients[mNextHandshake++];
+
+		if (client->getState() != BaseClient::State::Disconnected)
+			continue;
+
+		client->connect(mAddress.value());
+	}
+}
+
+void ClientSwarm::runShards()
+{
+	auto count = mShards.size();
+
+	std::vector<std::future<void>> results;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		results.push_back(mShards[i]->post([this, i, count] {
+			for (size_t j = i; j < mClients.size(); j += count)
+			{
+				mClients[j]->frame();
+			}
+		}));
+	}
+
+	// no shard can still run when an error of another one is rethrown here
+
+	for (auto& result : results)
+		result.wait();
+
+	for (auto& result : results)
+		result.get();
+
+	for (auto& client : mClients)
+	{
+		client->executeStuffedCommands();
+	}
+}
+
+void ClientSwarm::updateStats()
+{
+	auto now = Clock::Now();
+	auto seconds = Clock::ToSeconds(now - mStatsTime);
+
+	Stats stats;
+	stats.clients = mClients.size();
+
+	if (mAddress.has_value())
+		stats.pending = mClients.size() - mNextHandshake;
+
+	for (const auto& client : mClients)
+	{
+		switch (client->getState())
+		{
+		case BaseClient::State::Challenging:
+			stats.challenging += 1;
+			break;
+
+		case BaseClient::State::Connecting:
+			stats.connecting += 1;
+			break;
+
+		case BaseClient::State::Connected:
+			stats.connected += 1;
+			break;
+
+		case BaseClient::State::GameStarted:
+			stats.game_started += 1;
+			break;
+
+		default:
+			break;
+		}
+
+		const auto& traffic = client->getTraffic();
+
+		stats.traffic.incoming_packets += traffic.incoming_packets;
+		stats.traffic.incoming_bytes += traffic.incoming_bytes;
+		stats.traffic.outgoing_packets += traffic.outgoing_packets;
+		stats.traffic.outgoing_bytes += traffic.outgoing_bytes;
+	}
+
+	// clients can be added between two updates, so counters are compared only when they grow
+
+	auto rate = [seconds](uint64_t value, uint64_t prev_value) {
+		if (value < prev_value || seconds <= 0.0f)
+			return 0.0f;
+
+		return static_cast<float>(value - prev_value) / seconds;
+	};
+
+	stats.incoming_packets_per_second = rate(stats.traffic.incoming_packets, mPrevTraffic.incoming_packets);
+	stats.incoming_bytes_per_second = rate(stats.traffic.incoming_bytes, mPrevTraffic.incoming_bytes);
+	stats.outgoing_packets_per_second = rate(stats.traffic.outgoing_packets, mPrevTraffic.outgoing_packets);
+	stats.outgoing_bytes_per_second = rate(stats.traffic.outgoing_bytes, mPrevTraffic.outgoing_bytes);
+
+	mPrevTraffic = stats.traffic;
+	mStats = stats;
+	mStatsTime = now;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "base_client.h"
+#include "worker_pool.h"
+
+namespace HL
+{
+	// many headless clients in one process with staggered handshakes.
+	// with threads clients are split into shards, each shard is run by own
+	// thread every frame while frame thread waits: sockets of its clients are
+	// polled, clients think and send there. needs batched socket
+	// (HL_BATCHED_UDP_SOCKET), without it all clients stay on frame thread.
+	// callbacks of clients (think, game messages) are called from shard threads.
+	// clients are not bound to global console commands, see NoConsoleScope
+
+	class ClientSwarm : public Common::FrameSystem::Frameable
+	{
+	public:
+		using ClientFactory = std::function<std::shared_ptr<BaseClient>()>;
+
+		struct Stats
+		{
+			size_t clients = 0;
+			size_t pending = 0; // waiting for their handshake slot
+			size_t challenging = 0;
+			size_t connecting = 0;
+			size_t connected = 0;
+			size_t game_started = 0;
+			Networking::Traffic traffic;
+			float incoming_packets_per_second = 0.0f;
+			float incoming_bytes_per_second = 0.0f;
+			float outgoing_packets_per_second = 0.0f;
+			float outgoing_bytes_per_second = 0.0f;
+		};
+
+	public:
+		ClientSwarm(ClientFactory factory, size_t threads = 0);
+
+	private:
+		void onFrame() override;
+
+	public:
+		void spawn(size_t count);
+		void connect(const Network::Address& address);
+		void disconnect(const std::string& reason);
+
+	private:
+		void releaseHandshakes();
+		void runShards();
+		void updateStats();
+
+	public:
+		const auto& getClients() const { return mClients; }
+		auto getThreadsCount() const { return mShards.size(); }
+		const auto& getStats() const { return mStats; }
+
+		auto getHandshakeInterval() const { return mHandshakeInterval; }
+		void setHandshakeInterval(Clock::Duration value) { mHandshakeInterval = value; }
+
+		auto getHandshakesPerInterval() const { return mHandshakesPerInterval; }
+		void setHandshakesPerInterval(size_t value) { mHandshakesPerInterval = value; }
+
+	private:
+		ClientFactory mFactory;
+		std::vector<std::shared_ptr<BaseClient>> mClients; // client i belongs to shard i % threads
+		std::vector<std::unique_ptr<WorkerPool>> mShards; // one thread each, so clients stay on same thread
+		std::optional<Network::Address> mAddress;
+		size_t mNextHandshake = 0;
+		Clock::Duration mHandshakeInterval = Clock::FromMilliseconds(50);
+		size_t mHandshakesPerInterval = 4;
+		Clock::TimePoint mHandshakeTime = Clock::Now();
+		Stats mStats;
+		Networking::Traffic mPrevTraffic;
+		Clock::TimePoint mStatsTime = Clock::Now();
+	};
+}
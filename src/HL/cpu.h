@@ -0,0 +1,86 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define HL_CPU_X86
+#endif
+
+#if defined(HL_CPU_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define HL_TARGET(x)
+	#else
+		#include <cpuid.h>
+		#define HL_TARGET(x) __attribute__((target(x)))
+	#endif
+	#include <immintrin.h>
+#endif
+
+namespace HL::Cpu
+{
+#if defined(HL_CPU_X86)
+	struct Features
+	{
+		bool sse2 = false;
+		bool pclmul = false;
+		bool avx2 = false;
+	};
+
+	inline Features DetectFeatures()
+	{
+		Features result;
+
+		auto cpuid = [](int leaf, int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+			__cpuidex((int*)regs, leaf, subleaf);
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		};
+
+		unsigned int regs[4] = { 0 };
+
+		cpuid(0, 0, regs);
+
+		auto max_leaf = regs[0];
+
+		if (max_leaf < 1)
+			return result;
+
+		cpuid(1, 0, regs);
+
+		result.sse2 = regs[3] & (1 << 26);
+		result.pclmul = regs[2] & (1 << 1);
+
+		bool osxsave = regs[2] & (1 << 27);
+		bool avx = regs[2] & (1 << 28);
+
+		if (max_leaf < 7 || !osxsave || !avx)
+			return result;
+
+		// os must save ymm registers on context switch
+
+#if defined(_MSC_VER)
+		auto xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0_lo, xcr0_hi;
+		__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		auto xcr0 = ((unsigned long long)xcr0_hi << 32) | xcr0_lo;
+#endif
+
+		if ((xcr0 & 6) != 6)
+			return result;
+
+		cpuid(7, 0, regs);
+
+		result.avx2 = regs[1] & (1 << 5);
+
+		return result;
+	}
+
+	inline const Features& GetFeatures()
+	{
+		static const Features features = DetectFeatures();
+		return features;
+	}
+#endif
+}
@@ -1,6 +1,7 @@
 #include "delta.h"
 
 #include <Common/buffer_helpers.h>
+#include <bit>
 #include <cassert>
 #include <stdexcept>
 
@@ -8,22 +9,167 @@ using namespace HL;
 
 namespace
 {
-	template <class T, class U>
-	bool ReadResultValue(const Delta::ReadFields& fields, const std::string& name, U& value) {
-		if (fields.count(name) == 0)
-			return false;
+	template <class T, class V>
+	void Assign(T& dst, V&& value)
+	{
+		using U = std::remove_cvref_t<V>;
+
+		if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<U>)
+			dst = static_cast<T>(value);
+		else if constexpr (std::is_same_v<T, std::string> && std::is_same_v<U, std::string>)
+			dst = std::move(value);
+		else
+			throw std::runtime_error("delta field type mismatch");
+	}
+
+#define BIND2(S, X, Y, G) { #X, { \
+	[](void* dst, int64_t value) { Assign(static_cast<S*>(dst)->Y, value); }, \
+	[](void* dst, float value) { Assign(static_cast<S*>(dst)->Y, value); }, \
+	[](void* dst, std::string&& value) { Assign(static_cast<S*>(dst)->Y, std::move(value)); }, \
+	G } }
+
+#define BIND(S, X, G) BIND2(S, X, X, G)
+
+	const Delta::Bindings FieldBindings = {
+		BIND2(Delta::Field, fieldType, type, 0),
+		BIND2(Delta::Field, fieldName, name, 0),
+		BIND2(Delta::Field, fieldOffset, offset, 0),
+		BIND2(Delta::Field, fieldSize, size, 0),
+		BIND2(Delta::Field, significant_bits, bits, 0),
+		BIND2(Delta::Field, premultiply, scale, 0),
+		BIND2(Delta::Field, postmultiply, pscale, 0),
+	};
+
+#define C(X, G) BIND(Protocol::ClientData, X, Protocol::CLIENTDATA_FIELD_##G)
+
+	const Delta::Bindings ClientDataBindings = {
+		C(origin[0], ORIGIN), C(origin[1], ORIGIN), C(origin[2], ORIGIN),
+		C(velocity[0], VELOCITY), C(velocity[1], VELOCITY), C(velocity[2], VELOCITY),
+		C(viewmodel, VIEW),
+		C(punchangle[0], VIEW), C(punchangle[1], VIEW), C(punchangle[2], VIEW),
+		C(flags, MOVEMENT), C(waterlevel, MOVEMENT), C(watertype, MOVEMENT),
+		C(view_ofs[0], VIEW), C(view_ofs[1], VIEW), C(view_ofs[2], VIEW),
+		C(health, HEALTH),
+		C(bInDuck, MOVEMENT), C(weapons, WEAPONS),
+		C(flTimeStepSound, MOVEMENT), C(flDuckTime, MOVEMENT), C(flSwimTime, MOVEMENT), C(waterjumptime, MOVEMENT),
+		C(maxspeed, MOVEMENT), C(fov, VIEW),
+		C(weaponanim, VIEW),
+		C(m_iId, WEAPONS), C(ammo_shells, WEAPONS), C(ammo_nails, WEAPONS), C(ammo_cells, WEAPONS), C(ammo_rockets, WEAPONS), C(m_flNextAttack, WEAPONS),
+		C(tfstate, MOVEMENT),
+		C(pushmsec, MOVEMENT),
+		C(deadflag, HEALTH),
+		C(physinfo, MOVEMENT),
+		C(iuser1, USER), C(iuser2, USER), C(iuser3, USER), C(iuser4, USER),
+		C(fuser1, USER), C(fuser2, USER), C(fuser3, USER), C(fuser4, USER),
+		C(vuser1[0], USER), C(vuser1[1], USER), C(vuser1[2], USER),
+		C(vuser2[0], USER), C(vuser2[1], USER), C(vuser2[2], USER),
+		C(vuser3[0], USER), C(vuser3[1], USER), C(vuser3[2], USER),
+		C(vuser4[0], USER), C(vuser4[1], USER), C(vuser4[2], USER),
+	};
+
+#undef C
+#define W(X, G) BIND(Protocol::WeaponData, X, Protocol::WEAPONDATA_FIELD_##G)
 
-		value = static_cast<U>(std::get<T>(fields.at(name)));
-		return true;
+	const Delta::Bindings WeaponDataBindings = {
+		W(m_iId, CLIP), W(m_iClip, CLIP),
+		W(m_flNextPrimaryAttack, TIMERS), W(m_flNextSecondaryAttack, TIMERS), W(m_flTimeWeaponIdle, TIMERS),
+		W(m_fInReload, STATE), W(m_fInSpecialReload, STATE), W(m_flNextReload, TIMERS), W(m_flPumpTime, TIMERS), W(m_fReloadTime, TIMERS),
+		W(m_fAimedDamage, STATE), W(m_fNextAimBonus, TIMERS), W(m_fInZoom, STATE), W(m_iWeaponState, STATE),
+		W(iuser1, USER), W(iuser2, USER), W(iuser3, USER), W(iuser4, USER),
+		W(fuser1, USER), W(fuser2, USER), W(fuser3, USER), W(fuser4, USER),
 	};
+
+#undef W
+#define E(X) BIND(Protocol::EventArgs, X, 0)
+
+	const Delta::Bindings EventBindings = {
+		E(entindex),
+		E(origin[0]), E(origin[1]), E(origin[2]),
+		E(angles[0]), E(angles[1]), E(angles[2]),
+		E(ducking),
+		E(fparam1), E(fparam2),
+		E(iparam1), E(iparam2),
+		E(bparam1), E(bparam2),
+	};
+
+#undef E
+#define E(X, G) BIND(Protocol::Entity, X, Protocol::ENTITY_FIELD_##G)
+
+	const Delta::Bindings EntityBindings = {
+		E(origin[0], ORIGIN), E(origin[1], ORIGIN), E(origin[2], ORIGIN),
+		E(angles[0], ANGLES), E(angles[1], ANGLES), E(angles[2], ANGLES),
+		E(modelindex, MODEL), E(sequence, ANIMATION), E(frame, ANIMATION), E(colormap, MODEL), E(skin, MODEL), E(solid, BBOX), E(effects, RENDER), E(scale, MODEL),
+		E(eflags, RENDER),
+		E(rendermode, RENDER), E(renderamt, RENDER), E(rendercolor.r, RENDER), E(rendercolor.g, RENDER), E(rendercolor.b, RENDER), E(renderfx, RENDER),
+		E(movetype, MOVEMENT), E(animtime, ANIMATION), E(framerate, ANIMATION), E(body, MODEL),
+		E(controller[0], ANIMATION), E(controller[1], ANIMATION), E(controller[2], ANIMATION), E(controller[3], ANIMATION),
+		E(blending[0], ANIMATION), E(blending[1], ANIMATION),
+		E(velocity[0], VELOCITY), E(velocity[1], VELOCITY), E(velocity[2], VELOCITY),
+		E(mins[0], BBOX), E(mins[1], BBOX), E(mins[2], BBOX),
+		E(maxs[0], BBOX), E(maxs[1], BBOX), E(maxs[2], BBOX),
+		E(aiment, MOVEMENT),
+		E(owner, MOVEMENT),
+		E(friction, MOVEMENT), E(gravity, MOVEMENT),
+		E(team, PLAYER), E(playerclass, PLAYER), E(health, PLAYER), E(spectator, PLAYER), E(weaponmodel, WEAPON), E(gaitsequence, ANIMATION),
+		E(basevelocity[0], VELOCITY), E(basevelocity[1], VELOCITY), E(basevelocity[2], VELOCITY),
+		E(usehull, BBOX), E(oldbuttons, MOVEMENT), E(onground, MOVEMENT), E(iStepLeft, MOVEMENT), E(flFallVelocity, MOVEMENT),
+		// TODO: where is fov ?
+		E(weaponanim, WEAPON),
+		E(startpos[0], PARAMETRIC), E(startpos[1], PARAMETRIC), E(startpos[2], PARAMETRIC),
+		E(endpos[0], PARAMETRIC), E(endpos[1], PARAMETRIC), E(endpos[2], PARAMETRIC),
+		E(impacttime, PARAMETRIC), E(starttime, PARAMETRIC),
+		E(iuser1, USER), E(iuser2, USER), E(iuser3, USER), E(iuser4, USER),
+		E(fuser1, USER), E(fuser2, USER), E(fuser3, USER), E(fuser4, USER),
+		E(vuser1[0], USER), E(vuser1[1], USER), E(vuser1[2], USER),
+		E(vuser2[0], USER), E(vuser2[1], USER), E(vuser2[2], USER),
+		E(vuser3[0], USER), E(vuser3[1], USER), E(vuser3[2], USER),
+		E(vuser4[0], USER), E(vuser4[1], USER), E(vuser4[2], USER),
+	};
+
+#undef E
+#undef BIND
+#undef BIND2
+
+#define GET(S, X) { #X, { \
+	[](const void* src) { return static_cast<int64_t>(static_cast<const S*>(src)->X); }, \
+	[](const void* src) { return static_cast<float>(static_cast<const S*>(src)->X); } } }
+
+#define U(X) GET(Protocol::UserCmd, X)
+
+	const Delta::GetterBindings UserCmdBindings = {
+		U(lerp_msec), U(msec),
+		U(viewangles[0]), U(viewangles[1]), U(viewangles[2]),
+		U(forwardmove), U(sidemove), U(upmove),
+		U(lightlevel), U(buttons), U(impulse), U(weaponselect),
+		U(impact_index),
+		U(impact_position[0]), U(impact_position[1]), U(impact_position[2]),
+	};
+
+#undef U
+#undef GET
+
+	const Delta::Plan& GetPlan(const std::optional<Delta::Plan>& plan, const std::string& name)
+	{
+		if (!plan.has_value())
+			throw std::runtime_error("delta table \"" + name + "\" is not received");
+
+		return plan.value();
+	}
 }
 
 void Delta::clear()
 {
 	mTables.clear();
+	mClientDataPlan.reset();
+	mWeaponDataPlan.reset();
+	mEventPlan.reset();
+	mEntityNormalPlan.reset();
+	mEntityPlayerPlan.reset();
+	mEntityCustomPlan.reset();
+	mUserCmdPlan.reset();
 }
 
-void Delta::add(sky::BitBuffer& msg, const std::string& name, uint32_t fieldCount)
+void Delta::add(BitReader& msg, const std::string& name, uint32_t fieldCount)
 {
 	Table table;
 
@@ -37,164 +183,267 @@ void Delta::add(sky::BitBuffer& msg, const std::string& name, uint32_t fieldCoun
 		table.push_back(field);
 	}
 
-	mTables.insert({ name, table });
+	// tables come once per connection, bind them to our structs right now
+
+	if (name == S_DELTA_CLIENTDATA)
+		mClientDataPlan = compile(table, ClientDataBindings);
+	else if (name == S_DELTA_WEAPON_DATA)
+		mWeaponDataPlan = compile(table, WeaponDataBindings);
+	else if (name == S_DELTA_EVENT)
+		mEventPlan = compile(table, EventBindings);
+	else if (name == S_DELTA_ENTITY_STATE)
+		mEntityNormalPlan = compile(table, EntityBindings);
+	else if (name == S_DELTA_ENTITY_STATE_PLAYER)
+		mEntityPlayerPlan = compile(table, EntityBindings);
+	else if (name == S_DELTA_CUSTOM_ENTITY_STATE)
+		mEntityCustomPlan = compile(table, EntityBindings);
+	else if (name == S_DELTA_USERCMD)
+		mUserCmdPlan = compile(table, UserCmdBindings);
+
+	mTables.insert_or_assign(name, table);
 }
 
-Delta::ReadFields Delta::read(sky::BitBuffer& msg, const Table& table)
+Delta::Plan Delta::compile(const Table& table, const Bindings& bindings)
 {
+	if (table.size() > 64)
+		throw std::runtime_error("delta table is too large: " + std::to_string(table.size()));
+
+	Plan plan;
+	plan.reserve(table.size());
+
+	for (const auto& field : table)
+	{
+		Instruction instruction;
+		instruction.type = field.type & ~DT_SIGNED;
+		instruction.sign = field.type & DT_SIGNED;
+		instruction.bits = field.bits;
+		instruction.scale = field.scale;
+		instruction.pscale = field.pscale;
+
+		if (bindings.contains(field.name))
+			instruction.setter = bindings.at(field.name);
+
+		plan.push_back(instruction);
+	}
+
+	return plan;
+}
+
+uint32_t Delta::execute(BitReader& msg, const Plan& plan, void* dst)
+{
+	uint32_t changed = 0;
 	uint64_t marks = 0;
 	uint32_t count = msg.readBits(3);
 
 	msg.read(&marks, count);
 
-	ReadFields result;
+	// only fields that are marked, lowest first, unbound ones are read and dropped
 
-	for (int i = 0; i < table.size(); i++)
+	while (marks != 0)
 	{
-		if (!(marks & (1ULL << i)))
-			continue;
+		auto i = static_cast<size_t>(std::countr_zero(marks));
+		marks &= marks - 1;
 
-		const auto& field = table.at(i);
+		if (i >= plan.size())
+			break;
 
-		bool sign = field.type & DT_SIGNED;
-		int type = field.type & ~DT_SIGNED;
+		const auto& instruction = plan[i];
+		const auto& setter = instruction.setter;
 
-		VariantField resultField;
+		changed |= setter.field;
 
-		switch (type)
+		switch (instruction.type)
 		{
 		case DT_BYTE:
 		case DT_SHORT:
 		case DT_INTEGER:
 		{
-			if (sign)
-				resultField = static_cast<int64_t>(sky::bitbuffer_helpers::ReadSBits(msg, field.bits));
+			assert(instruction.scale == 1.0f);
+			assert(instruction.pscale == 1.0f);
+
+			int64_t value;
+
+			if (instruction.sign)
+				value = static_cast<int64_t>(msg.readSBits(instruction.bits));
 			else
-				resultField = static_cast<int64_t>(msg.readBits(field.bits));
+				value = static_cast<int64_t>(msg.readBits(instruction.bits));
+
+			if (setter.setInt)
+				setter.setInt(dst, value);
 
-			assert(field.scale == 1.0f);
-			assert(field.pscale == 1.0f);
+			break;
 		}
+		case DT_TIMEWINDOW_8:
+		{
+			auto value = static_cast<float>(msg.readSBits(8));
 
-		break;
+			if (setter.setFloat)
+				setter.setFloat(dst, value);
 
-		case DT_TIMEWINDOW_8:
-			resultField = static_cast<float>(sky::bitbuffer_helpers::ReadSBits(msg, 8));
 			break;
-
+		}
 		case DT_TIMEWINDOW_BIG:
 		case DT_FLOAT:
 		{
 			float value = 0.0f;
 
-			if (sign)
-				value = (float)sky::bitbuffer_helpers::ReadSBits(msg, field.bits);
+			if (instruction.sign)
+				value = (float)msg.readSBits(instruction.bits);
 			else
-				value = (float)msg.readBits(field.bits);
+				value = (float)msg.readBits(instruction.bits);
+
+			value /= instruction.scale;
+			value *= instruction.pscale;
 
-			value /= field.scale;
-			value *= field.pscale;
+			if (setter.setFloat)
+				setter.setFloat(dst, value);
 
-			resultField = value;
 			break;
 		}
 		case DT_ANGLE:
-			resultField = sky::bitbuffer_helpers::ReadBitAngle(msg, field.bits);
-			break;
+		{
+			auto value = msg.readBitAngle(instruction.bits);
+
+			if (setter.setFloat)
+				setter.setFloat(dst, value);
 
-		case DT_STRING:
-			resultField = sky::bitbuffer_helpers::ReadString(msg);
 			break;
+		}
+		case DT_STRING:
+		{
+			auto value = msg.readString();
+
+			if (setter.setString)
+				setter.setString(dst, std::move(value));
 
+			break;
+		}
 		default:
-			throw std::runtime_error(("unknown delta field: " + std::to_string(type)).c_str());
+			throw std::runtime_error(("unknown delta field: " + std::to_string(instruction.type)).c_str());
 			break;
 		}
+	}
+
+	return changed;
+}
+
+Delta::WritePlan Delta::compile(const Table& table, const GetterBindings& bindings)
+{
+	if (table.size() > 64)
+		throw std::runtime_error("delta table is too large: " + std::to_string(table.size()));
+
+	WritePlan plan;
+	plan.reserve(table.size());
+
+	for (const auto& field : table)
+	{
+		WriteInstruction instruction;
+		instruction.type = field.type & ~DT_SIGNED;
+		instruction.sign = field.type & DT_SIGNED;
+		instruction.bits = field.bits;
+		instruction.scale = field.scale;
+		instruction.pscale = field.pscale;
+
+		if (bindings.contains(field.name))
+			instruction.getter = bindings.at(field.name);
 
-		result.insert({ field.name, resultField });
+		plan.push_back(instruction);
 	}
 
-	return result;
+	return plan;
 }
 
-void Delta::write(sky::BitBuffer& msg, const Table& table, const WriteFields& fields)
+void Delta::execute(sky::BitBuffer& msg, const WritePlan& plan, const void* src, const void* prev)
 {
-	uint64_t marks = 0;
+	auto isFloat = [](int type) {
+		return type == DT_TIMEWINDOW_8 || type == DT_TIMEWINDOW_BIG || type == DT_FLOAT || type == DT_ANGLE;
+	};
 
-	int lastMark = -1;
+	uint64_t marks = 0;
 
-	for (const auto& [index, field] : fields)
+	for (size_t i = 0; i < plan.size(); i++)
 	{
-		marks |= 1ULL << index;
-		lastMark = index;
+		const auto& instruction = plan[i];
+		const auto& getter = instruction.getter;
+
+		if (!getter.getInt)
+			continue;
+
+		bool changed = isFloat(instruction.type) ?
+			getter.getFloat(src) != getter.getFloat(prev) :
+			getter.getInt(src) != getter.getInt(prev);
+
+		if (changed)
+			marks |= 1ULL << i;
 	}
 
 	uint32_t count = 0;
 
-	if (lastMark != -1)
-		count = (lastMark >> 3) + 1;
+	if (marks != 0)
+		count = ((63 - std::countl_zero(marks)) >> 3) + 1;
 
 	msg.writeBits(count, 3);
 	msg.write(&marks, count);
 
-	for (const auto& [index, field] : fields)
+	while (marks != 0)
 	{
-		const auto& normal = table.at(index);
+		auto i = static_cast<size_t>(std::countr_zero(marks));
+		marks &= marks - 1;
 
-		bool sign = normal.type & DT_SIGNED;
-		int type = normal.type & ~DT_SIGNED;
+		const auto& instruction = plan[i];
+		const auto& getter = instruction.getter;
 
-		switch (type)
+		switch (instruction.type)
 		{
 		case DT_BYTE:
 		case DT_SHORT:
 		case DT_INTEGER:
 		{
-			assert(normal.scale == 1.0f);
-			assert(normal.pscale == 1.0f);
+			assert(instruction.scale == 1.0f);
+			assert(instruction.pscale == 1.0f);
+
+			auto value = getter.getInt(src);
 
-			if (sign)
-				sky::bitbuffer_helpers::WriteSBits(msg, static_cast<int32_t>(std::get<int64_t>(field)), normal.bits);
+			if (instruction.sign)
+				sky::bitbuffer_helpers::WriteSBits(msg, static_cast<int32_t>(value), instruction.bits);
 			else
-				msg.writeBits(static_cast<uint32_t>(std::get<int64_t>(field)), normal.bits);
-		}
-		break;
+				msg.writeBits(static_cast<uint32_t>(value), instruction.bits);
 
+			break;
+		}
 		case DT_TIMEWINDOW_8:
-			sky::bitbuffer_helpers::WriteSBits(msg, (int)std::get<float>(field), 8); // TODO: time fix
+			sky::bitbuffer_helpers::WriteSBits(msg, (int)getter.getFloat(src), 8); // TODO: time fix
 			break;
 
 		case DT_TIMEWINDOW_BIG:
 		case DT_FLOAT:
 		{
-			float value = std::get<float>(field);
+			// inverse of decoding
+
+			float value = getter.getFloat(src);
 
-			value /= normal.scale;
-			value *= normal.pscale;
+			value /= instruction.pscale;
+			value *= instruction.scale;
 
-			if (sign)
-				sky::bitbuffer_helpers::WriteSBits(msg, (int32_t)value, normal.bits);
+			if (instruction.sign)
+				sky::bitbuffer_helpers::WriteSBits(msg, (int32_t)value, instruction.bits);
 			else
-				msg.writeBits((uint32_t)value, normal.bits);
-		}
-		break;
+				msg.writeBits((uint32_t)value, instruction.bits);
 
-		case DT_ANGLE:
-			sky::bitbuffer_helpers::WriteBitAngle(msg, std::get<float>(field), normal.bits);
 			break;
-
-		case DT_STRING:
-			sky::bitbuffer_helpers::WriteString(msg, std::get<std::string>(field));
+		}
+		case DT_ANGLE:
+			sky::bitbuffer_helpers::WriteBitAngle(msg, getter.getFloat(src), instruction.bits);
 			break;
 
 		default:
-			throw std::runtime_error(("unknown delta field: " + std::to_string(type)).c_str());
+			throw std::runtime_error(("unsupported delta field: " + std::to_string(instruction.type)).c_str());
 			break;
 		}
 	}
 }
 
-void Delta::read(sky::BitBuffer& msg, Field& field)
+void Delta::read(BitReader& msg, Field& field)
 {
 	static const Delta::Table MetaTable = {
 		{ "fieldType", DT_INTEGER, 32, 1.0f, 1.0f },
@@ -206,411 +455,45 @@ void Delta::read(sky::BitBuffer& msg, Field& field)
 		{ "postmultiply", DT_FLOAT, 32, 4000.0f, 1.0f }
 	};
 
-	auto result = read(msg, MetaTable);
-
-#define READ_INT(X, Y) ReadResultValue<int64_t>(result, #X, field.Y)
-#define READ_FLOAT(X, Y) ReadResultValue<float>(result, #X, field.Y)
-#define READ_STR(X, Y) ReadResultValue<std::string>(result, #X, field.Y)
+	static const Plan MetaPlan = compile(MetaTable, FieldBindings);
 
-	READ_INT(fieldType, type);
-	READ_STR(fieldName, name);
-	READ_INT(fieldOffset, offset);
-	READ_INT(fieldSize, size);
-	READ_INT(significant_bits, bits);
-	READ_FLOAT(premultiply, scale);
-	READ_FLOAT(postmultiply, pscale);
-
-#undef READ_INT
-#undef READ_FLOAT
-#undef READ_STR
+	execute(msg, MetaPlan, &field);
 }
 
-void Delta::readClientData(sky::BitBuffer& msg, Protocol::ClientData& clientData)
+void Delta::readClientData(BitReader& msg, Protocol::ClientData& clientData)
 {
-	auto result = read(msg, mTables.at("clientdata_t"));
-
-#define READ_INT2(X, Y) ReadResultValue<int64_t>(result, #X, clientData.Y)
-#define READ_FLOAT2(X, Y) ReadResultValue<float>(result, #X, clientData.Y)
-#define READ_STR2(X, Y) ReadResultValue<std::string>(result, #X, clientData.Y)
-
-#define READ_INT(X) READ_INT2(X, X)
-#define READ_FLOAT(X) READ_FLOAT2(X, X)
-#define READ_STR(X) READ_STR2(X, X)
-
-	READ_FLOAT(origin[0]);
-	READ_FLOAT(origin[1]);
-	READ_FLOAT(origin[2]);
-
-	READ_FLOAT(velocity[0]);
-	READ_FLOAT(velocity[1]);
-	READ_FLOAT(velocity[2]);
-
-	READ_INT(viewmodel);
-
-	READ_FLOAT(punchangle[0]);
-	READ_FLOAT(punchangle[1]);
-	READ_FLOAT(punchangle[2]);
-
-	READ_INT(flags);
-	READ_INT(waterlevel);
-	READ_INT(watertype);
-
-	READ_FLOAT(view_ofs[0]);
-	READ_FLOAT(view_ofs[1]);
-	READ_FLOAT(view_ofs[2]);
-
-	READ_FLOAT(health);
-
-	READ_INT(bInDuck);
-	READ_INT(weapons);
-
-	READ_INT(flTimeStepSound);
-	READ_INT(flDuckTime);
-	READ_INT(flSwimTime);
-	READ_INT(waterjumptime);
-
-	READ_FLOAT(maxspeed);
-	READ_FLOAT(fov);
-
-	READ_INT(weaponanim);
-
-	READ_INT(m_iId);
-	READ_INT(ammo_shells);
-	READ_INT(ammo_nails);
-	READ_INT(ammo_cells);
-	READ_INT(ammo_rockets);
-	READ_FLOAT(m_flNextAttack);
-
-	READ_INT(tfstate);
-
-	READ_INT(pushmsec);
-
-	READ_INT(deadflag);
-
-	READ_STR(physinfo);
-
-	READ_INT(iuser1);
-	READ_INT(iuser2);
-	READ_INT(iuser3);
-	READ_INT(iuser4);
-
-	READ_FLOAT(fuser1);
-	READ_FLOAT(fuser2);
-	READ_FLOAT(fuser3);
-	READ_FLOAT(fuser4);
-
-	READ_FLOAT(vuser1[0]);
-	READ_FLOAT(vuser1[1]);
-	READ_FLOAT(vuser1[2]);
-
-	READ_FLOAT(vuser2[0]);
-	READ_FLOAT(vuser2[1]);
-	READ_FLOAT(vuser2[2]);
-
-	READ_FLOAT(vuser3[0]);
-	READ_FLOAT(vuser3[1]);
-	READ_FLOAT(vuser3[2]);
-
-	READ_FLOAT(vuser4[0]);
-	READ_FLOAT(vuser4[1]);
-	READ_FLOAT(vuser4[2]);
-
-#undef READ_INT2
-#undef READ_FLOAT2
-#undef READ_STR2
-
-#undef READ_INT
-#undef READ_FLOAT
-#undef READ_STR
+	clientData.changed_fields = execute(msg, GetPlan(mClientDataPlan, S_DELTA_CLIENTDATA), &clientData);
 }
 
-void Delta::readWeaponData(sky::BitBuffer& msg, Protocol::WeaponData& weaponData)
+void Delta::readWeaponData(BitReader& msg, Protocol::WeaponData& weaponData)
 {
-	auto result = read(msg, mTables.at("weapon_data_t"));
-
-#define READ_INT2(X, Y) ReadResultValue<int64_t>(result, #X, weaponData.Y)
-#define READ_FLOAT2(X, Y) ReadResultValue<float>(result, #X, weaponData.Y)
-#define READ_STR2(X, Y) ReadResultValue<std::string>(result, #X, weaponData.Y)
-
-#define READ_INT(X) READ_INT2(X, X)
-#define READ_FLOAT(X) READ_FLOAT2(X, X)
-#define READ_STR(X) READ_STR2(X, X)
-
-	READ_INT(m_iId);
-	READ_INT(m_iClip);
-
-	READ_FLOAT(m_flNextPrimaryAttack);
-	READ_FLOAT(m_flNextSecondaryAttack);
-	READ_FLOAT(m_flTimeWeaponIdle);
-
-	READ_INT(m_fInReload);
-	READ_INT(m_fInSpecialReload);
-	READ_FLOAT(m_flNextReload);
-	READ_FLOAT(m_flPumpTime);
-	READ_FLOAT(m_fReloadTime);
-
-	READ_FLOAT(m_fAimedDamage);
-	READ_FLOAT(m_fNextAimBonus);
-	READ_INT(m_fInZoom);
-	READ_INT(m_iWeaponState);
-
-	READ_INT(iuser1);
-	READ_INT(iuser2);
-	READ_INT(iuser3);
-	READ_INT(iuser4);
-
-	READ_FLOAT(fuser1);
-	READ_FLOAT(fuser2);
-	READ_FLOAT(fuser3);
-	READ_FLOAT(fuser4);
-
-#undef READ_INT2
-#undef READ_FLOAT2
-#undef READ_STR2
-
-#undef READ_INT
-#undef READ_FLOAT
-#undef READ_STR
+	weaponData.changed_fields = execute(msg, GetPlan(mWeaponDataPlan, S_DELTA_WEAPON_DATA), &weaponData);
 }
 
-void Delta::readEvent(sky::BitBuffer& msg, Protocol::EventArgs& evt)
+void Delta::readEvent(BitReader& msg, Protocol::EventArgs& evt)
 {
-	auto result = read(msg, mTables.at("event_t"));
-
-#define READ_INT2(X, Y) ReadResultValue<int64_t>(result, #X, evt.Y)
-#define READ_FLOAT2(X, Y) ReadResultValue<float>(result, #X, evt.Y)
-#define READ_STR2(X, Y) ReadResultValue<std::string>(result, #X, evt.Y)
-
-#define READ_INT(X) READ_INT2(X, X)
-#define READ_FLOAT(X) READ_FLOAT2(X, X)
-#define READ_STR(X) READ_STR2(X, X)
-
-	READ_INT(entindex);
-	READ_FLOAT(origin[0]);
-	READ_FLOAT(origin[1]);
-	READ_FLOAT(origin[2]);
-	READ_FLOAT(angles[0]);
-	READ_FLOAT(angles[1]);
-	READ_FLOAT(angles[2]);
-	READ_INT(ducking);
-	READ_FLOAT(fparam1);
-	READ_FLOAT(fparam2);
-	READ_INT(iparam1);
-	READ_INT(iparam2);
-	READ_INT(bparam1);
-	READ_INT(bparam2);
-
-#undef READ_INT2
-#undef READ_FLOAT2
-#undef READ_STR2
-
-#undef READ_INT
-#undef READ_FLOAT
-#undef READ_STR
+	execute(msg, GetPlan(mEventPlan, S_DELTA_EVENT), &evt);
 }
 
-void Delta::readEntityNormal(sky::BitBuffer& msg, Protocol::Entity& entity)
+void Delta::readEntityNormal(BitReader& msg, Protocol::Entity& entity)
 {
-	read(msg, entity, "entity_state_t");
+	entity.changed_fields = execute(msg, GetPlan(mEntityNormalPlan, S_DELTA_ENTITY_STATE), &entity);
 }
 
-void Delta::readEntityPlayer(sky::BitBuffer& msg, Protocol::Entity& entity)
+void Delta::readEntityPlayer(BitReader& msg, Protocol::Entity& entity)
 {
-	read(msg, entity, "entity_state_player_t");
+	entity.changed_fields = execute(msg, GetPlan(mEntityPlayerPlan, S_DELTA_ENTITY_STATE_PLAYER), &entity);
 }
 
-void Delta::readEntityCustom(sky::BitBuffer& msg, Protocol::Entity& entity)
+void Delta::readEntityCustom(BitReader& msg, Protocol::Entity& entity)
 {
-	read(msg, entity, "custom_entity_state_t");
+	entity.changed_fields = execute(msg, GetPlan(mEntityCustomPlan, S_DELTA_CUSTOM_ENTITY_STATE), &entity);
 }
 
-void Delta::read(sky::BitBuffer& msg, Protocol::Entity& entity, const std::string& table)
-{
-	auto result = read(msg, mTables.at(table));
-
-#define READ_INT2(X, Y) ReadResultValue<int64_t>(result, #X, entity.Y)
-#define READ_FLOAT2(X, Y) ReadResultValue<float>(result, #X, entity.Y)
-#define READ_STR2(X, Y) ReadResultValue<std::string>(result, #X, entity.Y)
-
-#define READ_INT(X) READ_INT2(X, X)
-#define READ_FLOAT(X) READ_FLOAT2(X, X)
-#define READ_STR(X) READ_STR2(X, X)
-
-	READ_FLOAT(origin[0]);
-	READ_FLOAT(origin[1]);
-	READ_FLOAT(origin[2]);
-
-	READ_FLOAT(angles[0]);
-	READ_FLOAT(angles[1]);
-	READ_FLOAT(angles[2]);
-
-	READ_INT(modelindex);
-	READ_INT(sequence);
-	READ_FLOAT(frame);
-	READ_INT(colormap);
-	READ_INT(skin);
-	READ_INT(solid);
-	READ_INT(effects);
-	READ_FLOAT(scale);
-
-	READ_INT(eflags);
-
-	READ_INT(rendermode);
-	READ_INT(renderamt);
-	READ_INT(rendercolor.r);
-	READ_INT(rendercolor.g);
-	READ_INT(rendercolor.b);
-	READ_INT(renderfx);
-
-	READ_INT(movetype);
-	READ_FLOAT(animtime);
-	READ_FLOAT(framerate);
-	READ_INT(body);
-
-	READ_INT(controller[0]);
-	READ_INT(controller[1]);
-	READ_INT(controller[2]);
-	READ_INT(controller[3]);
-
-	READ_INT(blending[0]);
-	READ_INT(blending[1]);
-
-	READ_FLOAT(velocity[0]);
-	READ_FLOAT(velocity[1]);
-	READ_FLOAT(velocity[2]);
-
-	READ_FLOAT(mins[0]);
-	READ_FLOAT(mins[1]);
-	READ_FLOAT(mins[2]);
-
-	READ_FLOAT(maxs[0]);
-	READ_FLOAT(maxs[1]);
-	READ_FLOAT(maxs[2]);
-
-	READ_INT(aiment);
-
-	READ_INT(owner);
-
-	READ_FLOAT(friction);
-	READ_FLOAT(gravity);
-
-	READ_INT(team);
-	READ_INT(playerclass);
-	READ_INT(health);
-	READ_INT(spectator);
-	READ_INT(weaponmodel);
-	READ_INT(gaitsequence);
-
-	READ_FLOAT(basevelocity[0]);
-	READ_FLOAT(basevelocity[1]);
-	READ_FLOAT(basevelocity[2]);
-
-	READ_INT(usehull);
-	READ_INT(oldbuttons);
-	READ_INT(onground);
-	READ_INT(iStepLeft);
-	READ_FLOAT(flFallVelocity);
-
-	// TODO: where is fov ?
-
-	READ_INT(weaponanim);
-
-	READ_FLOAT(startpos[0]);
-	READ_FLOAT(startpos[1]);
-	READ_FLOAT(startpos[2]);
-
-	READ_FLOAT(endpos[0]);
-	READ_FLOAT(endpos[1]);
-	READ_FLOAT(endpos[2]);
-
-	READ_FLOAT(impacttime);
-	READ_FLOAT(starttime);
-
-	READ_INT(iuser1);
-	READ_INT(iuser2);
-	READ_INT(iuser3);
-	READ_INT(iuser4);
-
-	READ_FLOAT(fuser1);
-	READ_FLOAT(fuser2);
-	READ_FLOAT(fuser3);
-	READ_FLOAT(fuser4);
-
-	READ_FLOAT(vuser1[0]);
-	READ_FLOAT(vuser1[1]);
-	READ_FLOAT(vuser1[2]);
-
-	READ_FLOAT(vuser2[0]);
-	READ_FLOAT(vuser2[1]);
-	READ_FLOAT(vuser2[2]);
-
-	READ_FLOAT(vuser3[0]);
-	READ_FLOAT(vuser3[1]);
-	READ_FLOAT(vuser3[2]);
-
-	READ_FLOAT(vuser4[0]);
-	READ_FLOAT(vuser4[1]);
-	READ_FLOAT(vuser4[2]);
-
-#undef READ_INT2
-#undef READ_FLOAT2
-#undef READ_STR2
-
-#undef READ_INT
-#undef READ_FLOAT
-#undef READ_STR
-};
-
 void Delta::writeUserCmd(sky::BitBuffer& msg, const Protocol::UserCmd& newCmd, const Protocol::UserCmd& oldCmd)
 {
-#define S_TOTAL(X, Y, T, A) if (field.name == #X && newCmd.Y != oldCmd.Y) { assert(A); writeFields.insert({ i, (T)newCmd.Y }); }
-
-#define S_INT2(X, Y) S_TOTAL(X, Y, int64_t, type == DT_BYTE || type == DT_SHORT || type == DT_INTEGER)
-#define S_FLOAT2(X, Y) S_TOTAL(X, Y, float, type == DT_TIMEWINDOW_8 || type == DT_TIMEWINDOW_BIG || type == DT_FLOAT || type == DT_ANGLE)
-#define S_STR2(X, Y) S_TOTAL(X, Y, std::string, type == DT_STRING)
-
-#define S_INT(X) S_INT2(X, X)
-#define S_FLOAT(X) S_FLOAT2(X, X)
-#define S_STR(X) S_STR2(X, X)
-
-#define C_INT2(X, Y) else S_INT2(X, Y)
-#define C_FLOAT2(X, Y) else S_FLOAT2(X, Y)
-#define C_STR2(X, Y) else S_STR2(X, Y)
-
-#define C_INT(X) C_INT2(X, X)
-#define C_FLOAT(X) C_FLOAT2(X, X)
-#define C_STR(X) C_STR2(X, X)
-
-	auto table = mTables.at("usercmd_t");
-
-	WriteFields writeFields;
-
-	for (int i = 0; i < table.size(); i++)
-	{
-		const auto& field = table.at(i);
-		int type = field.type & ~DT_SIGNED;
-		S_INT(lerp_msec)
-		//C_INT(msec)
-		else if (field.name == "msec" && newCmd.msec != oldCmd.msec)
-		{
-			assert(type == DT_BYTE || type == DT_SHORT || type == DT_INTEGER);
-			writeFields.insert({ i, (int64_t)newCmd.msec });
-		}
-		C_FLOAT(viewangles[0])
-		C_FLOAT(viewangles[1])
-		C_FLOAT(viewangles[2])
-		C_FLOAT(forwardmove)
-		C_FLOAT(sidemove)
-		C_FLOAT(upmove)
-		C_INT(lightlevel)
-		C_INT(buttons)
-		C_INT(impulse)
-		C_INT(weaponselect)
-		C_INT(impact_index)
-		C_FLOAT(impact_position[0])
-		C_FLOAT(impact_position[1])
-		C_FLOAT(impact_position[2])
-	}
+	if (!mUserCmdPlan.has_value())
+		throw std::runtime_error("delta table \"" + S_DELTA_USERCMD + "\" is not received");
 
-	write(msg, table, writeFields);
+	execute(msg, mUserCmdPlan.value(), &newCmd, &oldCmd);
 }
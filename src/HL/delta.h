@@ -11,6 +11,7 @@
 
 #include <common/bitbuffer.h>
 #include "protocol.h"
+#include "bit_reader.h"
 
 static const int DT_BYTE = 1 << 0;
 static const int DT_SHORT = 1 << 1;
@@ -49,33 +50,87 @@ namespace HL
 
 		using Table = std::vector<Field>;
 
-		using VariantField = std::variant<int64_t, float, std::string>;
-		using ReadFields = std::unordered_map<std::string, VariantField>;
-		using WriteFields = std::map<int, VariantField>;
+		// table compiled against one of our structs, every field knows where
+		// its value goes, so decoding does not touch names or allocate
+
+		struct Setter
+		{
+			void(*setInt)(void* dst, int64_t value) = nullptr;
+			void(*setFloat)(void* dst, float value) = nullptr;
+			void(*setString)(void* dst, std::string&& value) = nullptr;
+			uint32_t field = 0; // group in changed_fields mask of struct
+		};
+
+		using Bindings = std::unordered_map<std::string, Setter>;
+
+		struct Instruction
+		{
+			int type; // without DT_SIGNED
+			bool sign;
+			int bits;
+			float scale;
+			float pscale;
+			Setter setter; // empty when struct has no such field
+		};
+
+		using Plan = std::vector<Instruction>;
+
+		// same for encoding, values are taken from the struct and compared
+		// with previous one to build the field mask
+
+		struct Getter
+		{
+			int64_t(*getInt)(const void* src) = nullptr;
+			float(*getFloat)(const void* src) = nullptr;
+		};
+
+		using GetterBindings = std::unordered_map<std::string, Getter>;
+
+		struct WriteInstruction
+		{
+			int type; // without DT_SIGNED
+			bool sign;
+			int bits;
+			float scale;
+			float pscale;
+			Getter getter; // empty when struct has no such field, never sent then
+		};
+
+		using WritePlan = std::vector<WriteInstruction>;
 
 	public:
 		void clear();
 
-		void add(sky::BitBuffer& msg, const std::string& name, uint32_t fieldCount);
+		void add(BitReader& msg, const std::string& name, uint32_t fieldCount);
+
+		// these also set changed_fields of struct
 
-		void readClientData(sky::BitBuffer& msg, Protocol::ClientData& clientData);
-		void readWeaponData(sky::BitBuffer& msg, Protocol::WeaponData& weaponData);
-		void readEvent(sky::BitBuffer& msg, Protocol::EventArgs& evt);
-		void readEntityNormal(sky::BitBuffer& msg, Protocol::Entity& entity);
-		void readEntityPlayer(sky::BitBuffer& msg, Protocol::Entity& entity);
-		void readEntityCustom(sky::BitBuffer& msg, Protocol::Entity& entity);
+		void readClientData(BitReader& msg, Protocol::ClientData& clientData);
+		void readWeaponData(BitReader& msg, Protocol::WeaponData& weaponData);
+		void readEvent(BitReader& msg, Protocol::EventArgs& evt);
+		void readEntityNormal(BitReader& msg, Protocol::Entity& entity);
+		void readEntityPlayer(BitReader& msg, Protocol::Entity& entity);
+		void readEntityCustom(BitReader& msg, Protocol::Entity& entity);
 
 		void writeUserCmd(sky::BitBuffer& msg, const Protocol::UserCmd& newCmd, const Protocol::UserCmd& oldCmd);
 
 	private:
-		void read(sky::BitBuffer& msg, Protocol::Entity& entity, const std::string& table);
-		void read(sky::BitBuffer& msg, Field& field);
+		void read(BitReader& msg, Field& field);
 
 	private:
-		ReadFields read(sky::BitBuffer& msg, const Table& table);
-		void write(sky::BitBuffer& msg, const Table& table, const WriteFields& fields);
+		static Plan compile(const Table& table, const Bindings& bindings);
+		static uint32_t execute(BitReader& msg, const Plan& plan, void* dst); // returns changed fields
+		static WritePlan compile(const Table& table, const GetterBindings& bindings);
+		static void execute(sky::BitBuffer& msg, const WritePlan& plan, const void* src, const void* prev);
 
 	private:
 		std::unordered_map<std::string, Table> mTables;
+		std::optional<Plan> mClientDataPlan;
+		std::optional<Plan> mWeaponDataPlan;
+		std::optional<Plan> mEventPlan;
+		std::optional<Plan> mEntityNormalPlan;
+		std::optional<Plan> mEntityPlayerPlan;
+		std::optional<Plan> mEntityCustomPlan;
+		std::optional<WritePlan> mUserCmdPlan;
 	};
 }
@@ -0,0 +1,222 @@
+#include "download_manager.h"
+#include <algorithm>
+#include <set>
+#include <fmt/format.h>
+
+using namespace HL;
+
+void DownloadManager::enqueue(const std::vector<std::pair<std::string, size_t>>& files)
+{
+	std::set<std::string> names;
+
+	for (const auto& [name, size] : files)
+	{
+		names.insert(name);
+
+		auto [it, inserted] = mFiles.try_emplace(name);
+		auto& file = it->second;
+
+		if (!inserted && (file.state == State::Queued || file.state == State::Requested))
+			continue;
+
+		file.name = name;
+		file.size = size;
+		file.state = State::Queued;
+		file.map = name.starts_with("maps/") && name.ends_with(".bsp");
+		file.resumed = false;
+		file.order = mOrder++;
+	}
+
+	std::erase_if(mFiles, [&names](const auto& pair) {
+		return pair.second.state == State::Queued && !names.contains(pair.first);
+	});
+}
+
+bool DownloadManager::isBefore(const File& a, const File& b) const
+{
+	if (a.map != b.map)
+		return a.map;
+
+	if (a.resumed != b.resumed)
+		return a.resumed;
+
+	if (a.size != b.size)
+		return a.size < b.size;
+
+	return a.order < b.order;
+}
+
+std::vector<std::string> DownloadManager::takeRequests()
+{
+	std::vector<std::string> result;
+
+	if (mInFlight >= mWindow)
+		return result;
+
+	std::vector<File*> queued;
+
+	for (auto& [name, file] : mFiles)
+	{
+		if (file.state == State::Queued)
+			queued.push_back(&file);
+	}
+
+	auto count = std::min(mWindow - mInFlight, queued.size());
+
+	std::partial_sort(queued.begin(), queued.begin() + count, queued.end(), [this](auto a, auto b) {
+		return isBefore(*a, *b);
+	});
+
+	auto now = Clock::Now();
+
+	if (count > 0 && !mSessionTime.has_value())
+		mSessionTime = now;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto file = queued[i];
+		file->state = State::Requested;
+		file->resumed = false;
+		file->request_time = now;
+		result.push_back(file->name);
+	}
+
+	mInFlight += count;
+
+	return result;
+}
+
+bool DownloadManager::onReceived(const std::string& name, size_t size)
+{
+	auto it = mFiles.find(name);
+
+	if (it == mFiles.end() || it->second.state != State::Requested)
+		return false;
+
+	auto& file = it->second;
+	file.state = State::Received;
+	file.size = size;
+	file.done_time = Clock::Now();
+
+	mInFlight -= 1;
+	mSessionBytes += size;
+
+	return true;
+}
+
+void DownloadManager::onFailed(const std::string& name)
+{
+	auto it = mFiles.find(name);
+
+	if (it == mFiles.end() || it->second.state != State::Requested)
+		return;
+
+	it->second.state = State::Failed;
+	it->second.done_time = Clock::Now();
+
+	mInFlight -= 1;
+}
+
+void DownloadManager::suspend()
+{
+	// requested ones go before everything queued except map, they were the
+	// most wanted, and among themselves in the order they were requested
+
+	for (auto& [name, file] : mFiles)
+	{
+		if (file.state != State::Requested)
+			continue;
+
+		file.state = State::Queued;
+		file.resumed = true;
+	}
+
+	mInFlight = 0;
+	mSessionTime.reset();
+	mSessionBytes = 0;
+}
+
+void DownloadManager::clear()
+{
+	mFiles.clear();
+	mInFlight = 0;
+	mOrder = 0;
+	mSessionTime.reset();
+	mSessionBytes = 0;
+}
+
+void DownloadManager::setServer(const std::string& value)
+{
+	if (mServer == value)
+		return;
+
+	clear();
+	mServer = value;
+}
+
+bool DownloadManager::isBusy() const
+{
+	return std::any_of(mFiles.begin(), mFiles.end(), [](const auto& pair) {
+		return pair.second.state == State::Queued || pair.second.state == State::Requested;
+	});
+}
+
+DownloadManager::Stats DownloadManager::getStats() const
+{
+	Stats result;
+
+	for (const auto& [name, file] : mFiles)
+	{
+		result.total_bytes += file.size;
+
+		switch (file.state)
+		{
+		case State::Queued: result.queued += 1; break;
+		case State::Requested: result.requested += 1; break;
+		case State::Received: result.received += 1; result.received_bytes += file.size; break;
+		case State::Failed: result.failed += 1; break;
+		}
+	}
+
+	if (mSessionTime.has_value())
+	{
+		auto seconds = Clock::ToSeconds(Clock::Now() - mSessionTime.value());
+
+		if (seconds > 0.0f)
+			result.bytes_per_second = static_cast<float>(mSessionBytes) / seconds;
+	}
+
+	return result;
+}
+
+std::string DownloadManager::toText() const
+{
+	auto stats = getStats();
+
+	auto result = fmt::format("files: {} received, {} in flight, {} queued, {} failed\n", stats.received,
+		stats.requested, stats.queued, stats.failed);
+	result += fmt::format("bytes: {} of {} ({:.1f} KB/s)", stats.received_bytes, stats.total_bytes,
+		stats.bytes_per_second / 1024.0f);
+
+	auto now = Clock::Now();
+
+	for (const auto& [name, file] : mFiles)
+	{
+		if (file.state == State::Requested)
+		{
+			result += fmt::format("\n{} ({} bytes), requested {:.1f}s ago", name, file.size,
+				Clock::ToSeconds(now - file.request_time));
+		}
+		else if (file.state == State::Received)
+		{
+			auto seconds = Clock::ToSeconds(file.done_time - file.request_time);
+			result += fmt::format("\n{} ({} bytes), done in {:.1f}s", name, file.size, seconds);
+		}
+		else if (file.state == State::Failed)
+		{
+			result += fmt::format("\n{} failed", name);
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <core/engine.h>
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace HL
+{
+	// missing resources of the server, requested in batches with a bounded
+	// number of files in flight, map goes first, then smaller files, so most
+	// of files are ready early. state is kept across reconnects to the same
+	// server, files that were in flight are requested again right after map
+
+	class DownloadManager
+	{
+	public:
+		enum class State
+		{
+			Queued,
+			Requested,
+			Received,
+			Failed
+		};
+
+		struct File
+		{
+			std::string name;
+			size_t size = 0; // from resource list, received size when done
+			State state = State::Queued;
+			bool map = false;
+			bool resumed = false; // was in flight when connection was lost
+			uint64_t order = 0; // lower goes first among same priority
+			Clock::TimePoint request_time;
+			Clock::TimePoint done_time;
+		};
+
+		struct Stats
+		{
+			size_t queued = 0;
+			size_t requested = 0;
+			size_t received = 0;
+			size_t failed = 0;
+			size_t received_bytes = 0;
+			size_t total_bytes = 0; // expected, of all known files
+			float bytes_per_second = 0.0f; // since first request of session
+		};
+
+	public:
+		// queue becomes exactly these files (name, size), files that are queued
+		// from before keep their place, files in flight are not touched
+
+		void enqueue(const std::vector<std::pair<std::string, size_t>>& files);
+		std::vector<std::string> takeRequests(); // names to request now, marked as requested
+		bool onReceived(const std::string& name, size_t size); // false if file was not requested by us
+		void onFailed(const std::string& name);
+		void suspend(); // connection lost, files in flight will be requested again
+		void clear();
+
+		bool isBusy() const; // something is queued or in flight
+		Stats getStats() const;
+		std::string toText() const;
+
+		const auto& getFiles() const { return mFiles; }
+
+		auto getWindow() const { return mWindow; }
+		void setWindow(size_t value) { mWindow = std::max<size_t>(value, 1); }
+
+		auto getServer() const { return mServer; }
+		void setServer(const std::string& value); // state is dropped when server changes
+
+	private:
+		bool isBefore(const File& a, const File& b) const;
+
+	private:
+		std::map<std::string, File> mFiles;
+		size_t mWindow = 4;
+		size_t mInFlight = 0;
+		uint64_t mOrder = 0;
+		std::string mServer;
+		std::optional<Clock::TimePoint> mSessionTime; // first request after (re)connect
+		size_t mSessionBytes = 0;
+	};
+}
@@ -1,5 +1,8 @@
 #include "encoder.h"
+#include "cpu.h"
 
+#include <array>
+#include <cassert>
 #include <cstring>
 
 
@@ -102,72 +105,203 @@ const uint8_t mungify_table3[] =
 	0x4A, 0x12, 0xA9, 0xB5
 };
 
-using namespace HL;
+// munge of word i is "out = bswap(in ^ ~seq) ^ mask[i & 15] ^ seq", where mask bytes are
+// 0xA5 | (j << j) | j | table[(i + j) & 15], so the whole table is expanded to 16 words once
+// and every kernel just does "out = bswap(in ^ pre) ^ post" with per-call pre and post words
 
-void Encoder::MungeInternal(void* data, size_t size, int seq, const uint8_t table[])
+namespace
 {
-	size = (size & ~3) >> 2;
-		
-	for (size_t i = 0; i < size; i++)
+	using MungeMasks = std::array<uint32_t, 16>;
+
+	MungeMasks MakeMungeMasks(const uint8_t table[])
 	{
-		int32_t* p = (int32_t*)((size_t)data + (i << 2));
-		int32_t c = bswap_32(*p ^ ~seq);
-				
-		for (int j = 0; j < 4; j++)
+		MungeMasks result;
+
+		for (size_t i = 0; i < 16; i++)
 		{
-			*(uint8_t*)((size_t)&c + j) ^= 0xA5 | (j << j) | j | table[(i + j) & 0x0F];
+			uint32_t mask = 0;
+
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				uint8_t b = 0xA5 | (j << j) | j | table[(i + j) & 0x0F];
+				mask |= (uint32_t)b << (j * 8);
+			}
+
+			result[i] = mask;
 		}
 
-		*p = c ^ seq;
+		return result;
 	}
-}
 
-void Encoder::UnMungeInternal(void* data, size_t size, int seq, const uint8_t table[])
-{
-	size = (size & ~3) >> 2;
-		
-	for (size_t i = 0; i < size; i++)
+	const MungeMasks munge_masks = MakeMungeMasks(mungify_table);
+	const MungeMasks munge_masks2 = MakeMungeMasks(mungify_table2);
+	const MungeMasks munge_masks3 = MakeMungeMasks(mungify_table3);
+
+	void MungeScalar(uint8_t* data, size_t start, size_t count, const uint32_t pre[16], const uint32_t post[16])
+	{
+		for (size_t i = start; i < count; i++)
+		{
+			uint32_t c;
+			memcpy(&c, data + (i << 2), 4);
+			c = bswap_32(c ^ pre[i & 0x0F]) ^ post[i & 0x0F];
+			memcpy(data + (i << 2), &c, 4);
+		}
+	}
+
+#if defined(HL_CPU_X86)
+	HL_TARGET("sse2") size_t MungeSSE2(uint8_t* data, size_t count, const uint32_t pre[16], const uint32_t post[16])
+	{
+		__m128i pre_v[4];
+		__m128i post_v[4];
+
+		for (int n = 0; n < 4; n++)
+		{
+			pre_v[n] = _mm_loadu_si128((const __m128i*)(pre + n * 4));
+			post_v[n] = _mm_loadu_si128((const __m128i*)(post + n * 4));
+		}
+
+		size_t i = 0;
+
+		for (; i + 16 <= count; i += 16)
+		{
+			for (int n = 0; n < 4; n++)
+			{
+				auto p = (__m128i*)(data + ((i + n * 4) << 2));
+				auto v = _mm_xor_si128(_mm_loadu_si128(p), pre_v[n]);
+
+				// no pshufb in sse2, swap words then bytes inside words
+				v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+				v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+				_mm_storeu_si128(p, _mm_xor_si128(v, post_v[n]));
+			}
+		}
+
+		return i;
+	}
+
+	HL_TARGET("avx2") size_t MungeAVX2(uint8_t* data, size_t count, const uint32_t pre[16], const uint32_t post[16])
 	{
-		int32_t* p = (int32_t*)((size_t)data + (i << 2));
-		int32_t c = *p ^ seq;
+		__m256i pre_v[2];
+		__m256i post_v[2];
+
+		for (int n = 0; n < 2; n++)
+		{
+			pre_v[n] = _mm256_loadu_si256((const __m256i*)(pre + n * 8));
+			post_v[n] = _mm256_loadu_si256((const __m256i*)(post + n * 8));
+		}
 
-		for (int j = 0; j < 4; j++)
+		const auto bswap = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+		size_t i = 0;
+
+		for (; i + 16 <= count; i += 16)
 		{
-			*(uint8_t*)((size_t)&c + j) ^= 0xA5 | (j << j) | j | table[(i + j) & 0x0F];
+			for (int n = 0; n < 2; n++)
+			{
+				auto p = (__m256i*)(data + ((i + n * 8) << 2));
+				auto v = _mm256_xor_si256(_mm256_loadu_si256(p), pre_v[n]);
+				v = _mm256_shuffle_epi8(v, bswap);
+				_mm256_storeu_si256(p, _mm256_xor_si256(v, post_v[n]));
+			}
 		}
 
-		*p = bswap_32(c) ^ ~seq;
+		return i;
 	}
+#endif
+
+	using MungeKernel = size_t(*)(uint8_t* data, size_t count, const uint32_t pre[16], const uint32_t post[16]);
+
+	MungeKernel SelectMungeKernel()
+	{
+#if defined(HL_CPU_X86)
+		const auto& features = HL::Cpu::GetFeatures();
+
+		if (features.avx2)
+			return MungeAVX2;
+
+		if (features.sse2)
+			return MungeSSE2;
+#endif
+		return nullptr;
+	}
+
+	void MungeWords(void* data, size_t size, const uint32_t pre[16], const uint32_t post[16])
+	{
+		static const MungeKernel kernel = SelectMungeKernel();
+
+		auto bytes = (uint8_t*)data;
+		size_t count = size >> 2;
+		size_t done = 0;
+
+		if (kernel != nullptr && count >= 16)
+			done = kernel(bytes, count, pre, post);
+
+		MungeScalar(bytes, done, count, pre, post);
+	}
+}
+
+using namespace HL;
+
+void Encoder::MungeInternal(void* data, size_t size, int seq, const uint32_t masks[])
+{
+	uint32_t pre[16];
+	uint32_t post[16];
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		pre[i] = ~(uint32_t)seq;
+		post[i] = masks[i] ^ (uint32_t)seq;
+	}
+
+	MungeWords(data, size, pre, post);
+}
+
+void Encoder::UnMungeInternal(void* data, size_t size, int seq, const uint32_t masks[])
+{
+	uint32_t pre[16];
+	uint32_t post[16];
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		pre[i] = masks[i] ^ (uint32_t)seq;
+		post[i] = ~(uint32_t)seq;
+	}
+
+	MungeWords(data, size, pre, post);
 }
 
 void Encoder::Munge(void* data, size_t size, int seq)
 {
-	MungeInternal(data, size, seq, mungify_table);
+	MungeInternal(data, size, seq, munge_masks.data());
 }
 
 void Encoder::UnMunge(void* data, size_t size, int seq)
 {
-	UnMungeInternal(data, size, seq, mungify_table);
+	UnMungeInternal(data, size, seq, munge_masks.data());
 }
 
 void Encoder::Munge2(void* data, size_t size, int seq)
 {
-	MungeInternal(data, size, seq, mungify_table2);
+	MungeInternal(data, size, seq, munge_masks2.data());
 }
 
 void Encoder::UnMunge2(void* data, size_t size, int seq)
 {
-	UnMungeInternal(data, size, seq, mungify_table2);
+	UnMungeInternal(data, size, seq, munge_masks2.data());
 }
 
 void Encoder::Munge3(void* data, size_t size, int seq)
 {
-	MungeInternal(data, size, seq, mungify_table3);
+	MungeInternal(data, size, seq, munge_masks3.data());
 }
 
 void Encoder::UnMunge3(void* data, size_t size, int seq)
 {
-	UnMungeInternal(data, size, seq, mungify_table3);
+	UnMungeInternal(data, size, seq, munge_masks3.data());
 }
 
 static const uint32_t pulCRCTable[256] =
@@ -256,45 +390,228 @@ void Encoder::CRC32_ProcessByte(CRC32_t *pulCRC, unsigned char ch)
 	*pulCRC = ulCrc;
 }
 
-void Encoder::CRC32_ProcessBuffer(CRC32_t *pulCRC, void *pBuffer, int nBuffer)
+// slicing-by-8 tables, table[0] is the classic one
+
+namespace
 {
-	CRC32_t ulCrc = *pulCRC;
-	uint8_t* pb = (uint8_t*)pBuffer;
+	using CRC32Tables = std::array<std::array<uint32_t, 256>, 8>;
 
-	for (int i = 0; i < nBuffer; i++)
+	CRC32Tables MakeCRC32Tables()
 	{
-		ulCrc = pulCRCTable[(ulCrc & 0xFF) ^ pb[i]] ^ (ulCrc >> 8);
+		CRC32Tables result;
+
+		for (size_t i = 0; i < 256; i++)
+		{
+			result[0][i] = pulCRCTable[i];
+		}
+
+		for (size_t i = 0; i < 256; i++)
+		{
+			for (size_t t = 1; t < 8; t++)
+			{
+				auto prev = result[t - 1][i];
+				result[t][i] = (prev >> 8) ^ pulCRCTable[prev & 0xFF];
+			}
+		}
+
+		return result;
 	}
 
-	*pulCRC = ulCrc;
+	const CRC32Tables crc32_tables = MakeCRC32Tables();
+
+	uint32_t CRC32Scalar(uint32_t crc, const uint8_t* data, size_t size)
+	{
+		const auto& t = crc32_tables;
+
+		while (size >= 8)
+		{
+			uint32_t lo;
+			uint32_t hi;
+			memcpy(&lo, data, 4);
+			memcpy(&hi, data + 4, 4);
+
+			lo ^= crc;
+
+			crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+				t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+
+			data += 8;
+			size -= 8;
+		}
+
+		while (size > 0)
+		{
+			crc = t[0][(crc & 0xFF) ^ *data] ^ (crc >> 8);
+			data += 1;
+			size -= 1;
+		}
+
+		return crc;
+	}
+
+#if defined(HL_CPU_X86)
+	// folding with carry-less multiplication, same as zlib (chromium) crc32_simd,
+	// needs at least 64 bytes and processes a multiple of 16 bytes
+
+	HL_TARGET("sse2,pclmul") uint32_t CRC32PCLMUL(uint32_t crc, const uint8_t* buf, size_t len)
+	{
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+		x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+		x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+		x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+		x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+		x0 = _mm_load_si128((const __m128i*)k1k2);
+
+		buf += 64;
+		len -= 64;
+
+		// fold 4 x 128 bits in parallel
+
+		while (len >= 64)
+		{
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+			y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+			y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+			y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+			y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+			buf += 64;
+			len -= 64;
+		}
+
+		// fold into 128 bits
+
+		x0 = _mm_load_si128((const __m128i*)k3k4);
+
+		for (auto next : { x2, x3, x4 })
+		{
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+		}
+
+		// single fold blocks of 128 bits
+
+		while (len >= 16)
+		{
+			x2 = _mm_loadu_si128((const __m128i*)buf);
+
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+			buf += 16;
+			len -= 16;
+		}
+
+		// fold 128 bits to 64 bits
+
+		x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+		x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_srli_si128(x1, 8);
+		x1 = _mm_xor_si128(x1, x2);
+
+		x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, x3);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// barrett reduce to 32 bits
+
+		x0 = _mm_load_si128((const __m128i*)poly);
+
+		x2 = _mm_and_si128(x1, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+		x2 = _mm_and_si128(x2, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	}
+#endif
+
+	uint32_t CRC32(uint32_t crc, const uint8_t* data, size_t size)
+	{
+#if defined(HL_CPU_X86)
+		static const bool pclmul = HL::Cpu::GetFeatures().pclmul && HL::Cpu::GetFeatures().sse2;
+
+		if (pclmul && size >= 64)
+		{
+			auto chunk = size & ~(size_t)15;
+			crc = CRC32PCLMUL(crc, data, chunk);
+			data += chunk;
+			size -= chunk;
+		}
+#endif
+		return CRC32Scalar(crc, data, size);
+	}
 }
 
+void Encoder::CRC32_ProcessBuffer(CRC32_t *pulCRC, void *pBuffer, int nBuffer)
+{
+	if (nBuffer <= 0)
+		return;
 
-uint8_t Encoder::BlockSequenceCRCByte(void* data, int len, int seq)
+	*pulCRC = CRC32(*pulCRC, (const uint8_t*)pBuffer, (size_t)nBuffer);
+}
+
+void Encoder::CRC32_ProcessBuffer(CRC32_t* pulCRC, const sky::BitBuffer& buf, size_t offset, size_t size)
 {
-	uint8_t *p;
-	char chkb[64];
-	CRC32_t crc;
+	assert(offset + size <= buf.getSize());
 
+	*pulCRC = CRC32(*pulCRC, (const uint8_t*)buf.getMemory() + offset, size);
+}
+
+uint8_t Encoder::BlockSequenceCRCByte(void* data, int len, int seq)
+{
 	if (seq < 0)
 		return 0; //Sys_Error("%s: sequence < 0\n", __func__);
-		
-	p = (uint8_t*)pulCRCTable + seq % 0x3FC;
-		
+
 	if (len > 60)
 		len = 60;
-		
-	memcpy(chkb, data, len);
 
-	chkb[len] = p[0];
-	chkb[len + 1] = p[1];
-	chkb[len + 2] = p[2];
-	chkb[len + 3] = p[3];
+	// original copies data and 4 bytes of crc table into a temporary buffer, 
+	// we just continue the same crc with these bytes
+
+	auto p = (uint8_t*)pulCRCTable + seq % 0x3FC;
+
+	CRC32_t crc;
 
 	CRC32_Init(&crc);
-		
-	CRC32_ProcessBuffer(&crc, chkb, len + 4);
-		
+	CRC32_ProcessBuffer(&crc, data, len);
+	CRC32_ProcessBuffer(&crc, p, 4);
+
 	return CRC32_Final(crc);
+}
+
+uint8_t Encoder::BlockSequenceCRCByte(const sky::BitBuffer& buf, size_t offset, size_t size, int seq)
+{
+	assert(offset + size <= buf.getSize());
 
-}
\ No newline at end of file
+	return BlockSequenceCRCByte((uint8_t*)buf.getMemory() + offset, (int)std::min<size_t>(size, 60), seq);
+}
@@ -2,14 +2,15 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <common/bitbuffer.h>
 
 namespace HL
 {
 	class Encoder
 	{
 	private:
-		static void MungeInternal(void* data, size_t size, int seq, const uint8_t table[]);
-		static void UnMungeInternal(void* data, size_t size, int seq, const uint8_t table[]);
+		static void MungeInternal(void* data, size_t size, int seq, const uint32_t masks[]);
+		static void UnMungeInternal(void* data, size_t size, int seq, const uint32_t masks[]);
 
 	public:
 		static void Munge(void* data, size_t size, int seq);
@@ -26,7 +27,9 @@ namespace HL
 		static CRC32_t CRC32_Final(CRC32_t pulCRC);
 		static void CRC32_ProcessByte(CRC32_t *pulCRC, unsigned char ch);
 		static void CRC32_ProcessBuffer(CRC32_t *pulCRC, void *pBuffer, int nBuffer);
+		static void CRC32_ProcessBuffer(CRC32_t* pulCRC, const sky::BitBuffer& buf, size_t offset, size_t size);
 
 		static uint8_t BlockSequenceCRCByte(void* data, int len, int seq);
+		static uint8_t BlockSequenceCRCByte(const sky::BitBuffer& buf, size_t offset, size_t size, int seq);
 	};
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "protocol.h"
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace HL
+{
+	// packet entities of last frames, keyed by incoming sequence, so delta packet
+	// can be applied to exactly the frame server compressed it against,
+	// entities are immutable and shared between frames until changed
+
+	class EntityFrames
+	{
+	public:
+		static constexpr size_t UpdateBackup = 64; // as in engine, must be power of two
+		static constexpr size_t UpdateMask = UpdateBackup - 1;
+
+		using EntityPtr = std::shared_ptr<const Protocol::Entity>;
+
+		struct Frame
+		{
+			uint32_t sequence = 0;
+			bool valid = false;
+			std::vector<std::pair<int, EntityPtr>> entities; // sorted by index
+		};
+
+	public:
+		// frame which server named in svc_deltapacketentities (low byte of our incoming sequence)
+
+		const Frame* find(uint8_t delta_sequence) const
+		{
+			const auto& frame = mFrames[delta_sequence & UpdateMask];
+
+			if (!frame.valid || (frame.sequence & 0xFF) != delta_sequence)
+				return nullptr;
+
+			return &frame;
+		}
+
+		Frame& create(uint32_t sequence)
+		{
+			auto& frame = mFrames[sequence & UpdateMask];
+			frame.sequence = sequence;
+			frame.valid = false;
+			frame.entities.clear();
+			return frame;
+		}
+
+		void clear()
+		{
+			for (auto& frame : mFrames)
+			{
+				frame.valid = false;
+				frame.entities.clear();
+			}
+		}
+
+	private:
+		std::array<Frame, UpdateBackup> mFrames;
+	};
+}
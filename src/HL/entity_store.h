@@ -0,0 +1,157 @@
+#pragma once
+
+#include "protocol.h"
+#include <array>
+#include <bit>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+namespace HL
+{
+	// entities by index in one flat array, active ones are marked in a bitset,
+	// iteration goes in index order, storage is allocated on first insert.
+	// packet entities are delta compressed from frames (see EntityFrames)
+	// or from baselines, never from states left in this store
+
+	template <size_t N>
+	class EntityStore
+	{
+		static constexpr size_t WordsCount = (N + 63) / 64;
+
+	public:
+		template <typename E>
+		class Iterator
+		{
+		public:
+			using value_type = std::pair<int, E*>;
+
+			Iterator(const EntityStore* store, size_t index) : mStore(store), mIndex(index)
+			{
+				advance();
+			}
+
+			value_type operator*() const
+			{
+				return { static_cast<int>(mIndex), const_cast<E*>(&mStore->mSlots[mIndex]) };
+			}
+
+			Iterator& operator++()
+			{
+				mIndex += 1;
+				advance();
+				return *this;
+			}
+
+			bool operator==(const Iterator& other) const { return mIndex == other.mIndex; }
+			bool operator!=(const Iterator& other) const { return mIndex != other.mIndex; }
+
+		private:
+			void advance()
+			{
+				while (mIndex < N)
+				{
+					auto word = mStore->mActive[mIndex / 64] >> (mIndex % 64);
+
+					if (word != 0)
+					{
+						mIndex += std::countr_zero(word);
+						return;
+					}
+
+					mIndex = (mIndex / 64 + 1) * 64;
+				}
+
+				mIndex = N;
+			}
+
+		private:
+			const EntityStore* mStore;
+			size_t mIndex;
+		};
+
+	public:
+		bool contains(size_t index) const
+		{
+			return index < N && (mActive[index / 64] & (1ULL << (index % 64))) != 0;
+		}
+
+		// marks entity as active, returns its slot with state it had before
+
+		Protocol::Entity& insert(size_t index)
+		{
+			assert(index < N);
+
+			if (!contains(index))
+			{
+				mActive[index / 64] |= 1ULL << (index % 64);
+				mSize += 1;
+			}
+
+			return slots()[index];
+		}
+
+		void erase(size_t index)
+		{
+			if (!contains(index))
+				return;
+
+			mActive[index / 64] &= ~(1ULL << (index % 64));
+			mSize -= 1;
+		}
+
+		// slot of entity, active or not
+
+		Protocol::Entity& at(size_t index)
+		{
+			assert(index < N);
+			return slots()[index];
+		}
+
+		const Protocol::Entity& at(size_t index) const
+		{
+			assert(contains(index));
+			return mSlots[index];
+		}
+
+		// deactivates everything, states are kept
+
+		void deactivate()
+		{
+			mActive = {};
+			mSize = 0;
+		}
+
+		// deactivates everything and forgets states
+
+		void clear()
+		{
+			deactivate();
+			mSlots.clear();
+			mSlots.shrink_to_fit();
+		}
+
+		auto size() const { return mSize; }
+		bool empty() const { return mSize == 0; }
+		static constexpr size_t capacity() { return N; }
+
+		auto begin() { return Iterator<Protocol::Entity>(this, 0); }
+		auto end() { return Iterator<Protocol::Entity>(this, N); }
+		auto begin() const { return Iterator<const Protocol::Entity>(this, 0); }
+		auto end() const { return Iterator<const Protocol::Entity>(this, N); }
+
+	private:
+		std::vector<Protocol::Entity>& slots()
+		{
+			if (mSlots.empty())
+				mSlots.resize(N);
+
+			return mSlots;
+		}
+
+	private:
+		std::vector<Protocol::Entity> mSlots;
+		std::array<uint64_t, WordsCount> mActive = {};
+		size_t mSize = 0;
+	};
+}
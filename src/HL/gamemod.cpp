@@ -14,12 +14,14 @@ bool GameMod::isPlayerAlive(int index) const
 	return true;
 }
 
-void GameMod::readMessage(const std::string& name, sky::BitBuffer& msg)
+const GameMod::ReadMessageCallback* GameMod::findReadCallback(const std::string& name) const
 {
-	if (!mReadCallbacks.contains(name))
-		return;
+	auto it = mReadCallbacks.find(name);
 
-	mReadCallbacks.at(name)(msg);
+	if (it == mReadCallbacks.end())
+		return nullptr;
+
+	return &it->second;
 }
 
 void GameMod::addReadCallback(const std::string& name, ReadMessageCallback callback)
@@ -55,9 +57,9 @@ CounterStrike::CounterStrike()
 	AddCallback("SayText", ReadSayText)
 	AddCallback("MOTD", ReadMOTD)
 	*/
-	addReadCallback("TeamInfo", [this](sky::BitBuffer& msg) {
+	addReadCallback("TeamInfo", [this](BitReader& msg) {
 		auto player_id = msg.read<uint8_t>();
-		auto team = sky::bitbuffer_helpers::ReadString(msg);
+		auto team = msg.readString();
 		mTeamInfo[player_id] = magic_enum::enum_cast<Team>(team).value_or(Team::UNASSIGNED);
 	});
 	/*
@@ -67,7 +69,7 @@ CounterStrike::CounterStrike()
 	AddCallback("Money", ReadMoney)
 	AddCallback("TeamScore", ReadTeamScore)
 	*/
-	addReadCallback("ScoreAttrib", [this](sky::BitBuffer& msg) {
+	addReadCallback("ScoreAttrib", [this](BitReader& msg) {
 		auto player_id = msg.read<uint8_t>();
 		auto status = msg.read<uint8_t>();
 		mScoreStatus[player_id] = status;
@@ -94,11 +96,11 @@ CounterStrike::CounterStrike()
 	AddCallback("SendAudio", ReadSendAudio)
 	AddCallback("Geiger", ReadGeiger)
 	*/
-	addReadCallback("Radar", [this](sky::BitBuffer& msg) {
+	addReadCallback("Radar", [this](BitReader& msg) {
 		auto player_id = msg.read<uint8_t>();
-		auto x = sky::bitbuffer_helpers::ReadCoord(msg);
-		auto y = sky::bitbuffer_helpers::ReadCoord(msg);
-		auto z = sky::bitbuffer_helpers::ReadCoord(msg);
+		auto x = msg.readCoord();
+		auto y = msg.readCoord();
+		auto z = msg.readCoord();
 		mRadar[player_id] = { x, y, z };
 	});
 	/*
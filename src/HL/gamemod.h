@@ -1,13 +1,14 @@
 #pragma once
 
 #include <shared/all.h>
+#include "bit_reader.h"
 
 namespace HL
 {
 	class GameMod
 	{
 	public:
-		using ReadMessageCallback = std::function<void(sky::BitBuffer&)>;
+		using ReadMessageCallback = std::function<void(BitReader&)>;
 		using SendCommandCallback = std::function<void(const std::string&)>;
 
 	public:
@@ -15,7 +16,10 @@ namespace HL
 		virtual bool isPlayerAlive(int index) const;
 
 	public:
-		void readMessage(const std::string& name, sky::BitBuffer& msg);
+		// client binds message index to callback once, when message is registered,
+		// pointer stays valid while game mod lives
+
+		const ReadMessageCallback* findReadCallback(const std::string& name) const;
 		void addReadCallback(const std::string& name, ReadMessageCallback callback);
 		void setSendCommandCallback(SendCommandCallback value) { mSendCommandCallback = value; }
 
@@ -149,7 +149,7 @@ GameplayViewNode::GameplayViewNode(std::shared_ptr<BaseClient> client) :
 		auto model = mClient->findModel(model_index);
 
 		auto label = std::make_shared<Scene::Label>();
-		label->setText(sky::to_wstring(model.value().name));
+		label->setText(sky::to_wstring(model != nullptr ? model->name : "?"));
 		label->setFontSize(10.0f);
 		label->setPivot(0.5f);
 		label->setPosition(worldToScreen(origin));
@@ -169,7 +169,7 @@ GameplayViewNode::GameplayViewNode(std::shared_ptr<BaseClient> client) :
 		auto model = mClient->findModel(model_index);
 
 		auto label = std::make_shared<Scene::Label>();
-		label->setText(sky::to_wstring(model.value().name));
+		label->setText(sky::to_wstring(model != nullptr ? model->name : "?"));
 		label->setFontSize(10.0f);
 		label->setPivot(0.5f);
 		label->setPosition(worldToScreen(origin));
@@ -189,7 +189,7 @@ GameplayViewNode::GameplayViewNode(std::shared_ptr<BaseClient> client) :
 		auto model = mClient->findModel(model_index);
 
 		auto label = std::make_shared<Scene::Label>();
-		label->setText(sky::to_wstring(model.value().name));
+		label->setText(sky::to_wstring(model != nullptr ? model->name : "?"));
 		label->setFontSize(10.0f);
 		label->setPivot(0.5f);
 		label->setPosition(worldToScreen(origin));
@@ -209,7 +209,7 @@ GameplayViewNode::GameplayViewNode(std::shared_ptr<BaseClient> client) :
 		auto model = mClient->findModel(model_index);
 
 		auto label = std::make_shared<Scene::Label>();
-		label->setText(sky::to_wstring(model.value().name));
+		label->setText(sky::to_wstring(model != nullptr ? model->name : "?"));
 		label->setFontSize(10.0f);
 		label->setPivot(0.5f);
 		label->setPosition(worldToScreen(origin));
@@ -285,12 +285,12 @@ void GameplayViewNode::drawEntities(Scene::Node& holder)
 
 		auto model = mClient->findModel(entity->modelindex);
 
-		if (!model.has_value())
+		if (model == nullptr)
 			continue;
 
 		auto origin_scr = worldToScreen(entity->origin);
 
-		if (model.value().name.substr(0, 1) == "*")
+		if (model->brush)
 		{
 			auto position = (entity->maxs + entity->mins) / 2.0f;
 			origin_scr = worldToScreen(position + entity->origin);
@@ -317,7 +317,7 @@ void GameplayViewNode::drawEntities(Scene::Node& holder)
 		label->setAnchor({ 0.5f, 0.0f });
 		label->setY(-10.0f);
 		label->setFontSize(8.0f);
-		label->setText(sky::to_wstring(getNiceModelName(model.value())));
+		label->setText(sky::to_wstring(model->short_name));
 		IMSCENE->showAndHideWithScale();
 	}
 }
@@ -336,10 +336,10 @@ void GameplayViewNode::drawPlayers(Scene::Node& holder)
 		if (!gamemod->isPlayerAlive(index))
 			continue;
 
-		HL::Protocol::Entity* entity = nullptr;
+		const HL::Protocol::Entity* entity = nullptr;
 
 		if (entities.contains(index))
-			entity = entities.at(index);
+			entity = &entities.at(index);
 
 		bool is_me = index == serverinfo.index + 1;
 
@@ -371,9 +371,9 @@ void GameplayViewNode::drawPlayers(Scene::Node& holder)
 		if (entity != nullptr)
 		{
 			auto weapon_model = mClient->findModel(entity->weaponmodel);
-			if (weapon_model.has_value())
+			if (weapon_model != nullptr)
 			{
-				labels.push_back({ "weapon", getNiceModelName(weapon_model.value()) });
+				labels.push_back({ "weapon", weapon_model->short_name });
 			}
 			angles = entity->angles;
 		}
@@ -489,15 +489,6 @@ float GameplayViewNode::worldToScreenAngles(const glm::vec3& value) const
 	return result;
 }
 
-std::string GameplayViewNode::getNiceModelName(const HL::Protocol::Resource& model) const
-{
-	if (model.name.starts_with("*"))
-		return model.name;
-
-	auto path = std::filesystem::path(model.name);
-	return path.filename().replace_extension().string();
-}
-
 std::string GameplayViewNode::getShortMapName() const
 {
 	const auto& info = mClient->getServerInfo().value();
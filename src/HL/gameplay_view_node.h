@@ -63,7 +63,6 @@ namespace HL
 		glm::vec2 worldToScreen(const glm::vec3& value) const;
 		glm::vec3 screenToWorld(const glm::vec2& value) const;
 		float worldToScreenAngles(const glm::vec3& value) const;
-		std::string getNiceModelName(const HL::Protocol::Resource& model) const;
 		std::string getShortMapName() const;
 		auto getBackgroundNode() const { return mBackground; }
 
@@ -28,7 +28,7 @@ HLTVClient::HLTVClient() : BaseClient(true)
 		{ "raw", "861078331b85a424935805ca54f82891" } 
 	});
 
-	CONSOLE->execute("name 'HLTV Proxy'");
+	execute("name 'HLTV Proxy'");
 }
 
 HLTVClient::~HLTVClient()
@@ -100,21 +100,17 @@ void HudViews::onFrame()
 
 		ImGui::Separator();
 
-		const auto& resources = mBaseClient.getResources();
-
 		for (const auto [index, entity] : mBaseClient.getEntities())
 		{
-			auto model = std::find_if(resources.cbegin(), resources.cend(), [e = entity](const auto& res) {
-				return res.index == e->modelindex && res.type == HL::Protocol::Resource::Type::Model;
-			});
+			auto model = mBaseClient.findModel(entity->modelindex);
 
-			if (model == resources.end()) // TODO: assert here
+			if (model == nullptr) // TODO: assert here
 				continue;
 
 			if (model->name.empty())
 				continue;
 
-			if (model->name[0] == '*' && mWantShowEntities == 1)
+			if (model->brush && mWantShowEntities == 1)
 				continue;
 
 			const auto& origin = entity->origin;
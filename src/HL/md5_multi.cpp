@@ -0,0 +1,532 @@
+#include "md5_multi.h"
+#include "cpu.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// rounds of rfc 1321, shared by all kernels, every kernel has own overloads of
+// Add, Rotl, Splat and F, G, H, I for its word type, so this expands to plain
+// code of 1, 4 or 8 lanes
+
+#define MD5_STEP(f, a, b, c, d, k, s, t) \
+	a = Add(b, Rotl<s>(Add(Add(a, f(b, c, d)), Add(w[k], Splat(a, t)))));
+
+#define MD5_ROUNDS() \
+	MD5_STEP(F, a, b, c, d,  0,  7, 0xd76aa478) \
+	MD5_STEP(F, d, a, b, c,  1, 12, 0xe8c7b756) \
+	MD5_STEP(F, c, d, a, b,  2, 17, 0x242070db) \
+	MD5_STEP(F, b, c, d, a,  3, 22, 0xc1bdceee) \
+	MD5_STEP(F, a, b, c, d,  4,  7, 0xf57c0faf) \
+	MD5_STEP(F, d, a, b, c,  5, 12, 0x4787c62a) \
+	MD5_STEP(F, c, d, a, b,  6, 17, 0xa8304613) \
+	MD5_STEP(F, b, c, d, a,  7, 22, 0xfd469501) \
+	MD5_STEP(F, a, b, c, d,  8,  7, 0x698098d8) \
+	MD5_STEP(F, d, a, b, c,  9, 12, 0x8b44f7af) \
+	MD5_STEP(F, c, d, a, b, 10, 17, 0xffff5bb1) \
+	MD5_STEP(F, b, c, d, a, 11, 22, 0x895cd7be) \
+	MD5_STEP(F, a, b, c, d, 12,  7, 0x6b901122) \
+	MD5_STEP(F, d, a, b, c, 13, 12, 0xfd987193) \
+	MD5_STEP(F, c, d, a, b, 14, 17, 0xa679438e) \
+	MD5_STEP(F, b, c, d, a, 15, 22, 0x49b40821) \
+	MD5_STEP(G, a, b, c, d,  1,  5, 0xf61e2562) \
+	MD5_STEP(G, d, a, b, c,  6,  9, 0xc040b340) \
+	MD5_STEP(G, c, d, a, b, 11, 14, 0x265e5a51) \
+	MD5_STEP(G, b, c, d, a,  0, 20, 0xe9b6c7aa) \
+	MD5_STEP(G, a, b, c, d,  5,  5, 0xd62f105d) \
+	MD5_STEP(G, d, a, b, c, 10,  9, 0x02441453) \
+	MD5_STEP(G, c, d, a, b, 15, 14, 0xd8a1e681) \
+	MD5_STEP(G, b, c, d, a,  4, 20, 0xe7d3fbc8) \
+	MD5_STEP(G, a, b, c, d,  9,  5, 0x21e1cde6) \
+	MD5_STEP(G, d, a, b, c, 14,  9, 0xc33707d6) \
+	MD5_STEP(G, c, d, a, b,  3, 14, 0xf4d50d87) \
+	MD5_STEP(G, b, c, d, a,  8, 20, 0x455a14ed) \
+	MD5_STEP(G, a, b, c, d, 13,  5, 0xa9e3e905) \
+	MD5_STEP(G, d, a, b, c,  2,  9, 0xfcefa3f8) \
+	MD5_STEP(G, c, d, a, b,  7, 14, 0x676f02d9) \
+	MD5_STEP(G, b, c, d, a, 12, 20, 0x8d2a4c8a) \
+	MD5_STEP(H, a, b, c, d,  5,  4, 0xfffa3942) \
+	MD5_STEP(H, d, a, b, c,  8, 11, 0x8771f681) \
+	MD5_STEP(H, c, d, a, b, 11, 16, 0x6d9d6122) \
+	MD5_STEP(H, b, c, d, a, 14, 23, 0xfde5380c) \
+	MD5_STEP(H, a, b, c, d,  1,  4, 0xa4beea44) \
+	MD5_STEP(H, d, a, b, c,  4, 11, 0x4bdecfa9) \
+	MD5_STEP(H, c, d, a, b,  7, 16, 0xf6bb4b60) \
+	MD5_STEP(H, b, c, d, a, 10, 23, 0xbebfbc70) \
+	MD5_STEP(H, a, b, c, d, 13,  4, 0x289b7ec6) \
+	MD5_STEP(H, d, a, b, c,  0, 11, 0xeaa127fa) \
+	MD5_STEP(H, c, d, a, b,  3, 16, 0xd4ef3085) \
+	MD5_STEP(H, b, c, d, a,  6, 23, 0x04881d05) \
+	MD5_STEP(H, a, b, c, d,  9,  4, 0xd9d4d039) \
+	MD5_STEP(H, d, a, b, c, 12, 11, 0xe6db99e5) \
+	MD5_STEP(H, c, d, a, b, 15, 16, 0x1fa27cf8) \
+	MD5_STEP(H, b, c, d, a,  2, 23, 0xc4ac5665) \
+	MD5_STEP(I, a, b, c, d,  0,  6, 0xf4292244) \
+	MD5_STEP(I, d, a, b, c,  7, 10, 0x432aff97) \
+	MD5_STEP(I, c, d, a, b, 14, 15, 0xab9423a7) \
+	MD5_STEP(I, b, c, d, a,  5, 21, 0xfc93a039) \
+	MD5_STEP(I, a, b, c, d, 12,  6, 0x655b59c3) \
+	MD5_STEP(I, d, a, b, c,  3, 10, 0x8f0ccc92) \
+	MD5_STEP(I, c, d, a, b, 10, 15, 0xffeff47d) \
+	MD5_STEP(I, b, c, d, a,  1, 21, 0x85845dd1) \
+	MD5_STEP(I, a, b, c, d,  8,  6, 0x6fa87e4f) \
+	MD5_STEP(I, d, a, b, c, 15, 10, 0xfe2ce6e0) \
+	MD5_STEP(I, c, d, a, b,  6, 15, 0xa3014314) \
+	MD5_STEP(I, b, c, d, a, 13, 21, 0x4e0811a1) \
+	MD5_STEP(I, a, b, c, d,  4,  6, 0xf7537e82) \
+	MD5_STEP(I, d, a, b, c, 11, 10, 0xbd3af235) \
+	MD5_STEP(I, c, d, a, b,  2, 15, 0x2ad7d2bb) \
+	MD5_STEP(I, b, c, d, a,  9, 21, 0xeb86d391)
+
+namespace
+{
+	constexpr size_t MaxLanes = 8;
+
+	// state is 4 rows of lanes (a of all lanes, then b, ...), one block per lane
+	using TransformKernel = void(*)(uint32_t* state, const uint8_t* const* blocks);
+
+	struct Engine
+	{
+		TransformKernel transform;
+		size_t lanes;
+	};
+
+	const uint8_t ZeroBlock[64] = { }; // for idle lanes
+
+	inline uint32_t Add(uint32_t x, uint32_t y) { return x + y; }
+	inline uint32_t Splat(uint32_t, uint32_t t) { return t; }
+	template <int S> inline uint32_t Rotl(uint32_t x) { return (x << S) | (x >> (32 - S)); }
+	inline uint32_t F(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+	inline uint32_t G(uint32_t x, uint32_t y, uint32_t z) { return y ^ (z & (x ^ y)); }
+	inline uint32_t H(uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; }
+	inline uint32_t I(uint32_t x, uint32_t y, uint32_t z) { return y ^ (x | ~z); }
+
+	inline uint32_t LoadLE(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	inline void StoreLE(uint8_t* p, uint32_t value)
+	{
+		p[0] = (uint8_t)value;
+		p[1] = (uint8_t)(value >> 8);
+		p[2] = (uint8_t)(value >> 16);
+		p[3] = (uint8_t)(value >> 24);
+	}
+
+	void TransformScalar(uint32_t* state, const uint8_t* const* blocks)
+	{
+		uint32_t w[16];
+
+		for (int i = 0; i < 16; i++)
+			w[i] = LoadLE(blocks[0] + i * 4);
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+
+		MD5_ROUNDS();
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+
+#if defined(HL_CPU_X86)
+	HL_TARGET("sse2") inline __m128i Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+	HL_TARGET("sse2") inline __m128i Splat(__m128i, uint32_t t) { return _mm_set1_epi32((int)t); }
+	template <int S> HL_TARGET("sse2") inline __m128i Rotl(__m128i x) { return _mm_or_si128(_mm_slli_epi32(x, S), _mm_srli_epi32(x, 32 - S)); }
+	HL_TARGET("sse2") inline __m128i F(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z))); }
+	HL_TARGET("sse2") inline __m128i G(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(y, _mm_and_si128(z, _mm_xor_si128(x, y))); }
+	HL_TARGET("sse2") inline __m128i H(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(_mm_xor_si128(x, y), z); }
+	HL_TARGET("sse2") inline __m128i I(__m128i x, __m128i y, __m128i z) { return _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1)))); }
+
+	// words i..i+3 of 4 lanes to 4 vectors of one word
+	HL_TARGET("sse2") inline void Transpose(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+	{
+		auto t0 = _mm_unpacklo_epi32(r0, r1);
+		auto t1 = _mm_unpacklo_epi32(r2, r3);
+		auto t2 = _mm_unpackhi_epi32(r0, r1);
+		auto t3 = _mm_unpackhi_epi32(r2, r3);
+		r0 = _mm_unpacklo_epi64(t0, t1);
+		r1 = _mm_unpackhi_epi64(t0, t1);
+		r2 = _mm_unpacklo_epi64(t2, t3);
+		r3 = _mm_unpackhi_epi64(t2, t3);
+	}
+
+	HL_TARGET("sse2") void TransformSSE2(uint32_t* state, const uint8_t* const* blocks)
+	{
+		__m128i w[16];
+
+		for (int i = 0; i < 16; i += 4)
+		{
+			for (int lane = 0; lane < 4; lane++)
+				w[i + lane] = _mm_loadu_si128((const __m128i*)(blocks[lane] + i * 4));
+
+			Transpose(w[i], w[i + 1], w[i + 2], w[i + 3]);
+		}
+
+		auto a = _mm_loadu_si128((const __m128i*)(state + 0));
+		auto b = _mm_loadu_si128((const __m128i*)(state + 4));
+		auto c = _mm_loadu_si128((const __m128i*)(state + 8));
+		auto d = _mm_loadu_si128((const __m128i*)(state + 12));
+
+		auto a0 = a;
+		auto b0 = b;
+		auto c0 = c;
+		auto d0 = d;
+
+		MD5_ROUNDS();
+
+		_mm_storeu_si128((__m128i*)(state + 0), _mm_add_epi32(a, a0));
+		_mm_storeu_si128((__m128i*)(state + 4), _mm_add_epi32(b, b0));
+		_mm_storeu_si128((__m128i*)(state + 8), _mm_add_epi32(c, c0));
+		_mm_storeu_si128((__m128i*)(state + 12), _mm_add_epi32(d, d0));
+	}
+
+	HL_TARGET("avx2") inline __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+	HL_TARGET("avx2") inline __m256i Splat(__m256i, uint32_t t) { return _mm256_set1_epi32((int)t); }
+	template <int S> HL_TARGET("avx2") inline __m256i Rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi32(x, S), _mm256_srli_epi32(x, 32 - S)); }
+	HL_TARGET("avx2") inline __m256i F(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z))); }
+	HL_TARGET("avx2") inline __m256i G(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y))); }
+	HL_TARGET("avx2") inline __m256i H(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(_mm256_xor_si256(x, y), z); }
+	HL_TARGET("avx2") inline __m256i I(__m256i x, __m256i y, __m256i z) { return _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1)))); }
+
+	// same as sse2 one, but each half of row is other lane (l and l + 4)
+	HL_TARGET("avx2") inline void Transpose(__m256i& r0, __m256i& r1, __m256i& r2, __m256i& r3)
+	{
+		auto t0 = _mm256_unpacklo_epi32(r0, r1);
+		auto t1 = _mm256_unpacklo_epi32(r2, r3);
+		auto t2 = _mm256_unpackhi_epi32(r0, r1);
+		auto t3 = _mm256_unpackhi_epi32(r2, r3);
+		r0 = _mm256_unpacklo_epi64(t0, t1);
+		r1 = _mm256_unpackhi_epi64(t0, t1);
+		r2 = _mm256_unpacklo_epi64(t2, t3);
+		r3 = _mm256_unpackhi_epi64(t2, t3);
+	}
+
+	HL_TARGET("avx2") void TransformAVX2(uint32_t* state, const uint8_t* const* blocks)
+	{
+		__m256i w[16];
+
+		for (int i = 0; i < 16; i += 4)
+		{
+			for (int lane = 0; lane < 4; lane++)
+			{
+				auto lo = _mm_loadu_si128((const __m128i*)(blocks[lane] + i * 4));
+				auto hi = _mm_loadu_si128((const __m128i*)(blocks[lane + 4] + i * 4));
+				w[i + lane] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			}
+
+			Transpose(w[i], w[i + 1], w[i + 2], w[i + 3]);
+		}
+
+		auto a = _mm256_loadu_si256((const __m256i*)(state + 0));
+		auto b = _mm256_loadu_si256((const __m256i*)(state + 8));
+		auto c = _mm256_loadu_si256((const __m256i*)(state + 16));
+		auto d = _mm256_loadu_si256((const __m256i*)(state + 24));
+
+		auto a0 = a;
+		auto b0 = b;
+		auto c0 = c;
+		auto d0 = d;
+
+		MD5_ROUNDS();
+
+		_mm256_storeu_si256((__m256i*)(state + 0), _mm256_add_epi32(a, a0));
+		_mm256_storeu_si256((__m256i*)(state + 8), _mm256_add_epi32(b, b0));
+		_mm256_storeu_si256((__m256i*)(state + 16), _mm256_add_epi32(c, c0));
+		_mm256_storeu_si256((__m256i*)(state + 24), _mm256_add_epi32(d, d0));
+	}
+#endif
+
+	Engine SelectEngine()
+	{
+#if defined(HL_CPU_X86)
+		const auto& features = HL::Cpu::GetFeatures();
+
+		if (features.avx2)
+			return { TransformAVX2, 8 };
+
+		if (features.sse2)
+			return { TransformSSE2, 4 };
+#endif
+		return { TransformScalar, 1 };
+	}
+
+	const Engine& GetEngine()
+	{
+		static const Engine engine = SelectEngine();
+		return engine;
+	}
+
+	// whole blocks of one context for this update
+	struct Stream
+	{
+		HL::MultiMD5::Context* context;
+		uint32_t* state;
+		const uint8_t* head; // buffer of context when it got full, goes first
+		const uint8_t* data;
+		size_t blocks;
+		const uint8_t* tail; // goes to buffer of context after all
+		size_t tail_size;
+
+		size_t remaining() const { return blocks + (head != nullptr ? 1 : 0); }
+
+		const uint8_t* next()
+		{
+			if (head != nullptr)
+				return std::exchange(head, nullptr);
+
+			blocks -= 1;
+			return std::exchange(data, data + 64);
+		}
+	};
+
+	// lane that runs out of blocks takes next stream, longest streams go
+	// first so lanes finish at about same time, and last stream that is left
+	// alone goes on without other lanes
+
+	void Process(std::vector<Stream>& streams)
+	{
+		const auto& engine = GetEngine();
+		const auto lanes = streams.size() > 1 ? engine.lanes : 1;
+		const auto transform = lanes > 1 ? engine.transform : TransformScalar;
+
+		std::stable_sort(streams.begin(), streams.end(), [](const Stream& a, const Stream& b) {
+			return a.remaining() > b.remaining();
+		});
+
+		uint32_t state[4 * MaxLanes];
+		const uint8_t* blocks[MaxLanes];
+		Stream* active[MaxLanes] = { };
+		size_t next = 0;
+
+		while (true)
+		{
+			size_t busy = 0;
+
+			for (size_t lane = 0; lane < lanes; lane++)
+			{
+				auto& stream = active[lane];
+
+				if (stream != nullptr && stream->remaining() == 0)
+				{
+					for (size_t row = 0; row < 4; row++)
+						stream->state[row] = state[row * lanes + lane];
+
+					stream = nullptr;
+				}
+
+				while (stream == nullptr && next < streams.size())
+				{
+					auto candidate = &streams[next++];
+
+					if (candidate->remaining() == 0)
+						continue;
+
+					for (size_t row = 0; row < 4; row++)
+						state[row * lanes + lane] = candidate->state[row];
+
+					stream = candidate;
+				}
+
+				if (stream != nullptr)
+					busy += 1;
+			}
+
+			if (busy == 0)
+				break;
+
+			if (busy == 1 && lanes > 1 && next == streams.size())
+			{
+				auto lane = (size_t)(std::find_if(active, active + lanes, [](auto s) { return s != nullptr; }) - active);
+				auto stream = active[lane];
+
+				for (size_t row = 0; row < 4; row++)
+					stream->state[row] = state[row * lanes + lane];
+
+				while (stream->remaining() > 0)
+				{
+					auto block = stream->next();
+					TransformScalar(stream->state, &block);
+				}
+
+				break;
+			}
+
+			for (size_t lane = 0; lane < lanes; lane++)
+				blocks[lane] = active[lane] != nullptr ? active[lane]->next() : ZeroBlock;
+
+			transform(state, blocks);
+		}
+	}
+}
+
+using namespace HL;
+
+MultiMD5::Context::Context()
+{
+	mState[0] = 0x67452301;
+	mState[1] = 0xefcdab89;
+	mState[2] = 0x98badcfe;
+	mState[3] = 0x10325476;
+}
+
+void MultiMD5::Context::update(const unsigned char* buf, size_type length)
+{
+	Input input = { this, buf, length };
+	Update({ &input, 1 });
+}
+
+void MultiMD5::Context::update(const char* buf, size_type length)
+{
+	update((const unsigned char*)buf, length);
+}
+
+MultiMD5::Context& MultiMD5::Context::finalize()
+{
+	Context* self = this;
+	Finalize({ &self, 1 });
+	return *this;
+}
+
+std::string MultiMD5::Context::hexdigest() const
+{
+	if (!mFinalized)
+		return "";
+
+	static const char hex[] = "0123456789abcdef";
+
+	std::string result(32, '0');
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		result[i * 2] = hex[mDigest[i] >> 4];
+		result[i * 2 + 1] = hex[mDigest[i] & 0x0F];
+	}
+
+	return result;
+}
+
+size_t MultiMD5::GetLanesCount()
+{
+	return GetEngine().lanes;
+}
+
+void MultiMD5::Update(std::span<const Input> inputs)
+{
+	std::vector<Stream> streams;
+	streams.reserve(inputs.size());
+
+	for (const auto& input : inputs)
+	{
+		auto context = input.context;
+		auto bytes = (const uint8_t*)input.data;
+		auto size = input.size;
+		auto index = (size_t)(context->mCount & 63);
+
+		context->mCount += size;
+
+		Stream stream = { context, context->mState, nullptr, nullptr, 0, nullptr, 0 };
+
+		if (index > 0)
+		{
+			auto fill = std::min(64 - index, size);
+			memcpy(context->mBuffer + index, bytes, fill);
+			bytes += fill;
+			size -= fill;
+
+			if (index + fill < 64)
+				continue;
+
+			stream.head = context->mBuffer;
+		}
+
+		stream.data = bytes;
+		stream.blocks = size / 64;
+		stream.tail = bytes + stream.blocks * 64;
+		stream.tail_size = size % 64;
+
+		streams.push_back(stream);
+	}
+
+	Process(streams);
+
+	for (const auto& stream : streams)
+	{
+		if (stream.tail_size > 0)
+			memcpy(stream.context->mBuffer, stream.tail, stream.tail_size);
+	}
+}
+
+void MultiMD5::Finalize(std::span<Context* const> contexts)
+{
+	// padding and bit count of every context, 1 or 2 last blocks
+
+	std::vector<std::array<uint8_t, 72>> paddings(contexts.size());
+	std::vector<Input> inputs;
+	inputs.reserve(contexts.size());
+
+	for (size_t i = 0; i < contexts.size(); i++)
+	{
+		auto context = contexts[i];
+
+		if (context->mFinalized)
+			continue;
+
+		auto& padding = paddings[i];
+		auto index = (size_t)(context->mCount & 63);
+		auto size = index < 56 ? 56 - index : 120 - index;
+		auto bits = context->mCount << 3;
+
+		padding.fill(0);
+		padding[0] = 0x80;
+
+		StoreLE(padding.data() + size, (uint32_t)bits);
+		StoreLE(padding.data() + size + 4, (uint32_t)(bits >> 32));
+
+		inputs.push_back({ context, padding.data(), size + 8 });
+	}
+
+	Update(inputs);
+
+	for (const auto& input : inputs)
+	{
+		auto context = input.context;
+
+		for (size_t i = 0; i < 4; i++)
+			StoreLE(context->mDigest.data() + i * 4, context->mState[i]);
+
+		context->mFinalized = true;
+	}
+}
+
+std::vector<MultiMD5::Digest> MultiMD5::Hash(std::span<const std::span<const uint8_t>> messages)
+{
+	std::vector<Context> contexts(messages.size());
+	std::vector<Input> inputs;
+	std::vector<Context*> pointers;
+
+	inputs.reserve(messages.size());
+	pointers.reserve(messages.size());
+
+	for (size_t i = 0; i < messages.size(); i++)
+	{
+		inputs.push_back({ &contexts[i], messages[i].data(), messages[i].size() });
+		pointers.push_back(&contexts[i]);
+	}
+
+	Update(inputs);
+	Finalize(pointers);
+
+	std::vector<Digest> result;
+	result.reserve(contexts.size());
+
+	for (const auto& context : contexts)
+		result.push_back(context.getDigest());
+
+	return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace HL
+{
+	// md5 of many independent messages at once, blocks of different messages
+	// go through simd lanes together (8 with avx2, 4 with sse2, else 1).
+	// every message has own context with same flow as MD5 class, contexts
+	// are fed one by one or in batches, only batches use lanes
+
+	class MultiMD5
+	{
+	public:
+		using Digest = std::array<uint8_t, 16>;
+
+		class Context
+		{
+			friend class MultiMD5;
+
+		public:
+			typedef unsigned int size_type;
+
+			Context();
+
+		public:
+			void update(const unsigned char* buf, size_type length);
+			void update(const char* buf, size_type length);
+			Context& finalize();
+			std::string hexdigest() const;
+
+			auto getdigest() const { return mDigest.data(); }
+			const auto& getDigest() const { return mDigest; }
+
+		private:
+			uint32_t mState[4];
+			uint64_t mCount = 0; // bytes
+			uint8_t mBuffer[64];
+			bool mFinalized = false;
+			Digest mDigest = { };
+		};
+
+		struct Input
+		{
+			Context* context = nullptr;
+			const void* data = nullptr;
+			size_t size = 0;
+		};
+
+	public:
+		static size_t GetLanesCount();
+
+		// same as update() of every input, contexts must be different
+		static void Update(std::span<const Input> inputs);
+		static void Finalize(std::span<Context* const> contexts);
+
+		static std::vector<Digest> Hash(std::span<const std::span<const uint8_t>> messages);
+	};
+}
@@ -7,8 +7,10 @@ using namespace HL;
 
 Networking::Networking(uint16_t port)
 {
-	mSocket = std::make_shared<Network::UdpSocket>(port);
+	mSocket = std::make_shared<Socket>(port);
 	mSocket->setReadCallback([this](Network::Packet& packet) { 
+		mTraffic.incoming_packets += 1;
+		mTraffic.incoming_bytes += packet.buf.getSize();
 		readPacket(packet); 
 	});
 }
@@ -48,29 +50,42 @@ void Networking::readSplitPacket(Network::Packet& packet)
 
 	Utils::dlog("index: {} ({}/{}), size: {}, data: \"{}\"", index, count + 1, total, packet.buf.getRemaining(), Common::Helpers::BytesArrayToNiceString(packet.buf.getPositionMemory(), packet.buf.getRemaining()));
 
-	std::shared_ptr<SplitBuffer> sb = nullptr;
+	mSplitBuffers.expire();
 
-	if (mSplitBuffers.contains(index))
-	{
-		sb = mSplitBuffers.at(index);
-	}
+	if (count >= total)
+		return;
 
-	if (sb == nullptr)
+	if (!isSplitSourceAllowed(packet.adr))
+		return;
+
+	auto key = SplitKey{ packet.adr.toString(), index };
+	auto sb = mSplitBuffers.find(key);
+
+	if (sb == nullptr || sb->frags.size() != total)
 	{
 		sb = std::make_shared<SplitBuffer>();
 		sb->frags.resize(total);
-		mSplitBuffers.insert({ index, sb });
+		mSplitBuffers.insert(key, sb);
 	}
 
-	sb->time = Clock::Now();
-
 	auto& frag = sb->frags[count];
 
+	if (frag.completed)
+		return;
+
 	// write fragment data to buffer
 
 	frag.buffer.write(packet.buf.getPositionMemory(), packet.buf.getRemaining());
 	frag.completed = true;
 
+	sb->bytes += frag.buffer.getSize();
+
+	if (!mSplitBuffers.touch(key, sb->bytes))
+	{
+		Utils::Log(Console::Color::Red, "split packet {} from {} dropped, out of memory budget", index, key.address);
+		return;
+	}
+
 	// check for completion
 
 	bool completed = std::all_of(sb->frags.begin(), sb->frags.end(), [](const auto& frag) {
@@ -96,25 +111,101 @@ void Networking::readSplitPacket(Network::Packet& packet)
 
 		// remove completed split buf
 
-		mSplitBuffers.erase(index);
+		mSplitBuffers.complete(key);
 	}
 }
 
 void Networking::sendPacket(Network::Packet& packet)
 {
+	mTraffic.outgoing_packets += 1;
+	mTraffic.outgoing_bytes += packet.buf.getSize();
 	mSocket->sendPacket(packet);
 }
 
+#if defined(__linux__) && defined(HL_BATCHED_UDP_SOCKET)
+void Networking::setSocketExternalFrames(bool value)
+{
+	mSocket->setExternalFrames(value);
+}
+
+void Networking::receivePackets()
+{
+	mSocket->receive();
+}
+
+void Networking::flushPackets()
+{
+	mSocket->flush();
+}
+#else
+void Networking::setSocketExternalFrames(bool)
+{
+	// not supported, see ExternalFramesSupported
+}
+
+void Networking::receivePackets()
+{
+}
+
+void Networking::flushPackets()
+{
+}
+#endif
+
 void Networking::sendConnectionlessPacket(Network::Packet& packet)
 {
-	Network::Packet pack; // TODO: make split packet if buf.size too large
+	Utils::dlog(Common::Helpers::BytesArrayToNiceString(packet.buf.getMemory(), packet.buf.getSize()));
+
+	auto& pack = mConnectionlessPacket;
 
 	pack.adr = packet.adr;
+	pack.buf.clear();
 	pack.buf.write<int32_t>(-1);
+	pack.buf.write(packet.buf.getMemory(), packet.buf.getSize());
+
+	if (pack.buf.getSize() <= mSplitSize)
+	{
+		sendPacket(pack);
+		return;
+	}
 
-	sky::bitbuffer_helpers::WriteToBuffer(packet.buf, pack.buf);
+	sendSplitPacket(pack);
+}
 
-	Utils::dlog(Common::Helpers::BytesArrayToNiceString(packet.buf.getMemory(), packet.buf.getSize()));
+void Networking::sendSplitPacket(Network::Packet& packet)
+{
+	// -2, int32 id, 4 bits total, 4 bits index, then part of whole packet (with its -1 header)
+
+	const size_t header_size = 9;
 
-	mSocket->sendPacket(pack);
-}
\ No newline at end of file
+	auto part_size = mSplitSize - header_size;
+	auto size = packet.buf.getSize();
+	auto total = (size + part_size - 1) / part_size;
+
+	if (total > MaxSplitParts)
+	{
+		Utils::Log(Console::Color::Red, "connectionless packet is too large to split ({} bytes)", size);
+		return;
+	}
+
+	auto id = mSplitSequence++;
+	auto data = (const uint8_t*)packet.buf.getMemory();
+
+	auto& part = mSplitPacket;
+
+	part.adr = packet.adr;
+
+	for (size_t i = 0; i < total; i++)
+	{
+		auto offset = i * part_size;
+
+		part.buf.clear();
+		part.buf.write<int32_t>(-2);
+		part.buf.write<int32_t>(id);
+		part.buf.writeBits(static_cast<uint32_t>(total), 4);
+		part.buf.writeBits(static_cast<uint32_t>(i), 4);
+		part.buf.write((void*)(data + offset), std::min(part_size, size - offset));
+
+		sendPacket(part);
+	}
+}
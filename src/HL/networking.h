@@ -3,7 +3,9 @@
 #include <core/engine.h>
 #include <network/system.h>
 #include <common/bitbuffer.h>
-#include <map>
+#include "reassembly_cache.h"
+#include "batched_udp_socket.h"
+#include <string>
 
 namespace HL
 {
@@ -16,19 +18,70 @@ namespace HL
 		virtual void readConnectionlessPacket(Network::Packet& packet) = 0;
 		virtual void readRegularPacket(Network::Packet& packet) = 0;
 
+		// parts of split packets from other addresses are dropped before reassembly
+		virtual bool isSplitSourceAllowed(const Network::Address&) const { return true; }
+
+	protected:
+		void readPacket(Network::Packet& packet); // datagram from socket, may be a part of split packet
+
 	private:
-		void readPacket(Network::Packet& packet);
 		void readSplitPacket(Network::Packet& packet);
 
 	protected:
-		void sendPacket(Network::Packet& packet);
+		virtual void sendPacket(Network::Packet& packet); // every datagram goes to socket through here
 		void sendConnectionlessPacket(Network::Packet& packet);
 
+	private:
+		void sendSplitPacket(Network::Packet& packet);
+
+	public:
+		static const size_t MaxSplitParts = 15; // total is sent in 4 bits
+
+		auto getSplitSize() const { return mSplitSize; }
+		void setSplitSize(size_t value) { mSplitSize = std::max<size_t>(value, 64); }
+
+	private:
+		size_t mSplitSize = 1400; // largest connectionless datagram we send without splitting
+		int32_t mSplitSequence = 1;
+		Network::Packet mConnectionlessPacket;
+		Network::Packet mSplitPacket;
+
+	public:
+#if defined(__linux__) && defined(HL_BATCHED_UDP_SOCKET)
+		using Socket = BatchedUdpSocket;
+		static const bool ExternalFramesSupported = true;
+#else
+		using Socket = Network::UdpSocket;
+		static const bool ExternalFramesSupported = false; // packets come from network system on frame thread
+#endif
+
 	protected:
 		auto getSocket() { return mSocket; }
 
+		// with external frames socket is polled by receivePackets() and
+		// flushPackets() instead of frame system, on any thread
+
+		void setSocketExternalFrames(bool value);
+		void receivePackets();
+		void flushPackets();
+
+	private:
+		std::shared_ptr<Socket> mSocket;
+
+	public:
+		struct Traffic
+		{
+			uint64_t incoming_packets = 0;
+			uint64_t incoming_bytes = 0;
+			uint64_t outgoing_packets = 0;
+			uint64_t outgoing_bytes = 0;
+		};
+
+	public:
+		const auto& getTraffic() const { return mTraffic; }
+
 	private:
-		std::shared_ptr<Network::UdpSocket> mSocket;
+		Traffic mTraffic;
 
 	private:
 		struct Fragment
@@ -41,8 +94,32 @@ namespace HL
 		{
 			Clock::TimePoint time;
 			std::vector<Fragment> frags;
+			size_t bytes = 0;
 		};
 
-		std::map<int32_t, std::shared_ptr<SplitBuffer>> mSplitBuffers;
+		// split id is chosen by sender, so two servers can use the same one
+
+		struct SplitKey
+		{
+			std::string address;
+			int32_t index = 0;
+
+			auto operator<=>(const SplitKey&) const = default;
+		};
+
+	public:
+		using SplitBuffers = ReassemblyCache<SplitKey, SplitBuffer>;
+
+		static constexpr size_t DefaultSplitBudget = 256 * 1024;
+		static constexpr size_t MaxSplitPacketSize = MaxSplitParts * 1400; // largest reassembled reply we expect
+
+	public:
+		const auto& getSplitBuffers() const { return mSplitBuffers; }
+
+		auto getSplitBudget() const { return mSplitBuffers.getBudget(); }
+		void setSplitBudget(size_t value) { mSplitBuffers.setBudget(value); }
+
+	private:
+		SplitBuffers mSplitBuffers = SplitBuffers(DefaultSplitBudget, Clock::FromSeconds(5.0f));
 	};
 }
\ No newline at end of file
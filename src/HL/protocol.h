@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
 #include <glm/glm.hpp>
 
 namespace HL::Protocol
@@ -146,6 +147,10 @@ namespace HL::Protocol
 		int flags;
 		uint8_t hash[16];
 		uint8_t reserved[32];
+
+		// filled by client when resource list is received
+		std::string short_name; // without directory and extension, "*n" for brush models
+		bool brush = false; // "*n", inline model of the world
 	};
 
 	struct GameMessage
@@ -227,6 +232,39 @@ namespace HL::Protocol
 		UserTracer = 127      // Larger message than the standard tracer, but allows some customization.
 	};
 
+	static const int MAX_EDICTS = 2048; // entity index is 11 bits
+	static const int MAX_EXTRA_BASELINES = 64; // 6 bits
+
+	// groups of fields changed by last delta update, delta tables differ between
+	// servers and entity types, so masks are given in terms of our structs
+
+	static const uint32_t ENTITY_FIELD_ORIGIN = 1 << 0;
+	static const uint32_t ENTITY_FIELD_ANGLES = 1 << 1;
+	static const uint32_t ENTITY_FIELD_MODEL = 1 << 2; // modelindex, skin, body, colormap, scale
+	static const uint32_t ENTITY_FIELD_ANIMATION = 1 << 3; // sequence, frame, controllers, blending
+	static const uint32_t ENTITY_FIELD_RENDER = 1 << 4; // render*, effects, eflags
+	static const uint32_t ENTITY_FIELD_VELOCITY = 1 << 5;
+	static const uint32_t ENTITY_FIELD_BBOX = 1 << 6; // mins, maxs, solid, usehull
+	static const uint32_t ENTITY_FIELD_MOVEMENT = 1 << 7; // movetype, owner, aiment, friction, gravity, onground
+	static const uint32_t ENTITY_FIELD_PLAYER = 1 << 8; // team, playerclass, health, spectator
+	static const uint32_t ENTITY_FIELD_WEAPON = 1 << 9;
+	static const uint32_t ENTITY_FIELD_PARAMETRIC = 1 << 10; // startpos, endpos, impacttime, starttime
+	static const uint32_t ENTITY_FIELD_USER = 1 << 11; // iuser, fuser, vuser
+	static const uint32_t ENTITY_FIELD_ALL = 0xFFFFFFFF;
+
+	static const uint32_t CLIENTDATA_FIELD_ORIGIN = 1 << 0;
+	static const uint32_t CLIENTDATA_FIELD_VELOCITY = 1 << 1;
+	static const uint32_t CLIENTDATA_FIELD_VIEW = 1 << 2; // viewmodel, punchangle, view_ofs, fov, weaponanim
+	static const uint32_t CLIENTDATA_FIELD_HEALTH = 1 << 3; // health, deadflag
+	static const uint32_t CLIENTDATA_FIELD_WEAPONS = 1 << 4; // weapons, m_iId, ammo, m_flNextAttack
+	static const uint32_t CLIENTDATA_FIELD_MOVEMENT = 1 << 5; // flags, water, duck, maxspeed, physinfo
+	static const uint32_t CLIENTDATA_FIELD_USER = 1 << 6;
+
+	static const uint32_t WEAPONDATA_FIELD_CLIP = 1 << 0; // m_iId, m_iClip
+	static const uint32_t WEAPONDATA_FIELD_TIMERS = 1 << 1; // next attack, idle, reload times
+	static const uint32_t WEAPONDATA_FIELD_STATE = 1 << 2; // reload, zoom, weapon state
+	static const uint32_t WEAPONDATA_FIELD_USER = 1 << 3;
+
 	enum class EntityType
 	{
 		Normal = 1 << 0,
@@ -245,6 +283,10 @@ namespace HL::Protocol
 		// Message number last time the player/entity state was updated.
 		int messagenum;
 
+		// filled by client, fields of last delta update and incoming sequence it came in
+		uint32_t changed_fields = 0;
+		uint32_t changed_tick = 0;
+
 		// Fields which can be transitted and reconstructed over the network stream
 		glm::vec3 origin;
 		glm::vec3 angles;
@@ -372,6 +414,9 @@ namespace HL::Protocol
 		glm::vec3 vuser2;
 		glm::vec3 vuser3;
 		glm::vec3 vuser4;
+
+		uint32_t changed_fields = 0; // filled by client, see Entity
+		uint32_t changed_tick = 0;
 	};
 
 	struct WeaponData
@@ -402,6 +447,9 @@ namespace HL::Protocol
 		float		fuser2;
 		float		fuser3;
 		float		fuser4;
+
+		uint32_t	changed_fields = 0; // filled by client, see Entity
+		uint32_t	changed_tick = 0;
 	};
 
 
@@ -529,6 +577,34 @@ namespace HL::Protocol
 		bool vac2 = false;
 	};
 
+	// connectionless query replies (A2S_INFO, A2S_PLAYER)
+
+	struct QueryInfo
+	{
+		uint8_t protocol = 0;
+		std::string name;
+		std::string map;
+		std::string folder;
+		std::string game;
+		uint16_t app_id = 0;
+		uint8_t players = 0;
+		uint8_t max_players = 0;
+		uint8_t bots = 0;
+		char type = 0; // 'd' dedicated, 'l' listen, 'p' proxy
+		char environment = 0; // 'l' linux, 'w' windows, 'm' mac
+		bool password = false;
+		bool vac = false;
+		std::string version;
+	};
+
+	struct QueryPlayer
+	{
+		uint8_t index = 0;
+		std::string name;
+		int32_t score = 0;
+		float duration = 0.0f;
+	};
+
 	struct MoveVars
 	{
 		float gravity = 0.0f;
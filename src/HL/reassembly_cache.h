@@ -0,0 +1,174 @@
+#pragma once
+
+#include <core/engine.h>
+#include <list>
+#include <map>
+
+namespace HL
+{
+	// keeps incomplete split packets and fragment streams of one connection,
+	// drops them when they stay untouched for too long or when the connection
+	// holds more bytes than its budget (least recently touched go first).
+	// T must have "Clock::TimePoint time" member
+
+	template <typename Key, typename T>
+	class ReassemblyCache
+	{
+	public:
+		struct Counters
+		{
+			uint64_t created = 0;
+			uint64_t completed = 0;
+			uint64_t timed_out = 0;
+			uint64_t evicted = 0;
+		};
+
+	public:
+		ReassemblyCache(size_t budget, Clock::Duration timeout) :
+			mBudget(budget),
+			mTimeout(timeout)
+		{
+		}
+
+	public:
+		std::shared_ptr<T> find(const Key& key) const
+		{
+			auto it = mEntries.find(key);
+
+			if (it == mEntries.end())
+				return nullptr;
+
+			return it->second.value;
+		}
+
+		void insert(const Key& key, std::shared_ptr<T> value)
+		{
+			remove(key);
+			mOrder.push_front(key);
+			mEntries.insert({ key, Entry{ value, 0, mOrder.begin() } });
+			mCounters.created += 1;
+		}
+
+		// marks entry as just used and updates its size, returns false if entry
+		// itself does not fit into the budget and was dropped
+
+		bool touch(const Key& key, size_t bytes)
+		{
+			auto it = mEntries.find(key);
+
+			if (it == mEntries.end())
+				return false;
+
+			auto& entry = it->second;
+
+			entry.value->time = Clock::Now();
+			mBytes = mBytes - entry.bytes + bytes;
+			entry.bytes = bytes;
+			mOrder.splice(mOrder.begin(), mOrder, entry.order);
+
+			while (mBytes > mBudget)
+			{
+				auto last = mOrder.back();
+
+				evict(last);
+				mCounters.evicted += 1;
+
+				if (last == key)
+					return false;
+			}
+
+			return true;
+		}
+
+		void complete(const Key& key)
+		{
+			if (!mEntries.contains(key))
+				return;
+
+			evict(key);
+			mCounters.completed += 1;
+		}
+
+		void remove(const Key& key)
+		{
+			if (!mEntries.contains(key))
+				return;
+
+			evict(key);
+		}
+
+		void expire()
+		{
+			// order list is sorted by touch time, so oldest entries are at the back
+
+			auto now = Clock::Now();
+
+			while (!mOrder.empty())
+			{
+				auto last = mOrder.back();
+
+				if (now - mEntries.at(last).value->time < mTimeout)
+					break;
+
+				evict(last);
+				mCounters.timed_out += 1;
+			}
+		}
+
+		void clear()
+		{
+			mEntries.clear();
+			mOrder.clear();
+			mBytes = 0;
+		}
+
+	private:
+		void evict(const Key& key)
+		{
+			auto it = mEntries.find(key);
+			mBytes -= it->second.bytes;
+			mOrder.erase(it->second.order);
+			mEntries.erase(it);
+		}
+
+	public:
+		auto size() const { return mEntries.size(); }
+		auto getBytes() const { return mBytes; }
+		const auto& getCounters() const { return mCounters; }
+
+		// bytes that entry can take without pushing other entries out
+
+		size_t getAvailable(const Key& key) const
+		{
+			auto it = mEntries.find(key);
+			auto own = it != mEntries.end() ? it->second.bytes : 0;
+			auto others = mBytes - own;
+
+			return others < mBudget ? mBudget - others : 0;
+		}
+
+		auto getBudget() const { return mBudget; }
+		void setBudget(size_t value) { mBudget = value; }
+
+		auto getTimeout() const { return mTimeout; }
+		void setTimeout(Clock::Duration value) { mTimeout = value; }
+
+		auto begin() const { return mEntries.begin(); }
+		auto end() const { return mEntries.end(); }
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<T> value;
+			size_t bytes = 0;
+			typename std::list<Key>::iterator order;
+		};
+
+		std::map<Key, Entry> mEntries;
+		std::list<Key> mOrder;
+		size_t mBytes = 0;
+		size_t mBudget;
+		Clock::Duration mTimeout;
+		Counters mCounters;
+	};
+}
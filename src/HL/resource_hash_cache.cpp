@@ -0,0 +1,176 @@
+#include "resource_hash_cache.h"
+#include "md5.h"
+#include "encoder.h"
+
+#include <core/engine.h>
+#include <platform/asset.h>
+#include <fmt/format.h>
+#include <charconv>
+#include <sstream>
+#include "utils.h"
+
+using namespace HL;
+
+ResourceHashCache::ResourceHashCache(const std::string& path) :
+	mPath(path),
+	mWorkers(std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 5) - 1)
+{
+	load();
+}
+
+std::shared_ptr<ResourceHashCache> ResourceHashCache::GetShared()
+{
+	static auto instance = std::make_shared<ResourceHashCache>();
+	return instance;
+}
+
+void ResourceHashCache::prefetch(const std::string& path)
+{
+	std::lock_guard lock(mMutex);
+	post(path);
+}
+
+void ResourceHashCache::post(const std::string& path)
+{
+	if (mPending.contains(path))
+		return;
+
+	std::optional<Entry> cached;
+
+	if (auto it = mEntries.find(path); it != mEntries.end())
+		cached = it->second;
+
+	mPending.insert({ path, mWorkers.post([path, cached] { return Hash(path, cached); }) });
+}
+
+std::optional<ResourceHashCache::Digest> ResourceHashCache::get(const std::string& path)
+{
+	std::unique_lock lock(mMutex);
+
+	post(path);
+
+	auto node = mPending.extract(path);
+
+	// other threads can prefetch and get while this one waits for hashing
+
+	lock.unlock();
+	auto entry = node.mapped().get();
+	lock.lock();
+
+	if (!entry.has_value())
+		return std::nullopt;
+
+	auto it = mEntries.find(path);
+
+	if (it == mEntries.end() || it->second.stamp != entry->stamp)
+	{
+		mEntries.insert_or_assign(path, entry.value());
+		mDirty = true;
+	}
+
+	return entry->digest;
+}
+
+std::optional<ResourceHashCache::Entry> ResourceHashCache::Hash(const std::string& path, std::optional<Entry> cached)
+{
+	try
+	{
+		auto asset = Platform::Asset(path, HL_ASSET_STORAGE);
+		auto memory = (uint8_t*)asset.getMemory();
+		auto size = asset.getSize();
+
+		Encoder::CRC32_t crc;
+		Encoder::CRC32_Init(&crc);
+
+		for (size_t offset = 0; offset < size; )
+		{
+			auto chunk = std::min<size_t>(size - offset, 1 << 30);
+			Encoder::CRC32_ProcessBuffer(&crc, memory + offset, static_cast<int>(chunk));
+			offset += chunk;
+		}
+
+		Entry result;
+		result.stamp = Stamp{ static_cast<uint64_t>(size), Encoder::CRC32_Final(crc) };
+
+		if (cached.has_value() && cached->stamp == result.stamp)
+			return cached;
+
+		MD5 md5;
+		md5.update(memory, static_cast<MD5::size_type>(size));
+		md5.finalize();
+
+		memcpy(result.digest.data(), md5.getdigest(), result.digest.size());
+		return result;
+	}
+	catch (const std::exception&)
+	{
+		return std::nullopt;
+	}
+}
+
+void ResourceHashCache::load()
+{
+	if (!Platform::Asset::Exists(mPath, HL_ASSET_STORAGE))
+		return;
+
+	auto asset = Platform::Asset(mPath, HL_ASSET_STORAGE);
+	auto text = std::string((const char*)asset.getMemory(), asset.getSize());
+	auto stream = std::istringstream(text);
+
+	// size crc32 md5 path
+
+	std::string line;
+
+	while (std::getline(stream, line))
+	{
+		std::istringstream fields(line);
+
+		Entry entry;
+		std::string hex;
+
+		if (!(fields >> entry.stamp.size >> entry.stamp.crc >> hex) || hex.size() != entry.digest.size() * 2)
+			continue;
+
+		bool valid = true;
+
+		for (size_t i = 0; i < entry.digest.size(); i++)
+		{
+			auto begin = hex.data() + i * 2;
+			valid = valid && std::from_chars(begin, begin + 2, entry.digest[i], 16).ec == std::errc();
+		}
+
+		if (!valid)
+			continue;
+
+		std::string path;
+		std::getline(fields >> std::ws, path);
+
+		if (!path.empty())
+			mEntries.insert_or_assign(path, entry);
+	}
+
+	sky::Log("{} resource hashes loaded", mEntries.size());
+}
+
+void ResourceHashCache::save()
+{
+	std::lock_guard lock(mMutex);
+
+	if (!mDirty)
+		return;
+
+	std::string text;
+
+	for (const auto& [path, entry] : mEntries)
+	{
+		std::string hex;
+
+		for (auto byte : entry.digest)
+			hex += fmt::format("{:02x}", byte);
+
+		text += fmt::format("{} {} {} {}\n", entry.stamp.size, entry.stamp.crc, hex, path);
+	}
+
+	Platform::Asset::Write(mPath, text.data(), text.size(), HL_ASSET_STORAGE);
+	mDirty = false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "worker_pool.h"
+#include <array>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace HL
+{
+	// md5 of local resource files for clc_fileconsistency, remembered between
+	// runs by path, size and crc32 of content. files are read through the same
+	// asset storage they are checked and written with, and are read and hashed
+	// on worker threads as soon as resource list is known, so reply waits only
+	// for files that are not ready yet. crc32 is much cheaper than md5, so md5
+	// is computed only for new and changed files. clients of ClientSwarm share
+	// it from several threads, so every call takes a lock
+
+	class ResourceHashCache
+	{
+	public:
+		using Digest = std::array<uint8_t, 16>;
+
+		static inline const std::string DefaultPath = "resource_hashes.txt";
+
+	public:
+		ResourceHashCache(const std::string& path = DefaultPath);
+
+		static std::shared_ptr<ResourceHashCache> GetShared(); // one for all clients of process
+
+	public:
+		void prefetch(const std::string& path); // starts reading and hashing
+		std::optional<Digest> get(const std::string& path); // waits for hashing when needed
+		void save(); // does nothing when nothing changed
+
+	private:
+		struct Stamp
+		{
+			uint64_t size = 0;
+			uint32_t crc = 0;
+
+			bool operator==(const Stamp&) const = default;
+		};
+
+		struct Entry
+		{
+			Stamp stamp;
+			Digest digest;
+		};
+
+		// cached entry is passed in, so md5 is skipped when stamp is the same
+		static std::optional<Entry> Hash(const std::string& path, std::optional<Entry> cached);
+
+		void load();
+		void post(const std::string& path); // under lock
+
+	private:
+		std::string mPath;
+		std::unordered_map<std::string, Entry> mEntries;
+		std::unordered_map<std::string, std::future<std::optional<Entry>>> mPending;
+		bool mDirty = false;
+		std::mutex mMutex;
+		WorkerPool mWorkers;
+	};
+}
@@ -0,0 +1,110 @@
+#include "resource_registry.h"
+
+using namespace HL;
+
+void ResourceRegistry::assign(std::vector<Protocol::Resource>&& resources)
+{
+	clear();
+
+	mResources = std::move(resources);
+	mByName.reserve(mResources.size());
+
+	for (size_t i = 0; i < mResources.size(); i++)
+	{
+		auto& resource = mResources[i];
+		auto position = static_cast<int32_t>(i);
+
+		std::string_view name = resource.name;
+
+		resource.brush = resource.type == Protocol::Resource::Type::Model && name.starts_with("*");
+
+		if (resource.brush)
+		{
+			resource.short_name = resource.name;
+		}
+		else
+		{
+			auto slash = name.find_last_of("/\\");
+
+			if (slash != std::string_view::npos)
+				name.remove_prefix(slash + 1);
+
+			auto dot = name.find_last_of('.');
+
+			if (dot != std::string_view::npos && dot > 0)
+				name = name.substr(0, dot);
+
+			resource.short_name = name;
+		}
+
+		auto type = static_cast<size_t>(resource.type);
+
+		if (type < TypesCount && resource.index >= 0)
+		{
+			auto& table = mByIndex[type];
+
+			if (table.size() <= static_cast<size_t>(resource.index))
+				table.resize(resource.index + 1, -1);
+
+			table[resource.index] = position;
+		}
+
+		// first one wins on duplicate names, find() checks name on hash collision
+
+		mByName.try_emplace(HashName(resource.name), position);
+	}
+}
+
+void ResourceRegistry::clear()
+{
+	mResources.clear();
+	mByName.clear();
+
+	for (auto& table : mByIndex)
+		table.clear();
+}
+
+const Protocol::Resource* ResourceRegistry::find(Protocol::Resource::Type type, int index) const
+{
+	auto t = static_cast<size_t>(type);
+
+	if (t >= TypesCount || index < 0)
+		return nullptr;
+
+	const auto& table = mByIndex[t];
+
+	if (static_cast<size_t>(index) >= table.size() || table[index] < 0)
+		return nullptr;
+
+	return &mResources[table[index]];
+}
+
+const Protocol::Resource* ResourceRegistry::find(std::string_view name) const
+{
+	auto it = mByName.find(HashName(name));
+
+	if (it == mByName.end())
+		return nullptr;
+
+	const auto& resource = mResources[it->second];
+
+	if (resource.name != name)
+		return nullptr;
+
+	return &resource;
+}
+
+uint64_t ResourceRegistry::HashName(std::string_view name)
+{
+	// fnv-1a
+
+	uint64_t result = 14695981039346656037ULL;
+
+	for (auto c : name)
+	{
+		result ^= static_cast<uint8_t>(c);
+		result *= 1099511628211ULL;
+	}
+
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "protocol.h"
+#include <array>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace HL
+{
+	// resources of svc_resourcelist, indexed once when list is received, so
+	// lookups by (type, index) and by name need no scans, pointers stay valid
+	// until next list
+
+	class ResourceRegistry
+	{
+		static constexpr size_t TypesCount = static_cast<size_t>(Protocol::Resource::Type::World) + 1;
+
+	public:
+		void assign(std::vector<Protocol::Resource>&& resources);
+		void clear();
+
+		const Protocol::Resource* find(Protocol::Resource::Type type, int index) const;
+		const Protocol::Resource* find(std::string_view name) const;
+		const Protocol::Resource* findModel(int index) const { return find(Protocol::Resource::Type::Model, index); }
+
+		static uint64_t HashName(std::string_view name);
+
+	public:
+		auto size() const { return mResources.size(); }
+		bool empty() const { return mResources.empty(); }
+		const auto& operator[](size_t position) const { return mResources[position]; }
+		auto begin() const { return mResources.cbegin(); }
+		auto end() const { return mResources.cend(); }
+
+	private:
+		std::vector<Protocol::Resource> mResources;
+		std::array<std::vector<int32_t>, TypesCount> mByIndex; // position in mResources or -1
+		std::unordered_map<uint64_t, int32_t> mByName;
+	};
+}
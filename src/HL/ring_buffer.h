@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+
+namespace HL
+{
+	// fifo over a vector of slots, popped slots are not destroyed,
+	// so objects with own storage (buffers) are reused by next push
+
+	template <typename T>
+	class RingBuffer
+	{
+	public:
+		RingBuffer(size_t capacity = 16)
+		{
+			mSlots.resize(std::max<size_t>(capacity, 1));
+		}
+
+	public:
+		T& push_back()
+		{
+			if (mSize == mSlots.size())
+				grow();
+
+			auto& result = mSlots[(mHead + mSize) % mSlots.size()];
+			mSize += 1;
+			return result;
+		}
+
+		// popping empty ring is a bug of caller, but it must not wrap size
+		// and expose stale slots in release builds
+
+		void pop_front()
+		{
+			assert(mSize > 0);
+
+			if (mSize == 0)
+				return;
+
+			mHead = (mHead + 1) % mSlots.size();
+			mSize -= 1;
+		}
+
+		void pop_back()
+		{
+			assert(mSize > 0);
+
+			if (mSize == 0)
+				return;
+
+			mSize -= 1;
+		}
+
+		void clear()
+		{
+			mHead = 0;
+			mSize = 0;
+		}
+
+		T& front() { return (*this)[0]; }
+		const T& front() const { return (*this)[0]; }
+
+		T& back() { return (*this)[mSize - 1]; }
+		const T& back() const { return (*this)[mSize - 1]; }
+
+		T& operator[](size_t index)
+		{
+			assert(index < mSize);
+			return mSlots[(mHead + index) % mSlots.size()];
+		}
+
+		const T& operator[](size_t index) const
+		{
+			assert(index < mSize);
+			return mSlots[(mHead + index) % mSlots.size()];
+		}
+
+	private:
+		void grow()
+		{
+			std::vector<T> slots(mSlots.size() * 2);
+
+			for (size_t i = 0; i < mSize; i++)
+			{
+				std::swap(slots[i], (*this)[i]);
+			}
+
+			// keep storage of free slots too
+
+			for (size_t i = mSize; i < mSlots.size(); i++)
+			{
+				std::swap(slots[i], mSlots[(mHead + i) % mSlots.size()]);
+			}
+
+			mSlots = std::move(slots);
+			mHead = 0;
+		}
+
+	public:
+		auto size() const { return mSize; }
+		auto empty() const { return mSize == 0; }
+		auto capacity() const { return mSlots.size(); }
+
+	private:
+		std::vector<T> mSlots;
+		size_t mHead = 0;
+		size_t mSize = 0;
+	};
+}
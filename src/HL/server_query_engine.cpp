@@ -0,0 +1,411 @@
+#include "server_query_engine.h"
+#include "utils.h"
+#include <common/buffer_helpers.h>
+
+using namespace HL;
+
+ServerQueryEngine::ServerQueryEngine(uint16_t port) : Networking(port)
+{
+}
+
+void ServerQueryEngine::onFrame()
+{
+	if (mExternalFrames)
+		return;
+
+	update();
+}
+
+void ServerQueryEngine::frame()
+{
+	receivePackets();
+	update();
+	flushPackets();
+}
+
+void ServerQueryEngine::setExternalFrames(bool value)
+{
+	mExternalFrames = value;
+	setSocketExternalFrames(value);
+}
+
+void ServerQueryEngine::update()
+{
+	checkTimeouts();
+	sendRequests();
+
+	// every server in progress can have its split reply in reassembly at the same time
+
+	setSplitBudget(std::max(DefaultSplitBudget, mTargets.size() * MaxSplitPacketSize));
+
+	STATS_INDICATE_GROUP("query", "active", mTargets.size());
+	STATS_INDICATE_GROUP("query", "queued", mSendQueue.size());
+}
+
+void ServerQueryEngine::query(const Network::Address& address, uint8_t queries, ResultCallback callback)
+{
+	auto key = address.toString();
+
+	if (mCache.contains(key))
+	{
+		const auto& cached = mCache.at(key);
+
+		if (Clock::Now() - cached.time < mCacheTTL && (cached.completed & queries) == queries)
+		{
+			mStats.cache_hits += 1;
+			callback(cached);
+			return;
+		}
+	}
+
+	mStats.queued += 1;
+
+	if (mTargets.contains(key))
+	{
+		// already in progress, just extend it
+
+		auto& target = mTargets.at(key);
+		target.result.queries |= queries;
+
+		auto prev_callback = target.callback;
+		target.callback = [prev_callback, callback](const Result& result) {
+			prev_callback(result);
+			callback(result);
+		};
+		return;
+	}
+
+	auto& target = mTargets[key];
+	target.result.address = address;
+	target.result.queries = queries;
+	target.callback = callback;
+	target.start_time = Clock::Now();
+
+	advance(key, target);
+}
+
+void ServerQueryEngine::clearCache()
+{
+	mCache.clear();
+}
+
+void ServerQueryEngine::enqueue(const std::string& key, Target& target)
+{
+	target.waiting = false;
+
+	if (target.queued)
+		return;
+
+	target.queued = true;
+	mSendQueue.push_back(key);
+}
+
+void ServerQueryEngine::advance(const std::string& key, Target& target)
+{
+	uint8_t left = target.result.queries & ~target.done;
+
+	if (left != 0)
+	{
+		target.current = static_cast<Query>(left & -left); // lowest bit, so info goes first
+		target.attempts = 0;
+		enqueue(key, target);
+		return;
+	}
+
+	// done, callback can start new queries, so take everything out of the map first
+
+	auto result = std::move(target.result);
+	auto callback = std::move(target.callback);
+
+	mTargets.erase(key);
+
+	result.time = Clock::Now();
+
+	if (result.isTimedOut())
+		mStats.timed_out += 1;
+	else
+		mStats.completed += 1;
+
+	if (result.completed != 0)
+		mCache.insert_or_assign(key, result);
+
+	if (callback)
+		callback(result);
+}
+
+void ServerQueryEngine::sendRequests()
+{
+	auto now = Clock::Now();
+
+	// global packets per second limit, allow a burst of 1/10 of a second
+
+	auto elapsed = Clock::ToSeconds(now - mSendTokensTime);
+	auto max_tokens = std::max(static_cast<float>(mPacketsPerSecond) / 10.0f, 1.0f);
+
+	mSendTokens = std::min(mSendTokens + elapsed * static_cast<float>(mPacketsPerSecond), max_tokens);
+	mSendTokensTime = now;
+
+	while (!mSendQueue.empty() && mSendTokens >= 1.0f)
+	{
+		auto key = std::move(mSendQueue.front());
+		mSendQueue.pop_front();
+
+		if (!mTargets.contains(key))
+			continue;
+
+		auto& target = mTargets.at(key);
+
+		if (!target.queued)
+			continue;
+
+		target.queued = false;
+
+		sendRequest(target);
+
+		mSendTokens -= 1.0f;
+	}
+}
+
+void ServerQueryEngine::sendRequest(Target& target)
+{
+	Network::Packet packet;
+	packet.adr = target.result.address;
+
+	switch (target.current)
+	{
+	case Query::Info:
+		packet.buf.write<uint8_t>((uint8_t)Protocol::Client::ConnectionlessPacket::Info);
+		sky::bitbuffer_helpers::WriteString(packet.buf, "Source Engine Query");
+
+		if (target.challenge != -1)
+			packet.buf.write<int32_t>(target.challenge);
+
+		break;
+
+	case Query::Players:
+		packet.buf.write<uint8_t>((uint8_t)Protocol::Client::ConnectionlessPacket::Players);
+		packet.buf.write<int32_t>(target.challenge);
+		break;
+
+	case Query::Rules:
+		packet.buf.write<uint8_t>((uint8_t)Protocol::Client::ConnectionlessPacket::Rules);
+		packet.buf.write<int32_t>(target.challenge);
+		break;
+
+	default:
+		break;
+	}
+
+	sendConnectionlessPacket(packet);
+
+	target.waiting = true;
+	target.attempts += 1;
+	target.send_time = Clock::Now();
+
+	mStats.packets_sent += 1;
+}
+
+void ServerQueryEngine::checkTimeouts()
+{
+	auto now = Clock::Now();
+
+	std::vector<std::string> expired;
+
+	for (auto& [key, target] : mTargets)
+	{
+		if (!target.waiting || now - target.send_time < mTimeout)
+			continue;
+
+		if (target.attempts <= mRetries)
+		{
+			mStats.retries += 1;
+			enqueue(key, target);
+			continue;
+		}
+
+		expired.push_back(key);
+	}
+
+	// give up current query of these targets, but still try next ones
+
+	for (const auto& key : expired)
+	{
+		if (!mTargets.contains(key))
+			continue;
+
+		auto& target = mTargets.at(key);
+		target.done |= target.current;
+		advance(key, target);
+	}
+}
+
+bool ServerQueryEngine::isSplitSourceAllowed(const Network::Address& address) const
+{
+	return mTargets.contains(address.toString());
+}
+
+void ServerQueryEngine::readConnectionlessPacket(Network::Packet& packet)
+{
+	mStats.packets_received += 1;
+
+	auto key = packet.adr.toString();
+
+	if (!mTargets.contains(key))
+	{
+		mStats.unexpected_packets += 1;
+		return;
+	}
+
+	auto& target = mTargets.at(key);
+	auto type = static_cast<Protocol::Server::ConnectionlessPacket>(packet.buf.read<uint8_t>());
+
+	Query answered = Query::Info;
+
+	try
+	{
+		switch (type)
+		{
+		case Protocol::Server::ConnectionlessPacket::Challenge:
+			if (!target.waiting)
+				return;
+
+			readChallenge(target, packet.buf);
+			enqueue(key, target); // ask again with challenge
+			return;
+
+		case Protocol::Server::ConnectionlessPacket::Info_New:
+			readInfo(target, packet.buf);
+			answered = Query::Info;
+			break;
+
+		case Protocol::Server::ConnectionlessPacket::Info_Old:
+			readInfoOld(target, packet.buf);
+			answered = Query::Info;
+			break;
+
+		case Protocol::Server::ConnectionlessPacket::Players:
+			readPlayers(target, packet.buf);
+			answered = Query::Players;
+			break;
+
+		case Protocol::Server::ConnectionlessPacket::Rules:
+			readRules(target, packet.buf);
+			answered = Query::Rules;
+			break;
+
+		default:
+			mStats.unexpected_packets += 1;
+			return;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		Utils::dlog("bad query reply from {}: {}", key, e.what());
+		mStats.unexpected_packets += 1;
+		return;
+	}
+
+	if (answered == Query::Info)
+		target.result.ping = Clock::Now() - target.send_time;
+
+	bool expected = target.waiting && answered == target.current;
+
+	target.result.completed |= answered;
+	target.done |= answered;
+
+	if (!expected)
+		return; // late answer or second info reply, just keep its data
+
+	advance(key, target);
+}
+
+void ServerQueryEngine::readRegularPacket(Network::Packet&)
+{
+	mStats.unexpected_packets += 1;
+}
+
+void ServerQueryEngine::readChallenge(Target& target, sky::BitBuffer& buf)
+{
+	target.challenge = buf.read<int32_t>();
+	target.attempts = 0;
+}
+
+void ServerQueryEngine::readInfo(Target& target, sky::BitBuffer& buf)
+{
+	Protocol::QueryInfo info;
+
+	info.protocol = buf.read<uint8_t>();
+	info.name = sky::bitbuffer_helpers::ReadString(buf);
+	info.map = sky::bitbuffer_helpers::ReadString(buf);
+	info.folder = sky::bitbuffer_helpers::ReadString(buf);
+	info.game = sky::bitbuffer_helpers::ReadString(buf);
+	info.app_id = buf.read<uint16_t>();
+	info.players = buf.read<uint8_t>();
+	info.max_players = buf.read<uint8_t>();
+	info.bots = buf.read<uint8_t>();
+	info.type = buf.read<uint8_t>();
+	info.environment = buf.read<uint8_t>();
+	info.password = buf.read<uint8_t>();
+	info.vac = buf.read<uint8_t>();
+	info.version = sky::bitbuffer_helpers::ReadString(buf);
+
+	target.result.info = info;
+}
+
+void ServerQueryEngine::readInfoOld(Target& target, sky::BitBuffer& buf)
+{
+	// some servers send both old and new replies, new one is more complete
+
+	if (target.result.info.has_value())
+		return;
+
+	Protocol::QueryInfo info;
+
+	sky::bitbuffer_helpers::ReadString(buf); // address
+	info.name = sky::bitbuffer_helpers::ReadString(buf);
+	info.map = sky::bitbuffer_helpers::ReadString(buf);
+	info.folder = sky::bitbuffer_helpers::ReadString(buf);
+	info.game = sky::bitbuffer_helpers::ReadString(buf);
+	info.players = buf.read<uint8_t>();
+	info.max_players = buf.read<uint8_t>();
+	info.protocol = buf.read<uint8_t>();
+	info.type = buf.read<uint8_t>();
+	info.environment = buf.read<uint8_t>();
+	info.password = buf.read<uint8_t>();
+
+	target.result.info = info;
+}
+
+void ServerQueryEngine::readPlayers(Target& target, sky::BitBuffer& buf)
+{
+	auto count = buf.read<uint8_t>();
+
+	target.result.players.clear();
+
+	for (int i = 0; i < count; i++)
+	{
+		Protocol::QueryPlayer player;
+
+		player.index = buf.read<uint8_t>();
+		player.name = sky::bitbuffer_helpers::ReadString(buf);
+		player.score = buf.read<int32_t>();
+		player.duration = buf.read<float>();
+
+		target.result.players.push_back(player);
+	}
+}
+
+void ServerQueryEngine::readRules(Target& target, sky::BitBuffer& buf)
+{
+	auto count = buf.read<uint16_t>();
+
+	target.result.rules.clear();
+
+	for (int i = 0; i < count; i++)
+	{
+		auto name = sky::bitbuffer_helpers::ReadString(buf);
+		auto value = sky::bitbuffer_helpers::ReadString(buf);
+
+		target.result.rules.insert_or_assign(name, value);
+	}
+}
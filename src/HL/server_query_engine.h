@@ -0,0 +1,131 @@
+#pragma once
+
+#include "networking.h"
+#include "protocol.h"
+#include <common/frame_system.h>
+#include <deque>
+#include <unordered_map>
+
+namespace HL
+{
+	// queries many servers at once through one socket (A2S_INFO, A2S_PLAYER, A2S_RULES)
+
+	class ServerQueryEngine : public Networking,
+		public Common::FrameSystem::Frameable
+	{
+	public:
+		enum Query : uint8_t
+		{
+			Info = 1 << 0,
+			Players = 1 << 1,
+			Rules = 1 << 2,
+			All = Info | Players | Rules
+		};
+
+		struct Result
+		{
+			Network::Address address;
+			uint8_t queries = 0; // requested
+			uint8_t completed = 0; // answered
+			std::optional<Protocol::QueryInfo> info;
+			std::vector<Protocol::QueryPlayer> players;
+			std::map<std::string, std::string> rules;
+			Clock::Duration ping = Clock::Duration::zero();
+			Clock::TimePoint time;
+
+			bool isTimedOut() const { return (completed & queries) != queries; }
+		};
+
+		using ResultCallback = std::function<void(const Result& result)>;
+
+		struct Stats
+		{
+			uint64_t queued = 0;
+			uint64_t completed = 0;
+			uint64_t timed_out = 0;
+			uint64_t retries = 0;
+			uint64_t cache_hits = 0;
+			uint64_t packets_sent = 0;
+			uint64_t packets_received = 0;
+			uint64_t unexpected_packets = 0;
+		};
+
+	public:
+		ServerQueryEngine(uint16_t port = 0);
+
+	private:
+		void onFrame() override;
+		void update();
+
+	public:
+		void frame(); // same as frame system does, when external frames are enabled
+		void setExternalFrames(bool value);
+
+	protected:
+		void readConnectionlessPacket(Network::Packet& packet) override;
+		void readRegularPacket(Network::Packet& packet) override;
+		bool isSplitSourceAllowed(const Network::Address& address) const override;
+
+	public:
+		void query(const Network::Address& address, uint8_t queries, ResultCallback callback);
+		void clearCache();
+
+	private:
+		struct Target
+		{
+			Result result;
+			ResultCallback callback;
+			Query current = Query::Info;
+			uint8_t done = 0; // answered or given up
+			int32_t challenge = -1;
+			int attempts = 0;
+			bool queued = false; // in send queue
+			bool waiting = false; // request is sent, waiting for reply
+			Clock::TimePoint send_time;
+			Clock::TimePoint start_time;
+		};
+
+		void sendRequests();
+		void sendRequest(Target& target);
+		void enqueue(const std::string& key, Target& target);
+		void advance(const std::string& key, Target& target);
+		void checkTimeouts();
+
+		void readChallenge(Target& target, sky::BitBuffer& buf);
+		void readInfo(Target& target, sky::BitBuffer& buf);
+		void readInfoOld(Target& target, sky::BitBuffer& buf);
+		void readPlayers(Target& target, sky::BitBuffer& buf);
+		void readRules(Target& target, sky::BitBuffer& buf);
+
+	public:
+		const auto& getStats() const { return mStats; }
+		auto getActiveCount() const { return mTargets.size(); }
+
+		auto getTimeout() const { return mTimeout; }
+		void setTimeout(Clock::Duration value) { mTimeout = value; }
+
+		auto getRetries() const { return mRetries; }
+		void setRetries(int value) { mRetries = value; }
+
+		auto getPacketsPerSecond() const { return mPacketsPerSecond; }
+		void setPacketsPerSecond(int value) { mPacketsPerSecond = value; }
+
+		auto getCacheTTL() const { return mCacheTTL; }
+		void setCacheTTL(Clock::Duration value) { mCacheTTL = value; }
+
+	private:
+		std::unordered_map</*address*/std::string, Target> mTargets;
+		std::deque</*address*/std::string> mSendQueue;
+		std::unordered_map</*address*/std::string, Result> mCache;
+		Stats mStats;
+
+		Clock::Duration mTimeout = Clock::FromSeconds(1.0f);
+		int mRetries = 2;
+		int mPacketsPerSecond = 1000;
+		Clock::Duration mCacheTTL = Clock::FromSeconds(30.0f);
+
+		float mSendTokens = 0.0f;
+		Clock::TimePoint mSendTokensTime = Clock::Now();
+		bool mExternalFrames = false;
+	};
+}
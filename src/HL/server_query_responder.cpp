@@ -0,0 +1,147 @@
+#include "server_query_responder.h"
+#include <common/buffer_helpers.h>
+#include <random>
+
+using namespace HL;
+
+ServerQueryResponder::ServerQueryResponder(uint16_t port) : Networking(port)
+{
+	mChallenge = static_cast<int32_t>(std::random_device()() & 0x7FFFFFFF);
+
+	mInfo.protocol = Protocol::Version;
+	mInfo.name = "Half-Life";
+	mInfo.map = "crossfire";
+	mInfo.folder = "valve";
+	mInfo.game = "Half-Life";
+	mInfo.app_id = 70;
+	mInfo.max_players = 32;
+	mInfo.type = 'd';
+	mInfo.environment = 'l';
+	mInfo.version = "1.1.2.7/Stdio";
+}
+
+void ServerQueryResponder::frame()
+{
+	receivePackets();
+	flushPackets();
+}
+
+void ServerQueryResponder::readConnectionlessPacket(Network::Packet& packet)
+{
+	mRequestsCount += 1;
+
+	if (mDropRate > 0.0f)
+	{
+		static std::mt19937 random(0);
+
+		if (std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < mDropRate)
+			return;
+	}
+
+	auto type = static_cast<Protocol::Client::ConnectionlessPacket>(packet.buf.read<uint8_t>());
+
+	switch (type)
+	{
+	case Protocol::Client::ConnectionlessPacket::Info:
+	{
+		auto query = sky::bitbuffer_helpers::ReadString(packet.buf);
+
+		if (query != "Source Engine Query")
+			return;
+
+		if (mChallengeRequired && (packet.buf.getRemaining() < 4 || packet.buf.read<int32_t>() != mChallenge))
+			sendChallenge(packet.adr);
+		else
+			sendInfo(packet.adr);
+
+		break;
+	}
+	case Protocol::Client::ConnectionlessPacket::Players:
+	case Protocol::Client::ConnectionlessPacket::Rules:
+	{
+		if (packet.buf.getRemaining() < 4 || packet.buf.read<int32_t>() != mChallenge)
+		{
+			sendChallenge(packet.adr);
+			return;
+		}
+
+		if (type == Protocol::Client::ConnectionlessPacket::Players)
+			sendPlayers(packet.adr);
+		else
+			sendRules(packet.adr);
+
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void ServerQueryResponder::readRegularPacket(Network::Packet&)
+{
+}
+
+void ServerQueryResponder::sendChallenge(const Network::Address& address)
+{
+	Network::Packet packet;
+	packet.adr = address;
+	packet.buf.write<uint8_t>((uint8_t)Protocol::Server::ConnectionlessPacket::Challenge);
+	packet.buf.write<int32_t>(mChallenge);
+	sendConnectionlessPacket(packet);
+}
+
+void ServerQueryResponder::sendInfo(const Network::Address& address)
+{
+	Network::Packet packet;
+	packet.adr = address;
+	packet.buf.write<uint8_t>((uint8_t)Protocol::Server::ConnectionlessPacket::Info_New);
+	packet.buf.write<uint8_t>(mInfo.protocol);
+	sky::bitbuffer_helpers::WriteString(packet.buf, mInfo.name);
+	sky::bitbuffer_helpers::WriteString(packet.buf, mInfo.map);
+	sky::bitbuffer_helpers::WriteString(packet.buf, mInfo.folder);
+	sky::bitbuffer_helpers::WriteString(packet.buf, mInfo.game);
+	packet.buf.write<uint16_t>(mInfo.app_id);
+	packet.buf.write<uint8_t>(static_cast<uint8_t>(mPlayers.size()));
+	packet.buf.write<uint8_t>(mInfo.max_players);
+	packet.buf.write<uint8_t>(mInfo.bots);
+	packet.buf.write<uint8_t>(mInfo.type);
+	packet.buf.write<uint8_t>(mInfo.environment);
+	packet.buf.write<uint8_t>(mInfo.password ? 1 : 0);
+	packet.buf.write<uint8_t>(mInfo.vac ? 1 : 0);
+	sky::bitbuffer_helpers::WriteString(packet.buf, mInfo.version);
+	sendConnectionlessPacket(packet);
+}
+
+void ServerQueryResponder::sendPlayers(const Network::Address& address)
+{
+	Network::Packet packet;
+	packet.adr = address;
+	packet.buf.write<uint8_t>((uint8_t)Protocol::Server::ConnectionlessPacket::Players);
+	packet.buf.write<uint8_t>(static_cast<uint8_t>(mPlayers.size()));
+
+	for (const auto& player : mPlayers)
+	{
+		packet.buf.write<uint8_t>(player.index);
+		sky::bitbuffer_helpers::WriteString(packet.buf, player.name);
+		packet.buf.write<int32_t>(player.score);
+		packet.buf.write<float>(player.duration);
+	}
+
+	sendConnectionlessPacket(packet);
+}
+
+void ServerQueryResponder::sendRules(const Network::Address& address)
+{
+	Network::Packet packet;
+	packet.adr = address;
+	packet.buf.write<uint8_t>((uint8_t)Protocol::Server::ConnectionlessPacket::Rules);
+	packet.buf.write<uint16_t>(static_cast<uint16_t>(mRules.size()));
+
+	for (const auto& [name, value] : mRules)
+	{
+		sky::bitbuffer_helpers::WriteString(packet.buf, name);
+		sky::bitbuffer_helpers::WriteString(packet.buf, value);
+	}
+
+	sendConnectionlessPacket(packet);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "networking.h"
+#include "protocol.h"
+
+namespace HL
+{
+	// answers A2S queries like a goldsrc server does, for testing ServerQueryEngine locally
+
+	class ServerQueryResponder : public Networking
+	{
+	public:
+		ServerQueryResponder(uint16_t port);
+
+	protected:
+		void readConnectionlessPacket(Network::Packet& packet) override;
+		void readRegularPacket(Network::Packet& packet) override;
+
+	private:
+		void sendChallenge(const Network::Address& address);
+		void sendInfo(const Network::Address& address);
+		void sendPlayers(const Network::Address& address);
+		void sendRules(const Network::Address& address);
+
+	public:
+		// answers requests received since last call, only with external frames
+
+		void frame();
+		void setExternalFrames(bool value) { setSocketExternalFrames(value); }
+
+	public:
+		auto& getInfo() { return mInfo; }
+		auto& getPlayers() { return mPlayers; }
+		auto& getRules() { return mRules; }
+
+		auto getChallenge() const { return mChallenge; }
+
+		auto isChallengeRequired() const { return mChallengeRequired; }
+		void setChallengeRequired(bool value) { mChallengeRequired = value; }
+
+		auto getDropRate() const { return mDropRate; }
+		void setDropRate(float value) { mDropRate = value; } // part of requests to ignore
+
+		auto getRequestsCount() const { return mRequestsCount; }
+
+	private:
+		Protocol::QueryInfo mInfo;
+		std::vector<Protocol::QueryPlayer> mPlayers;
+		std::map<std::string, std::string> mRules;
+		int32_t mChallenge;
+		bool mChallengeRequired = true; // for info request too
+		float mDropRate = 0.0f;
+		uint64_t mRequestsCount = 0;
+	};
+}
@@ -9,6 +9,7 @@
 	#include <source_location>
 #endif
 
+#include <mutex>
 #include <utility>
 
 #if defined(PLATFORM_IOS)
@@ -25,13 +26,34 @@ namespace HL::Utils
 		return s.substr(0, s.find('\\'));
 	}
 
+	// console, log and frame system are not thread safe, clients running on
+	// threads of ClientSwarm take this lock around every access to them.
+	// recursive, because console commands can log
+
+	inline std::recursive_mutex& GetGlobalMutex()
+	{
+		static std::recursive_mutex mutex;
+		return mutex;
+	}
+
+	template <typename... Args>
+	void Log(Args&&... args)
+	{
+		std::lock_guard lock(GetGlobalMutex());
+		sky::Log(std::forward<Args>(args)...);
+	}
+
 	template <typename... Args>
 	struct dlog
 	{
 #if defined(PLATFORM_IOS) || defined(PLATFORM_MAC) || defined(PLATFORM_EMSCRIPTEN)
         dlog(std::string text, Args&&... args)
         {
-            if (CONSOLE->getCVars().at("dlogs").getGetter()().at(0) != "1")
+            std::lock_guard lock(GetGlobalMutex());
+
+            auto& cvars = CONSOLE->getCVars();
+
+            if (auto it = cvars.find("dlogs"); it == cvars.end() || it->second.getGetter()().at(0) != "1")
                 return;
 
 			sky::Log(Console::Color::DarkGray, text, args...);
@@ -39,7 +61,13 @@ namespace HL::Utils
 #else
 		dlog(std::string text, Args&&... args, const std::source_location& location = std::source_location::current())
 		{
-			if (CONSOLE->getCVars().at("dlogs").getGetter()().at(0) != "1")
+			std::lock_guard lock(GetGlobalMutex());
+
+			// registered only by client bound to console
+
+			auto& cvars = CONSOLE->getCVars();
+
+			if (auto it = cvars.find("dlogs"); it == cvars.end() || it->second.getGetter()().at(0) != "1")
 				return;
 
 			sky::Log(Console::Color::DarkGray, "[{}] " + text, location.function_name(), args...);
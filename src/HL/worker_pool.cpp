@@ -0,0 +1,48 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+using namespace HL;
+
+WorkerPool::WorkerPool(size_t threads)
+{
+	threads = std::max<size_t>(threads, 1);
+
+	for (size_t i = 0; i < threads; i++)
+		mThreads.emplace_back([this] { work(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mStopping = true;
+	}
+
+	mCondition.notify_all();
+
+	for (auto& thread : mThreads)
+		thread.join();
+}
+
+void WorkerPool::work()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock lock(mMutex);
+			mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+
+			// queued tasks are finished before exit, somebody may wait for them
+
+			if (mTasks.empty())
+				return;
+
+			task = std::move(mTasks.front());
+			mTasks.pop();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace HL
+{
+	// fixed set of threads for work that should not run on frame thread
+	// (file hashing, shards of ClientSwarm), tasks run in order of posting
+
+	class WorkerPool
+	{
+	public:
+		WorkerPool(size_t threads);
+		~WorkerPool();
+
+	public:
+		template <typename F>
+		auto post(F&& func)
+		{
+			using Result = decltype(func());
+
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+			auto future = task->get_future();
+
+			{
+				std::lock_guard lock(mMutex);
+				mTasks.push([task] { (*task)(); });
+			}
+
+			mCondition.notify_one();
+
+			return future;
+		}
+
+		auto getThreadsCount() const { return mThreads.size(); }
+
+	private:
+		void work();
+
+	private:
+		std::vector<std::thread> mThreads;
+		std::queue<std::function<void()>> mTasks;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+		bool mStopping = false;
+	};
+}
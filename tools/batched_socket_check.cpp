@@ -0,0 +1,183 @@
+// checks BatchedUdpSocket over loopback: every datagram arrives once, intact,
+// in order and from the right address, with few system calls. then measures
+// datagrams per second through it
+//
+// usage: batched_socket_check            - check, then benchmark
+//        batched_socket_check --check    - check only
+
+#include <HL/batched_udp_socket.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	const uint16_t SenderPort = 27931;
+	const uint16_t ReceiverPort = 27932;
+	const size_t BatchSize = 64;
+
+	Network::Packet MakePacket(uint16_t port, uint32_t index, size_t size)
+	{
+		Network::Packet result;
+		result.adr = Network::Address("127.0.0.1:" + std::to_string(port));
+		result.buf.setSize(size);
+
+		auto memory = (uint8_t*)result.buf.getMemory();
+
+		for (size_t i = 0; i < size; i++)
+			memory[i] = static_cast<uint8_t>(index * 31 + i);
+
+		if (size >= sizeof(index))
+			memcpy(memory, &index, sizeof(index));
+
+		return result;
+	}
+
+	size_t GetPacketSize(uint32_t index)
+	{
+		return 4 + (index * 97) % 1400;
+	}
+
+	bool Check()
+	{
+		BatchedUdpSocket sender(SenderPort, BatchSize);
+		BatchedUdpSocket receiver(ReceiverPort, BatchSize);
+
+		const uint32_t count = 1000;
+
+		uint32_t next = 0;
+		bool ok = true;
+
+		receiver.setReadCallback([&](Network::Packet& packet) {
+			if (!ok)
+				return;
+
+			auto expected = MakePacket(ReceiverPort, next, GetPacketSize(next));
+			auto size = packet.buf.getSize();
+
+			if (size != expected.buf.getSize() || memcmp(packet.buf.getMemory(), expected.buf.getMemory(), size) != 0)
+			{
+				printf("datagram %u is damaged or out of order\n", next);
+				ok = false;
+				return;
+			}
+
+			if (packet.adr.toString() != "127.0.0.1:" + std::to_string(SenderPort))
+			{
+				printf("datagram %u came from %s\n", next, packet.adr.toString().c_str());
+				ok = false;
+				return;
+			}
+
+			next += 1;
+		});
+
+		// send in frames smaller than socket buffer, so nothing is lost on loopback
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			sender.sendPacket(MakePacket(ReceiverPort, i, GetPacketSize(i)));
+
+			if (i % 50 == 49)
+			{
+				sender.flush();
+				receiver.receive();
+			}
+		}
+
+		sender.flush();
+		receiver.receive();
+
+		if (!ok)
+			return false;
+
+		if (next != count)
+		{
+			printf("received %u of %u datagrams\n", next, count);
+			return false;
+		}
+
+		// too large and not ipv4 datagrams are dropped without sending
+
+		sender.sendPacket(MakePacket(ReceiverPort, 0, BatchedUdpSocket::SlotSize + 1));
+
+		auto bad = MakePacket(ReceiverPort, 0, 16);
+		bad.adr = Network::Address("localhost:" + std::to_string(ReceiverPort));
+		sender.sendPacket(bad);
+		sender.flush();
+
+		const auto& sent = sender.getStats();
+		const auto& received = receiver.getStats();
+
+		if (sent.sent_packets != count || sent.dropped_packets != 2 || received.received_packets != count)
+		{
+			printf("wrong stats: sent %llu, dropped %llu, received %llu\n", (unsigned long long)sent.sent_packets,
+				(unsigned long long)sent.dropped_packets, (unsigned long long)received.received_packets);
+			return false;
+		}
+
+		// one sendmmsg per full ring or flush, one recvmmsg per batch plus one to see it is empty
+
+		if (sent.send_calls > count / BatchSize + count / 50 + 2 || received.recv_calls > count / BatchSize + count / 50 + 2)
+		{
+			printf("too many calls: send %llu, recv %llu\n", (unsigned long long)sent.send_calls,
+				(unsigned long long)received.recv_calls);
+			return false;
+		}
+
+		printf("check ok: %u datagrams, %llu send calls, %llu recv calls\n", count,
+			(unsigned long long)sent.send_calls, (unsigned long long)received.recv_calls);
+		return true;
+	}
+
+	void Benchmark()
+	{
+		BatchedUdpSocket sender(SenderPort, BatchSize);
+		BatchedUdpSocket receiver(ReceiverPort, BatchSize);
+
+		size_t received = 0;
+
+		receiver.setReadCallback([&](Network::Packet&) {
+			received += 1;
+		});
+
+		// like a busy frame of many clients: 100 datagrams out, then everything in
+
+		const size_t frames = 20000;
+		auto packet = MakePacket(ReceiverPort, 0, 100);
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < 100; i++)
+				sender.sendPacket(packet);
+
+			sender.flush();
+			receiver.receive();
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const auto& stats = sender.getStats();
+
+		printf("%zu of %zu datagrams received, %.0f datagrams/s, %.1f datagrams per sendmmsg\n", received,
+			frames * 100, received / seconds, (double)stats.sent_packets / stats.send_calls);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
@@ -0,0 +1,194 @@
+// checks BitReader against reads of sky::BitBuffer and bitbuffer_helpers over
+// random data and random sequences of reads, then measures both
+//
+// usage: bit_reader_check            - check, then benchmark
+//        bit_reader_check --check    - check only
+
+#include <HL/bit_reader.h>
+#include <common/buffer_helpers.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	sky::BitBuffer MakeBuffer(std::mt19937& rng, size_t size)
+	{
+		sky::BitBuffer result;
+		result.setSize(size);
+
+		auto memory = (uint8_t*)result.getMemory();
+
+		// zeros often enough to end strings and to make empty coords
+
+		for (size_t i = 0; i < size; i++)
+			memory[i] = rng() % 8 == 0 ? 0 : static_cast<uint8_t>(rng());
+
+		result.toStart();
+		return result;
+	}
+
+	bool Check()
+	{
+		std::mt19937 rng(1);
+
+		for (int round = 0; round < 50; round++)
+		{
+			auto buf = MakeBuffer(rng, 4096 + rng() % 4096);
+			BitReader bits(buf.getMemory(), buf.getSize());
+
+			// byte aligned part first, like strings and coords at start of svc
+
+			for (int i = 0; i < 4; i++)
+			{
+				if (bits.readString() != sky::bitbuffer_helpers::ReadString(buf))
+				{
+					printf("string mismatch: round %d\n", round);
+					return false;
+				}
+
+				if (bits.readCoord() != sky::bitbuffer_helpers::ReadCoord(buf))
+				{
+					printf("coord mismatch: round %d\n", round);
+					return false;
+				}
+			}
+
+			// bit packed part, like delta fields
+
+			while (bits.getPosition() + 256 < bits.getSize() * 8)
+			{
+				auto kind = rng() % 4;
+
+				if (kind == 0)
+				{
+					auto count = 1 + static_cast<int>(rng() % 32);
+
+					if (bits.readBits(count) != buf.readBits(count))
+					{
+						printf("bits mismatch: round %d, count %d, position %zu\n", round, count, bits.getPosition());
+						return false;
+					}
+				}
+				else if (kind == 1)
+				{
+					auto count = 2 + static_cast<int>(rng() % 31);
+
+					if (bits.readSBits(count) != sky::bitbuffer_helpers::ReadSBits(buf, count))
+					{
+						printf("sbits mismatch: round %d, count %d, position %zu\n", round, count, bits.getPosition());
+						return false;
+					}
+				}
+				else if (kind == 2)
+				{
+					auto count = 1 + static_cast<int>(rng() % 16);
+					auto a = bits.readBitAngle(count);
+					auto b = sky::bitbuffer_helpers::ReadBitAngle(buf, count);
+
+					if (std::abs(a - b) > 1e-4f * std::max(1.0f, std::abs(b)))
+					{
+						printf("angle mismatch: round %d, count %d, %f != %f\n", round, count, a, b);
+						return false;
+					}
+				}
+				else
+				{
+					float a[3] = { 1.0f, 2.0f, 3.0f };
+					float b[3] = { 1.0f, 2.0f, 3.0f };
+
+					bits.readBitVec3(a);
+					sky::bitbuffer_helpers::ReadBitVec3(buf, b);
+
+					if (memcmp(a, b, sizeof(a)) != 0)
+					{
+						printf("vec3 mismatch: round %d, position %zu\n", round, bits.getPosition());
+						return false;
+					}
+				}
+			}
+		}
+
+		// reading past the end must throw instead of reading foreign memory
+
+		uint8_t data[3] = { };
+		BitReader bits(data, sizeof(data));
+		bits.readBits(20);
+
+		try
+		{
+			bits.readBits(5);
+			puts("no error on read past the end");
+			return false;
+		}
+		catch (const std::out_of_range&)
+		{
+		}
+
+		puts("check ok");
+		return true;
+	}
+
+	void Benchmark()
+	{
+		std::mt19937 rng(2);
+
+		// widths like in delta descriptions: flags, small ints, coords, angles
+
+		std::vector<int> counts;
+		size_t total_bits = 0;
+
+		while (total_bits + 32 < 8 * 1024 * 1024 * 8)
+		{
+			const int widths[] = { 1, 1, 1, 3, 5, 8, 10, 11, 12, 16, 18, 22, 32 };
+			auto count = widths[rng() % std::size(widths)];
+			counts.push_back(count);
+			total_bits += count;
+		}
+
+		auto buf = MakeBuffer(rng, 8 * 1024 * 1024);
+		uint64_t sum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (auto count : counts)
+			sum += buf.readBits(count);
+
+		auto middle = std::chrono::steady_clock::now();
+
+		BitReader bits(buf.getMemory(), buf.getSize());
+
+		for (auto count : counts)
+			sum -= bits.readBits(count);
+
+		auto end = std::chrono::steady_clock::now();
+
+		auto ns = [&](auto from, auto to) {
+			return std::chrono::duration<double, std::nano>(to - from).count() / counts.size();
+		};
+
+		printf("%zu reads, sky::BitBuffer %.2f ns/read, BitReader %.2f ns/read (%s)\n", counts.size(),
+			ns(start, middle), ns(middle, end), sum == 0 ? "same values" : "different values");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
@@ -0,0 +1,173 @@
+// checks Encoder::CRC32_* and BlockSequenceCRCByte against a plain table crc
+// and measures both on typical buffer sizes
+//
+// usage: crc32_check            - check, then benchmark
+//        crc32_check --check    - check only
+
+#include <HL/encoder.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	using CRC32_t = Encoder::CRC32_t;
+
+	// reflected 0xEDB88320, same values as table of encoder
+
+	std::array<uint32_t, 256> MakeTable()
+	{
+		std::array<uint32_t, 256> result;
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			auto c = i;
+
+			for (int j = 0; j < 8; j++)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+
+			result[i] = c;
+		}
+
+		return result;
+	}
+
+	const auto crc_table = MakeTable();
+
+	CRC32_t ReferenceCRC(CRC32_t crc, const uint8_t* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			crc = crc_table[(crc & 0xFF) ^ data[i]] ^ (crc >> 8);
+
+		return crc;
+	}
+
+	// as it was before kernels, with own table
+
+	uint8_t ReferenceBlockSequenceCRCByte(const void* data, int len, int seq)
+	{
+		if (seq < 0)
+			return 0;
+
+		if (len > 60)
+			len = 60;
+
+		uint8_t chkb[64];
+		memcpy(chkb, data, len);
+		memcpy(chkb + len, (const uint8_t*)crc_table.data() + seq % 0x3FC, 4);
+
+		return static_cast<uint8_t>(~ReferenceCRC(0xFFFFFFFF, chkb, len + 4));
+	}
+
+	bool Check()
+	{
+		std::mt19937 rng(1);
+
+		for (int i = 0; i < 50000; i++)
+		{
+			// sizes around and far beyond kernel block sizes, unaligned starts
+
+			auto size = rng() % 4 != 0 ? rng() % 200 : rng() % 70000;
+			auto offset = rng() % 8;
+
+			std::vector<uint8_t> memory(size + offset);
+
+			for (auto& byte : memory)
+				byte = static_cast<uint8_t>(rng());
+
+			auto data = memory.data() + offset;
+			auto initial = static_cast<CRC32_t>(rng());
+
+			auto crc = initial;
+			Encoder::CRC32_ProcessBuffer(&crc, data, static_cast<int>(size));
+
+			if (crc != ReferenceCRC(initial, data, size))
+			{
+				printf("crc mismatch: size %zu, offset %zu\n", (size_t)size, (size_t)offset);
+				return false;
+			}
+
+			sky::BitBuffer buf;
+			buf.setSize(size);
+			memcpy(buf.getMemory(), data, size);
+
+			auto buf_offset = size > 0 ? rng() % size : 0;
+
+			crc = initial;
+			Encoder::CRC32_ProcessBuffer(&crc, buf, buf_offset, size - buf_offset);
+
+			if (crc != ReferenceCRC(initial, data + buf_offset, size - buf_offset))
+			{
+				printf("buffer crc mismatch: size %zu, offset %zu\n", (size_t)size, (size_t)buf_offset);
+				return false;
+			}
+
+			auto len = static_cast<int>(std::min<size_t>(rng() % 80, size));
+			auto seq = static_cast<int>(rng() % 200000) - 1000;
+
+			if (Encoder::BlockSequenceCRCByte(data, len, seq) != ReferenceBlockSequenceCRCByte(data, len, seq))
+			{
+				printf("sequence crc mismatch: len %d, seq %d\n", len, seq);
+				return false;
+			}
+		}
+
+		puts("check ok");
+		return true;
+	}
+
+	template <typename F>
+	void Measure(const char* name, size_t size, size_t bytes, F&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%-20s %6zu bytes %8.1f ms %8.0f MB/s\n", name, size, seconds * 1000.0, bytes / seconds / 1e6);
+	}
+
+	void Benchmark()
+	{
+		const size_t total = 200 * 1000 * 1000;
+
+		for (size_t size : { 16, 64, 256, 1400, 65536 })
+		{
+			std::vector<uint8_t> data(size, 0x5A);
+			auto count = total / size;
+			CRC32_t crc = 0;
+
+			Measure("reference", size, count * size, [&] {
+				for (size_t i = 0; i < count; i++)
+					crc = ReferenceCRC(crc, data.data(), size);
+			});
+
+			Measure("Encoder::CRC32", size, count * size, [&] {
+				for (size_t i = 0; i < count; i++)
+					Encoder::CRC32_ProcessBuffer(&crc, data.data(), static_cast<int>(size));
+			});
+
+			// result is used, so reference loop is not thrown away
+			data[0] = static_cast<uint8_t>(crc);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
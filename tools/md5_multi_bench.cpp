@@ -0,0 +1,230 @@
+// checks MultiMD5 against MD5 and measures per-file throughput of both
+//
+// usage: md5_multi_bench            - check, then benchmark on generated files
+//        md5_multi_bench --check    - check only
+//        md5_multi_bench <dir>      - check, then benchmark on files of dir (recursive)
+
+#include <HL/md5.h>
+#include <HL/md5_multi.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	using Message = std::vector<uint8_t>;
+
+	MultiMD5::Digest ReferenceDigest(const Message& message)
+	{
+		MD5 md5;
+		md5.update(message.data(), static_cast<MD5::size_type>(message.size()));
+		md5.finalize();
+
+		MultiMD5::Digest result;
+		memcpy(result.data(), md5.getdigest(), result.size());
+		return result;
+	}
+
+	Message MakeMessage(std::mt19937& rng, size_t size)
+	{
+		Message result(size);
+
+		for (auto& byte : result)
+			byte = static_cast<uint8_t>(rng());
+
+		return result;
+	}
+
+	bool Check()
+	{
+		std::mt19937 rng(1);
+		std::vector<Message> messages;
+
+		for (int i = 0; i < 500; i++)
+		{
+			auto size = rng() % 3 != 0 ? rng() % 200 : rng() % 100000;
+			messages.push_back(MakeMessage(rng, size));
+		}
+
+		std::vector<MultiMD5::Digest> expected;
+
+		for (const auto& message : messages)
+			expected.push_back(ReferenceDigest(message));
+
+		// one-shot
+
+		std::vector<std::span<const uint8_t>> spans(messages.begin(), messages.end());
+		auto digests = MultiMD5::Hash(spans);
+
+		for (size_t i = 0; i < messages.size(); i++)
+		{
+			if (digests[i] != expected[i])
+			{
+				printf("hash mismatch: message %zu, size %zu\n", i, messages[i].size());
+				return false;
+			}
+		}
+
+		// streaming in random chunks, all contexts advance together
+
+		std::vector<MultiMD5::Context> contexts(messages.size());
+		std::vector<size_t> offsets(messages.size(), 0);
+
+		while (true)
+		{
+			std::vector<MultiMD5::Input> inputs;
+
+			for (size_t i = 0; i < messages.size(); i++)
+			{
+				auto remaining = messages[i].size() - offsets[i];
+
+				if (remaining == 0)
+					continue;
+
+				auto size = std::min<size_t>(rng() % 300, remaining);
+				inputs.push_back({ &contexts[i], messages[i].data() + offsets[i], size });
+				offsets[i] += size;
+			}
+
+			if (inputs.empty())
+				break;
+
+			MultiMD5::Update(inputs);
+		}
+
+		// half one by one, half together
+
+		std::vector<MultiMD5::Context*> batch;
+
+		for (size_t i = 0; i < contexts.size(); i++)
+		{
+			if (i % 2 == 0)
+				contexts[i].finalize();
+			else
+				batch.push_back(&contexts[i]);
+		}
+
+		MultiMD5::Finalize(batch);
+
+		for (size_t i = 0; i < messages.size(); i++)
+		{
+			if (contexts[i].getDigest() != expected[i])
+			{
+				printf("stream mismatch: message %zu, size %zu\n", i, messages[i].size());
+				return false;
+			}
+		}
+
+		printf("check ok: %zu messages, %zu lanes\n", messages.size(), MultiMD5::GetLanesCount());
+		return true;
+	}
+
+	std::vector<Message> GenerateFiles()
+	{
+		// like resources of a game: half are small sprites and sounds, some models,
+		// few large textures and maps
+
+		std::mt19937 rng(2);
+		std::vector<Message> result;
+
+		for (int i = 0; i < 20000; i++)
+		{
+			auto kind = rng() % 10;
+			size_t size;
+
+			if (kind < 5)
+				size = 256 + rng() % 4096;
+			else if (kind < 8)
+				size = 4096 + rng() % 60000;
+			else if (kind < 9)
+				size = 65536 + rng() % 200000;
+			else
+				size = 300000 + rng() % 700000;
+
+			result.push_back(MakeMessage(rng, size));
+		}
+
+		return result;
+	}
+
+	std::vector<Message> LoadFiles(const std::string& dir)
+	{
+		std::vector<Message> result;
+
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(dir))
+		{
+			if (!entry.is_regular_file())
+				continue;
+
+			std::ifstream file(entry.path(), std::ios::binary);
+			result.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+
+		return result;
+	}
+
+	template <typename F>
+	void Measure(const char* name, const std::vector<Message>& files, size_t bytes, F&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%-28s %8.1f ms %8.0f MB/s %9.0f files/s\n", name, seconds * 1000.0,
+			bytes / seconds / 1e6, files.size() / seconds);
+	}
+
+	void Benchmark(const std::vector<Message>& files)
+	{
+		size_t bytes = 0;
+
+		for (const auto& file : files)
+			bytes += file.size();
+
+		printf("%zu files, %.1f MB\n", files.size(), bytes / 1e6);
+
+		std::vector<std::span<const uint8_t>> spans(files.begin(), files.end());
+
+		Measure("MD5 one by one", files, bytes, [&] {
+			for (const auto& file : files)
+				ReferenceDigest(file);
+		});
+
+		Measure("MultiMD5 one by one", files, bytes, [&] {
+			for (const auto& file : files)
+			{
+				MultiMD5::Context context;
+				context.update(file.data(), static_cast<MultiMD5::Context::size_type>(file.size()));
+				context.finalize();
+			}
+		});
+
+		Measure("MultiMD5::Hash", files, bytes, [&] {
+			MultiMD5::Hash(spans);
+		});
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	if (argc > 1)
+		Benchmark(LoadFiles(argv[1]));
+	else
+		Benchmark(GenerateFiles());
+
+	return 0;
+}
@@ -0,0 +1,198 @@
+// checks Encoder::Munge/UnMunge kernels against the original per-byte loop
+// and measures both on packet-sized buffers
+//
+// usage: munge_check            - check, then benchmark
+//        munge_check --check    - check only
+
+#include <HL/encoder.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	const uint8_t mungify_table[] =
+	{
+		0x7A, 0x64, 0x05, 0xF1,
+		0x1B, 0x9B, 0xA0, 0xB5,
+		0xCA, 0xED, 0x61, 0x0D,
+		0x4A, 0xDF, 0x8E, 0xC7
+	};
+
+	const uint8_t mungify_table2[] =
+	{
+		0x05, 0x61, 0x7A, 0xED,
+		0x1B, 0xCA, 0x0D, 0x9B,
+		0x4A, 0xF1, 0x64, 0xC7,
+		0xB5, 0x8E, 0xDF, 0xA0
+	};
+
+	const uint8_t mungify_table3[] =
+	{
+		0x20, 0x07, 0x13, 0x61,
+		0x03, 0x45, 0x17, 0x72,
+		0x0A, 0x2D, 0x48, 0x0C,
+		0x4A, 0x12, 0xA9, 0xB5
+	};
+
+	uint32_t ByteSwap(uint32_t value)
+	{
+		return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+	}
+
+	// as it was before kernels, with memcpy instead of unaligned pointer casts
+
+	void ReferenceMunge(void* data, size_t size, int seq, const uint8_t table[])
+	{
+		size = (size & ~3) >> 2;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			auto p = (uint8_t*)data + (i << 2);
+
+			uint32_t word;
+			memcpy(&word, p, 4);
+
+			uint8_t c[4];
+			auto swapped = ByteSwap(word ^ ~seq);
+			memcpy(c, &swapped, 4);
+
+			for (int j = 0; j < 4; j++)
+				c[j] ^= 0xA5 | (j << j) | j | table[(i + j) & 0x0F];
+
+			memcpy(&word, c, 4);
+			word ^= seq;
+			memcpy(p, &word, 4);
+		}
+	}
+
+	void ReferenceUnMunge(void* data, size_t size, int seq, const uint8_t table[])
+	{
+		size = (size & ~3) >> 2;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			auto p = (uint8_t*)data + (i << 2);
+
+			uint32_t word;
+			memcpy(&word, p, 4);
+			word ^= seq;
+
+			uint8_t c[4];
+			memcpy(c, &word, 4);
+
+			for (int j = 0; j < 4; j++)
+				c[j] ^= 0xA5 | (j << j) | j | table[(i + j) & 0x0F];
+
+			memcpy(&word, c, 4);
+			word = ByteSwap(word) ^ ~seq;
+			memcpy(p, &word, 4);
+		}
+	}
+
+	struct Variant
+	{
+		const char* name;
+		const uint8_t* table;
+		void(*munge)(void*, size_t, int);
+		void(*unmunge)(void*, size_t, int);
+	};
+
+	const Variant variants[] =
+	{
+		{ "Munge", mungify_table, Encoder::Munge, Encoder::UnMunge },
+		{ "Munge2", mungify_table2, Encoder::Munge2, Encoder::UnMunge2 },
+		{ "Munge3", mungify_table3, Encoder::Munge3, Encoder::UnMunge3 },
+	};
+
+	bool Check()
+	{
+		std::mt19937 rng(1);
+
+		for (int i = 0; i < 20000; i++)
+		{
+			const auto& variant = variants[i % 3];
+
+			// odd offsets and sizes, so unaligned heads and word tails are covered
+
+			auto size = rng() % 1500;
+			auto offset = rng() % 4;
+			auto seq = static_cast<int>(rng());
+
+			std::vector<uint8_t> memory(size + offset);
+
+			for (auto& byte : memory)
+				byte = static_cast<uint8_t>(rng());
+
+			auto source = std::vector<uint8_t>(memory.begin() + offset, memory.end());
+			auto expected = source;
+			ReferenceMunge(expected.data(), size, seq, variant.table);
+
+			variant.munge(memory.data() + offset, size, seq);
+
+			if (memcmp(memory.data() + offset, expected.data(), size) != 0)
+			{
+				printf("%s mismatch: size %zu, offset %zu\n", variant.name, (size_t)size, (size_t)offset);
+				return false;
+			}
+
+			variant.unmunge(memory.data() + offset, size, seq);
+			ReferenceUnMunge(expected.data(), size, seq, variant.table);
+
+			if (memcmp(memory.data() + offset, expected.data(), size) != 0 || expected != source)
+			{
+				printf("Un%s mismatch: size %zu, offset %zu\n", variant.name, (size_t)size, (size_t)offset);
+				return false;
+			}
+		}
+
+		puts("check ok");
+		return true;
+	}
+
+	template <typename F>
+	void Measure(const char* name, size_t bytes, F&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%-20s %8.1f ms %8.0f MB/s\n", name, seconds * 1000.0, bytes / seconds / 1e6);
+	}
+
+	void Benchmark()
+	{
+		const size_t packet_size = 1400;
+		const size_t packets = 200000;
+
+		std::vector<uint8_t> packet(packet_size, 0x5A);
+
+		Measure("reference munge", packet_size * packets, [&] {
+			for (size_t i = 0; i < packets; i++)
+				ReferenceMunge(packet.data(), packet.size(), static_cast<int>(i), mungify_table2);
+		});
+
+		Measure("Encoder::Munge2", packet_size * packets, [&] {
+			for (size_t i = 0; i < packets; i++)
+				Encoder::Munge2(packet.data(), packet.size(), static_cast<int>(i));
+		});
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
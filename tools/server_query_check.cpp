@@ -0,0 +1,322 @@
+// checks ServerQueryEngine against ServerQueryResponder over loopback: results
+// match what servers have, challenges are asked for and used, lost requests
+// are retried, split rules replies are reassembled and cached results are
+// given without requests. then measures queries per second
+//
+// usage: server_query_check            - check, then benchmark
+//        server_query_check --check    - check only
+
+#include <HL/server_query_engine.h>
+#include <HL/server_query_responder.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	const uint16_t EnginePort = 27950;
+	const uint16_t FirstServerPort = 27951;
+	const uint16_t DeadServerPort = 27949; // nobody answers here
+
+	Network::Address MakeAddress(uint16_t port)
+	{
+		return Network::Address("127.0.0.1:" + std::to_string(port));
+	}
+
+	// engine, servers and results of finished queries
+
+	struct Loop
+	{
+		Loop(size_t servers)
+		{
+			engine = std::make_unique<ServerQueryEngine>(EnginePort);
+			engine->setExternalFrames(true);
+
+			for (size_t i = 0; i < servers; i++)
+			{
+				auto server = std::make_unique<ServerQueryResponder>(static_cast<uint16_t>(FirstServerPort + i));
+				server->setExternalFrames(true);
+				server->getInfo().name = "server " + std::to_string(i);
+
+				for (int j = 0; j < 5; j++)
+				{
+					Protocol::QueryPlayer player;
+					player.index = static_cast<uint8_t>(j);
+					player.name = "player " + std::to_string(j);
+					player.score = j * 10 - 5;
+					player.duration = j * 60.5f;
+					server->getPlayers().push_back(player);
+				}
+
+				// several times larger than one datagram
+
+				for (int j = 0; j < 200; j++)
+					server->getRules()["rule_" + std::to_string(j)] = "value of rule " + std::to_string(j * 7);
+
+				this->servers.push_back(std::move(server));
+			}
+		}
+
+		void query(uint16_t port, uint8_t queries)
+		{
+			pending += 1;
+
+			engine->query(MakeAddress(port), queries, [this](const ServerQueryEngine::Result& result) {
+				results.push_back(result);
+				pending -= 1;
+			});
+		}
+
+		ServerQueryResponder& getServer(const Network::Address& address)
+		{
+			auto name = address.toString();
+			auto port = std::stoi(name.substr(name.find(':') + 1));
+			return *servers.at(port - FirstServerPort);
+		}
+
+		bool run(double seconds = 5.0)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+
+			while (pending > 0 && std::chrono::steady_clock::now() < deadline)
+			{
+				engine->frame();
+
+				for (auto& server : servers)
+					server->frame();
+
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+
+			if (pending > 0)
+				printf("%zu queries are not finished\n", pending);
+
+			return pending == 0;
+		}
+
+		std::unique_ptr<ServerQueryEngine> engine;
+		std::vector<std::unique_ptr<ServerQueryResponder>> servers;
+		std::vector<ServerQueryEngine::Result> results;
+		size_t pending = 0;
+	};
+
+	bool CheckResult(const ServerQueryEngine::Result& result, ServerQueryResponder& server)
+	{
+		auto name = result.address.toString();
+
+		if (result.isTimedOut())
+		{
+			printf("%s: timed out, completed %d of %d\n", name.c_str(), result.completed, result.queries);
+			return false;
+		}
+
+		if (result.queries & ServerQueryEngine::Query::Info)
+		{
+			const auto& a = result.info;
+			const auto& b = server.getInfo();
+
+			if (!a.has_value() || a->name != b.name || a->map != b.map || a->folder != b.folder || a->game != b.game ||
+				a->app_id != b.app_id || a->players != server.getPlayers().size() || a->max_players != b.max_players ||
+				a->type != b.type || a->environment != b.environment || a->version != b.version)
+			{
+				printf("%s: wrong info\n", name.c_str());
+				return false;
+			}
+		}
+
+		if (result.queries & ServerQueryEngine::Query::Players)
+		{
+			const auto& players = server.getPlayers();
+
+			if (result.players.size() != players.size())
+			{
+				printf("%s: %zu players instead of %zu\n", name.c_str(), result.players.size(), players.size());
+				return false;
+			}
+
+			for (size_t i = 0; i < players.size(); i++)
+			{
+				const auto& a = result.players[i];
+				const auto& b = players[i];
+
+				if (a.index != b.index || a.name != b.name || a.score != b.score || a.duration != b.duration)
+				{
+					printf("%s: wrong player %zu\n", name.c_str(), i);
+					return false;
+				}
+			}
+		}
+
+		if ((result.queries & ServerQueryEngine::Query::Rules) && result.rules != server.getRules())
+		{
+			printf("%s: %zu rules instead of %zu or different values\n", name.c_str(), result.rules.size(), server.getRules().size());
+			return false;
+		}
+
+		return true;
+	}
+
+	bool CheckQueries()
+	{
+		Loop loop(2);
+
+		auto& first = *loop.servers[0];
+		auto& second = *loop.servers[1];
+
+		// second one asks challenge for players only, like old servers
+
+		second.setChallengeRequired(false);
+		second.setSplitSize(500); // more parts, 15 at most
+
+		loop.query(FirstServerPort, ServerQueryEngine::Query::All);
+		loop.query(FirstServerPort + 1, ServerQueryEngine::Query::All);
+
+		if (!loop.run())
+			return false;
+
+		for (const auto& result : loop.results)
+		{
+			if (!CheckResult(result, loop.getServer(result.address)))
+				return false;
+		}
+
+		// info without challenge, then info, players and rules with it
+
+		if (first.getRequestsCount() != 4 || second.getRequestsCount() != 4)
+		{
+			printf("wrong requests count: %llu and %llu instead of 4\n", (unsigned long long)first.getRequestsCount(),
+				(unsigned long long)second.getRequestsCount());
+			return false;
+		}
+
+		// everything is cached now, no requests and answer right away
+
+		loop.results.clear();
+		loop.query(FirstServerPort, ServerQueryEngine::Query::Info | ServerQueryEngine::Query::Rules);
+
+		if (loop.pending != 0 || loop.results.size() != 1 || !CheckResult(loop.results[0], first) ||
+			loop.engine->getStats().cache_hits != 1 || first.getRequestsCount() != 4)
+		{
+			puts("no cache hit");
+			return false;
+		}
+
+		// cleared cache goes to server again
+
+		loop.engine->clearCache();
+		loop.results.clear();
+		loop.query(FirstServerPort, ServerQueryEngine::Query::Info);
+
+		if (!loop.run() || !CheckResult(loop.results[0], first) || first.getRequestsCount() != 6)
+		{
+			printf("no requests after cache is cleared: %llu\n", (unsigned long long)first.getRequestsCount());
+			return false;
+		}
+
+		return true;
+	}
+
+	bool CheckRetries()
+	{
+		Loop loop(4);
+
+		loop.engine->setTimeout(Clock::FromSeconds(0.05f));
+		loop.engine->setRetries(20);
+
+		for (auto& server : loop.servers)
+			server->setDropRate(0.5f);
+
+		for (size_t i = 0; i < loop.servers.size(); i++)
+			loop.query(static_cast<uint16_t>(FirstServerPort + i), ServerQueryEngine::Query::All);
+
+		if (!loop.run(20.0))
+			return false;
+
+		for (const auto& result : loop.results)
+		{
+			if (!CheckResult(result, loop.getServer(result.address)))
+				return false;
+		}
+
+		const auto& stats = loop.engine->getStats();
+
+		if (stats.retries == 0 || stats.completed != loop.servers.size())
+		{
+			printf("lost requests: %llu retries, %llu completed\n", (unsigned long long)stats.retries,
+				(unsigned long long)stats.completed);
+			return false;
+		}
+
+		// nobody answers, engine gives up after retries of every query
+
+		loop.engine->setRetries(1);
+		loop.results.clear();
+		loop.query(DeadServerPort, ServerQueryEngine::Query::Info | ServerQueryEngine::Query::Players);
+
+		if (!loop.run())
+			return false;
+
+		if (!loop.results[0].isTimedOut() || loop.results[0].completed != 0 || stats.timed_out != 1)
+		{
+			puts("no timeout of dead server");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Check()
+	{
+		if (!CheckQueries() || !CheckRetries())
+			return false;
+
+		puts("check ok");
+		return true;
+	}
+
+	void Benchmark()
+	{
+		const size_t servers = 20;
+		const size_t rounds = 50;
+
+		Loop loop(servers);
+		loop.engine->setPacketsPerSecond(100000);
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t round = 0; round < rounds; round++)
+		{
+			loop.engine->clearCache();
+
+			for (size_t i = 0; i < servers; i++)
+				loop.query(static_cast<uint16_t>(FirstServerPort + i), ServerQueryEngine::Query::All);
+
+			loop.run();
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const auto& stats = loop.engine->getStats();
+
+		printf("%llu of %zu queries completed, %.0f queries/s, %llu packets sent, %llu received\n",
+			(unsigned long long)stats.completed, servers * rounds, stats.completed / seconds,
+			(unsigned long long)stats.packets_sent, (unsigned long long)stats.packets_received);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
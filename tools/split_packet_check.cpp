@@ -0,0 +1,305 @@
+// checks split connectionless packets of Networking: payloads of all sizes up
+// to 15 parts are split at several split sizes, parts come back in order,
+// reordered and duplicated, and reassembled payload must be byte identical.
+// then measures split and reassembly of large replies
+//
+// usage: split_packet_check            - check, then benchmark
+//        split_packet_check --check    - check only
+
+#include <HL/networking.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	const size_t HeaderSize = 9; // -2, int32 id, 4 bits total, 4 bits index
+
+	// sent datagrams are kept instead of going to socket, received ones are fed by hand
+
+	class Loop : public Networking
+	{
+	public:
+		void send(const std::vector<uint8_t>& payload)
+		{
+			Network::Packet packet;
+			packet.adr = Network::Address("127.0.0.1:27015");
+			packet.buf.write((void*)payload.data(), payload.size());
+			sendConnectionlessPacket(packet);
+		}
+
+		void receive(const Network::Packet& datagram)
+		{
+			Network::Packet packet;
+			packet.adr = datagram.adr;
+			packet.buf.write(datagram.buf.getMemory(), datagram.buf.getSize());
+			readPacket(packet);
+		}
+
+	protected:
+		void sendPacket(Network::Packet& packet) override
+		{
+			Network::Packet copy;
+			copy.adr = packet.adr;
+			copy.buf.write(packet.buf.getMemory(), packet.buf.getSize());
+			sent.push_back(std::move(copy));
+		}
+
+		void readConnectionlessPacket(Network::Packet& packet) override
+		{
+			auto data = (const uint8_t*)packet.buf.getPositionMemory();
+			received.emplace_back(data, data + packet.buf.getRemaining());
+		}
+
+		void readRegularPacket(Network::Packet&) override
+		{
+			regular += 1;
+		}
+
+	public:
+		std::vector<Network::Packet> sent;
+		std::vector<std::vector<uint8_t>> received;
+		size_t regular = 0;
+	};
+
+	std::vector<uint8_t> MakePayload(std::mt19937& rng, size_t size)
+	{
+		std::vector<uint8_t> result(size);
+
+		for (auto& byte : result)
+			byte = static_cast<uint8_t>(rng());
+
+		// starts like a reply, so nothing looks like a nested split header
+
+		if (size > 0)
+			result[0] = 'E';
+
+		return result;
+	}
+
+	size_t GetParts(size_t split_size, size_t payload_size)
+	{
+		auto size = payload_size + 4;
+		auto part_size = split_size - HeaderSize;
+		return size <= split_size ? 1 : (size + part_size - 1) / part_size;
+	}
+
+	enum class Order
+	{
+		InOrder,
+		Reordered,
+		Duplicated
+	};
+
+	const char* GetOrderName(Order order)
+	{
+		switch (order)
+		{
+		case Order::InOrder: return "in order";
+		case Order::Reordered: return "reordered";
+		default: return "duplicated";
+		}
+	}
+
+	bool CheckPayload(std::mt19937& rng, Loop& loop, size_t split_size, size_t payload_size, Order order)
+	{
+		auto payload = MakePayload(rng, payload_size);
+
+		loop.sent.clear();
+		loop.received.clear();
+		loop.send(payload);
+
+		auto expected_parts = GetParts(split_size, payload_size);
+
+		if (loop.sent.size() != expected_parts)
+		{
+			printf("split size %zu, payload %zu: %zu parts instead of %zu\n", split_size, payload_size,
+				loop.sent.size(), expected_parts);
+			return false;
+		}
+
+		for (const auto& part : loop.sent)
+		{
+			if (part.buf.getSize() > split_size)
+			{
+				printf("split size %zu, payload %zu: part of %zu bytes\n", split_size, payload_size, (size_t)part.buf.getSize());
+				return false;
+			}
+		}
+
+		std::vector<size_t> sequence(loop.sent.size());
+
+		for (size_t i = 0; i < sequence.size(); i++)
+			sequence[i] = i;
+
+		if (order != Order::InOrder)
+			std::shuffle(sequence.begin(), sequence.end(), rng);
+
+		// every part twice, some repeated right away, some after the packet is complete
+
+		if (order == Order::Duplicated)
+		{
+			auto copy = sequence;
+
+			for (size_t i = 0; i < copy.size(); i++)
+				sequence.insert(sequence.begin() + rng() % (sequence.size() + 1), copy[i]);
+		}
+
+		for (auto i : sequence)
+			loop.receive(loop.sent[i]);
+
+		if (loop.regular != 0)
+		{
+			printf("split size %zu, payload %zu, %s: parsed as regular packet\n", split_size, payload_size, GetOrderName(order));
+			return false;
+		}
+
+		// duplicates after completion start a new buffer, which completes again
+		// only when all parts are repeated, like in one part packet
+
+		if (loop.received.empty() || (order != Order::Duplicated && loop.received.size() != 1))
+		{
+			printf("split size %zu, payload %zu, %s: %zu packets reassembled\n", split_size, payload_size,
+				GetOrderName(order), loop.received.size());
+			return false;
+		}
+
+		for (const auto& received : loop.received)
+		{
+			if (received != payload)
+			{
+				printf("split size %zu, payload %zu, %s: payload is damaged\n", split_size, payload_size, GetOrderName(order));
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Check()
+	{
+		std::mt19937 rng(1);
+
+		for (size_t split_size : { 64, 100, 577, 1400 })
+		{
+			Loop loop;
+			loop.setSplitSize(split_size);
+
+			auto part_size = split_size - HeaderSize;
+			auto max_payload = Networking::MaxSplitParts * part_size - 4;
+
+			// around every part boundary, up to the 15 parts limit
+
+			std::vector<size_t> sizes = { 1, split_size - 5, split_size - 4, split_size - 3, max_payload };
+
+			for (size_t parts = 2; parts <= Networking::MaxSplitParts; parts++)
+			{
+				sizes.push_back(parts * part_size - 4);
+				sizes.push_back(parts * part_size - 5);
+				sizes.push_back((parts - 1) * part_size - 3);
+			}
+
+			for (auto size : sizes)
+			{
+				for (auto order : { Order::InOrder, Order::Reordered, Order::Duplicated })
+				{
+					if (!CheckPayload(rng, loop, split_size, size, order))
+						return false;
+				}
+			}
+
+			// one byte more than 15 parts can carry is not sent at all
+
+			loop.sent.clear();
+			loop.send(MakePayload(rng, max_payload + 1));
+
+			if (!loop.sent.empty())
+			{
+				printf("split size %zu: %zu parts sent for too large payload\n", split_size, loop.sent.size());
+				return false;
+			}
+		}
+
+		// parts of two packets interleaved, each comes back whole
+
+		Loop loop;
+		loop.setSplitSize(200);
+
+		auto a = MakePayload(rng, 1000);
+		auto b = MakePayload(rng, 1500);
+
+		loop.send(a);
+		auto parts_a = std::move(loop.sent);
+		loop.sent.clear();
+
+		loop.send(b);
+		auto parts_b = std::move(loop.sent);
+
+		for (size_t i = 0; i < std::max(parts_a.size(), parts_b.size()); i++)
+		{
+			if (i < parts_b.size())
+				loop.receive(parts_b[parts_b.size() - 1 - i]);
+
+			if (i < parts_a.size())
+				loop.receive(parts_a[i]);
+		}
+
+		if (loop.received.size() != 2 || loop.received[0] != a || loop.received[1] != b)
+		{
+			printf("interleaved packets: %zu reassembled\n", loop.received.size());
+			return false;
+		}
+
+		puts("check ok");
+		return true;
+	}
+
+	void Benchmark()
+	{
+		std::mt19937 rng(2);
+
+		Loop loop;
+		auto payload = MakePayload(rng, 8000); // big A2S_RULES reply
+
+		const size_t count = 20000;
+		size_t parts = 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			loop.sent.clear();
+			loop.received.clear();
+			loop.send(payload);
+
+			for (auto it = loop.sent.rbegin(); it != loop.sent.rend(); ++it)
+				loop.receive(*it);
+
+			parts += loop.sent.size();
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%zu packets of %zu bytes in %zu parts, %.0f packets/s, %.2f us/packet\n", count, payload.size(),
+			parts / count, count / seconds, seconds * 1e6 / count);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}
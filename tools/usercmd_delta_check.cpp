@@ -0,0 +1,271 @@
+// checks Delta::writeUserCmd against the encoder it replaced, which compared
+// field names and values on every call, over random commands. then measures both
+//
+// usage: usercmd_delta_check            - check, then benchmark
+//        usercmd_delta_check --check    - check only
+
+#include <HL/delta.h>
+#include <common/buffer_helpers.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HL;
+
+namespace
+{
+	// usercmd_t as goldsrc servers send it
+
+	const Delta::Table UserCmdTable = {
+		{ "lerp_msec", DT_SHORT, 9, 1.0f, 1.0f },
+		{ "msec", DT_BYTE, 8, 1.0f, 1.0f },
+		{ "viewangles[1]", DT_ANGLE, 16, 1.0f, 1.0f },
+		{ "viewangles[0]", DT_ANGLE, 16, 1.0f, 1.0f },
+		{ "buttons", DT_SHORT, 16, 1.0f, 1.0f },
+		{ "forwardmove", DT_FLOAT | DT_SIGNED, 12, 1.0f, 1.0f },
+		{ "lightlevel", DT_BYTE, 8, 1.0f, 1.0f },
+		{ "sidemove", DT_FLOAT | DT_SIGNED, 12, 1.0f, 1.0f },
+		{ "upmove", DT_FLOAT | DT_SIGNED, 12, 1.0f, 1.0f },
+		{ "impulse", DT_BYTE, 8, 1.0f, 1.0f },
+		{ "viewangles[2]", DT_ANGLE, 16, 1.0f, 1.0f },
+		{ "impact_index", DT_INTEGER, 6, 1.0f, 1.0f },
+		{ "weaponselect", DT_BYTE, 8, 1.0f, 1.0f },
+	};
+
+	// svc_deltadescription body, fields encoded with g_MetaDelta
+
+	sky::BitBuffer MakeDescription(const Delta::Table& table)
+	{
+		sky::BitBuffer result;
+
+		for (const auto& field : table)
+		{
+			uint8_t marks = 1 | 2 | 16 | 32 | 64; // type, name, bits, premultiply, postmultiply
+
+			result.writeBits(1, 3);
+			result.write(&marks, 1);
+			result.writeBits(static_cast<uint32_t>(field.type), 32);
+			sky::bitbuffer_helpers::WriteString(result, field.name);
+			result.writeBits(static_cast<uint32_t>(field.bits), 8);
+			result.writeBits(static_cast<uint32_t>(field.scale * 4000.0f), 32);
+			result.writeBits(static_cast<uint32_t>(field.pscale * 4000.0f), 32);
+		}
+
+		return result;
+	}
+
+	// as it was before compiling, value of field found by name on every call
+
+	bool ReferenceValue(const std::string& name, const Protocol::UserCmd& cmd, float& value)
+	{
+#define V(X) if (name == #X) { value = static_cast<float>(cmd.X); return true; }
+		V(lerp_msec) V(msec)
+		V(viewangles[0]) V(viewangles[1]) V(viewangles[2])
+		V(forwardmove) V(sidemove) V(upmove)
+		V(lightlevel) V(buttons) V(impulse) V(weaponselect)
+		V(impact_index)
+		V(impact_position[0]) V(impact_position[1]) V(impact_position[2])
+#undef V
+		return false;
+	}
+
+	void ReferenceWriteUserCmd(sky::BitBuffer& msg, const Delta::Table& table, const Protocol::UserCmd& newCmd,
+		const Protocol::UserCmd& oldCmd)
+	{
+		uint64_t marks = 0;
+		int lastMark = -1;
+
+		for (int i = 0; i < (int)table.size(); i++)
+		{
+			float a;
+			float b;
+
+			if (!ReferenceValue(table[i].name, newCmd, a) || !ReferenceValue(table[i].name, oldCmd, b) || a == b)
+				continue;
+
+			marks |= 1ULL << i;
+			lastMark = i;
+		}
+
+		uint32_t count = lastMark == -1 ? 0 : (lastMark >> 3) + 1;
+
+		msg.writeBits(count, 3);
+		msg.write(&marks, count);
+
+		for (int i = 0; i < (int)table.size(); i++)
+		{
+			if (!(marks & (1ULL << i)))
+				continue;
+
+			const auto& field = table[i];
+
+			bool sign = field.type & DT_SIGNED;
+			int type = field.type & ~DT_SIGNED;
+
+			float value;
+			ReferenceValue(field.name, newCmd, value);
+
+			if (type == DT_ANGLE)
+			{
+				sky::bitbuffer_helpers::WriteBitAngle(msg, value, field.bits);
+				continue;
+			}
+
+			// old encoder divided by scale here, same output for scale 1
+
+			if (type == DT_FLOAT)
+				value = value / field.pscale * field.scale;
+
+			if (sign)
+				sky::bitbuffer_helpers::WriteSBits(msg, static_cast<int32_t>(value), field.bits);
+			else
+				msg.writeBits(static_cast<uint32_t>(static_cast<int64_t>(value)), field.bits);
+		}
+	}
+
+	Protocol::UserCmd MakeCommand(std::mt19937& rng, const Protocol::UserCmd& prev)
+	{
+		auto result = prev;
+
+		// most commands change angles and moves only, some change everything
+
+		bool all = rng() % 16 == 0;
+
+		if (all || rng() % 2) result.msec = static_cast<uint8_t>(rng() % 50);
+		if (all || rng() % 2) result.viewangles[0] = static_cast<float>(rng() % 3600) / 10.0f;
+		if (all || rng() % 3 == 0) result.viewangles[1] = static_cast<float>(rng() % 3600) / 10.0f;
+		if (all || rng() % 8 == 0) result.viewangles[2] = static_cast<float>(rng() % 360);
+		if (all || rng() % 2) result.forwardmove = static_cast<float>(static_cast<int>(rng() % 801) - 400);
+		if (all || rng() % 5 == 0) result.sidemove = static_cast<float>(static_cast<int>(rng() % 801) - 400);
+		if (all || rng() % 9 == 0) result.upmove = static_cast<float>(static_cast<int>(rng() % 801) - 400);
+		if (all || rng() % 4 == 0) result.buttons = static_cast<unsigned short>(rng());
+		if (all || rng() % 6 == 0) result.lerp_msec = static_cast<short>(rng() % 512);
+		if (all || rng() % 6 == 0) result.lightlevel = static_cast<uint8_t>(rng());
+		if (all || rng() % 10 == 0) result.impulse = static_cast<uint8_t>(rng());
+		if (all || rng() % 10 == 0) result.weaponselect = static_cast<uint8_t>(rng());
+		if (all || rng() % 10 == 0) result.impact_index = static_cast<int>(rng() % 64);
+
+		return result;
+	}
+
+	std::vector<Protocol::UserCmd> MakeCommands(uint32_t seed, size_t count)
+	{
+		std::mt19937 rng(seed);
+		std::vector<Protocol::UserCmd> result;
+		result.reserve(count);
+
+		Protocol::UserCmd prev = { };
+
+		for (size_t i = 0; i < count; i++)
+		{
+			prev = MakeCommand(rng, prev);
+			result.push_back(prev);
+		}
+
+		return result;
+	}
+
+	Delta MakeDelta()
+	{
+		auto description = MakeDescription(UserCmdTable);
+		BitReader msg(description.getMemory(), description.getSize());
+
+		Delta result;
+		result.add(msg, S_DELTA_USERCMD, static_cast<uint32_t>(UserCmdTable.size()));
+		return result;
+	}
+
+	bool Check()
+	{
+		auto delta = MakeDelta();
+		auto commands = MakeCommands(1, 20000);
+
+		Protocol::UserCmd prev = { };
+
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			// same command again is an empty delta, servers get those in backups
+
+			const auto& cmd = commands[i];
+			const auto& from = i % 7 == 0 ? cmd : prev;
+
+			sky::BitBuffer a;
+			sky::BitBuffer b;
+
+			delta.writeUserCmd(a, cmd, from);
+			ReferenceWriteUserCmd(b, UserCmdTable, cmd, from);
+
+			if (a.getSize() != b.getSize() || memcmp(a.getMemory(), b.getMemory(), a.getSize()) != 0)
+			{
+				printf("usercmd mismatch: command %zu, %zu != %zu bytes\n", i, (size_t)a.getSize(), (size_t)b.getSize());
+				return false;
+			}
+
+			prev = cmd;
+		}
+
+		// no table, no guessing
+
+		try
+		{
+			Delta empty;
+			sky::BitBuffer msg;
+			empty.writeUserCmd(msg, commands[0], prev);
+			puts("no error without usercmd_t table");
+			return false;
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+
+		puts("check ok");
+		return true;
+	}
+
+	template <typename F>
+	void Measure(const char* name, size_t count, F&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%-20s %8.1f ms %8.1f ns/cmd\n", name, seconds * 1000.0, seconds * 1e9 / count);
+	}
+
+	void Benchmark()
+	{
+		auto delta = MakeDelta();
+		auto commands = MakeCommands(2, 1000000);
+
+		sky::BitBuffer a;
+		sky::BitBuffer b;
+
+		Measure("reference", commands.size(), [&] {
+			for (size_t i = 1; i < commands.size(); i++)
+				ReferenceWriteUserCmd(a, UserCmdTable, commands[i], commands[i - 1]);
+		});
+
+		Measure("Delta::writeUserCmd", commands.size(), [&] {
+			for (size_t i = 1; i < commands.size(); i++)
+				delta.writeUserCmd(b, commands[i], commands[i - 1]);
+		});
+
+		printf("%zu bytes (%s)\n", (size_t)b.getSize(), a.getSize() == b.getSize() ? "same size" : "different size");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (!Check())
+		return 1;
+
+	if (argc > 1 && std::string(argv[1]) == "--check")
+		return 0;
+
+	Benchmark();
+	return 0;
+}